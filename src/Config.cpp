@@ -0,0 +1,340 @@
+#include "Config.h"
+#include <ArduinoJson.h>
+#include <algorithm>
+
+#define TAG "Config"
+
+namespace weightwhiskers
+{
+
+    namespace
+    {
+        constexpr ConfigField fields[] = {
+            { "mqttEnabled", "MQTT Enabled", &Config::mqtt_enabled, false },
+            { "mqttServer", "MQTT Server", &Config::mqtt_server, "" },
+            { "mqttPort", "MQTT Port", &Config::mqtt_port, 1883, 1, 65535 },
+            { "mqttUser", "MQTT User", &Config::mqtt_user, "kitty" },
+            { "mqttPass", "MQTT Password", &Config::mqtt_pass, "kitty" },
+            { "mqttTopicCatWeight", "MQTT topic cat weight", &Config::mqtt_topic_cat_weight,
+                "home/cat/scale/measured", 128 },
+            { "mqttTopicCurrentWeight", "MQTT topic current weight",
+                &Config::mqtt_topic_current_weight, "home/cat/scale/current", 128 },
+            { "scaleCalibValue", "Scale calib value (is calculated)", &Config::scale_calib_value,
+                1.f, -100000.f, 100000.f },
+            { "scaleCalibWeight", "Scale calib weight (gram)", &Config::scale_calib_weight, 500, 1,
+                20000 },
+            { "scaleWeightMin", "Scale minimum weight (gram)", &Config::scale_weight_min, 2000, 0,
+                20000 },
+            { "scaleTareTime", "Scale tare time (ms)", &Config::scale_tare_time, 60000, 1000,
+                3600000 },
+            { "scaleTareThresh", "Scale auto tare threshold (gram)", &Config::scale_tare_thresh, 50,
+                0, 1000 },
+            { "presenceTimeMin", "Minimum presence time (s)", &Config::presence_time_min, 5.f, 0.f,
+                600.f },
+            { "scaleWeightDeviationPercent", "Weight deviation filter (0 = disabled)",
+                &Config::scale_weight_deviation_percent, 0.f, 0.f, 1.f },
+        };
+        constexpr size_t fieldCount = sizeof(fields) / sizeof(fields[0]);
+
+        constexpr size_t length(const char* text) { return *text ? 1 + length(text + 1) : 0; }
+
+        // keys and texts are copied when parsing a file
+        constexpr size_t capacity(size_t i = 0)
+        {
+            return i == fieldCount
+                ? JSON_OBJECT_SIZE(fieldCount)
+                : JSON_STRING_SIZE(length(fields[i].key))
+                    + (fields[i].type == ConfigField::Type::Text
+                            ? JSON_STRING_SIZE((size_t)fields[i].maximum)
+                            : 0)
+                    + capacity(i + 1);
+        }
+        // count byte, values in binary and texts with a length byte
+        constexpr size_t encodedSize(size_t i = 0)
+        {
+            return i == fieldCount ? 1
+                                   : (fields[i].type == ConfigField::Type::Text
+                                             ? 1 + (size_t)fields[i].maximum
+                                             : fields[i].type == ConfigField::Type::Bool ? 1 : 4)
+                    + encodedSize(i + 1);
+        }
+        static_assert(encodedSize() <= CONFIG_ENCODED_SIZE, "CONFIG_ENCODED_SIZE is too small");
+
+        // type, title, default, minimum and maximum of every field, all strings are constant
+        constexpr size_t schemaCapacity = JSON_OBJECT_SIZE(3) + JSON_OBJECT_SIZE(fieldCount)
+            + fieldCount * JSON_OBJECT_SIZE(5);
+
+        typedef StaticJsonDocument<capacity()> ConfigDocument;
+        typedef StaticJsonDocument<JSON_OBJECT_SIZE(fieldCount)> ConfigFilter;
+
+        // only keep known keys, the capacity doesn't allow more
+        void createFilter(ConfigFilter& filter)
+        {
+            for (auto& field : fields) {
+                filter[field.key] = true;
+            }
+        }
+
+        bool isValid(const ConfigField& field, JsonVariant value)
+        {
+            switch (field.type) {
+            case ConfigField::Type::Bool:
+                return value.is<bool>();
+            case ConfigField::Type::Int:
+                return value.is<int>() && value.as<int>() >= field.minimum
+                    && value.as<int>() <= field.maximum;
+            case ConfigField::Type::Float:
+                return value.is<float>() && value.as<float>() >= field.minimum
+                    && value.as<float>() <= field.maximum;
+            case ConfigField::Type::Text:
+                return value.is<const char*>() && strlen(value.as<const char*>()) <= field.maximum;
+            }
+            return false;
+        }
+
+        void read(const ConfigField& field, JsonVariant value, Config& config)
+        {
+            switch (field.type) {
+            case ConfigField::Type::Bool:
+                config.*field.boolean = value.as<bool>();
+                break;
+            case ConfigField::Type::Int:
+                config.*field.integer = value.as<int>();
+                break;
+            case ConfigField::Type::Float:
+                config.*field.real = value.as<float>();
+                break;
+            case ConfigField::Type::Text:
+                config.*field.string = value.as<const char*>();
+                break;
+            }
+        }
+
+        void write(const ConfigField& field, const Config& config, JsonDocument& doc)
+        {
+            switch (field.type) {
+            case ConfigField::Type::Bool:
+                doc[field.key] = config.*field.boolean;
+                break;
+            case ConfigField::Type::Int:
+                doc[field.key] = config.*field.integer;
+                break;
+            case ConfigField::Type::Float:
+                doc[field.key] = config.*field.real;
+                break;
+            case ConfigField::Type::Text:
+                doc[field.key] = config.*field.string;
+                break;
+            }
+        }
+
+        void write(const Config& config, ConfigDocument& doc)
+        {
+            for (auto& field : fields) {
+                write(field, config, doc);
+            }
+        }
+    }
+
+    Config::Config()
+    {
+        for (auto& field : fields) {
+            switch (field.type) {
+            case ConfigField::Type::Bool:
+                this->*field.boolean = field.defaultNumber;
+                break;
+            case ConfigField::Type::Int:
+                this->*field.integer = field.defaultNumber;
+                break;
+            case ConfigField::Type::Float:
+                this->*field.real = field.defaultNumber;
+                break;
+            case ConfigField::Type::Text:
+                this->*field.string = field.defaultText;
+                break;
+            }
+        }
+    }
+
+    bool ConfigSchema::load(Stream& in, Config& config)
+    {
+        ConfigFilter filter;
+        createFilter(filter);
+        ConfigDocument doc;
+        DeserializationError error
+            = deserializeJson(doc, in, DeserializationOption::Filter(filter));
+        if (error) {
+            ESP_LOGE(TAG, "Failed to deserialize config file: %s", error.c_str());
+            return false;
+        }
+        for (auto& field : fields) {
+            JsonVariant value = doc[field.key];
+            if (value.isNull()) {
+                continue;
+            }
+            if (!isValid(field, value)) {
+                ESP_LOGW(TAG, "Ignoring invalid value of %s", field.key);
+                continue;
+            }
+            read(field, value, config);
+        }
+        return true;
+    }
+
+    const char* ConfigSchema::parse(const uint8_t* data, size_t size, Config& config)
+    {
+        ConfigFilter filter;
+        createFilter(filter);
+        ConfigDocument doc;
+        DeserializationError error = deserializeJson(
+            doc, (const char*)data, size, DeserializationOption::Filter(filter));
+        if (error) {
+            return error.c_str();
+        }
+        // validate everything before changing anything
+        for (auto& field : fields) {
+            JsonVariant value = doc[field.key];
+            if (!value.isNull() && !isValid(field, value)) {
+                return field.key;
+            }
+        }
+        for (auto& field : fields) {
+            JsonVariant value = doc[field.key];
+            if (!value.isNull()) {
+                read(field, value, config);
+            }
+        }
+        return nullptr;
+    }
+
+    void ConfigSchema::serialize(const Config& config, Print& out)
+    {
+        ConfigDocument doc;
+        write(config, doc);
+        serializeJson(doc, out);
+    }
+
+    size_t ConfigSchema::encode(const Config& config, uint8_t* buffer, size_t size)
+    {
+        if (size < encodedSize()) {
+            return 0;
+        }
+        uint8_t* position = buffer;
+        *position++ = fieldCount;
+        for (auto& field : fields) {
+            switch (field.type) {
+            case ConfigField::Type::Bool:
+                *position++ = config.*field.boolean;
+                break;
+            case ConfigField::Type::Int:
+                memcpy(position, &(config.*field.integer), 4);
+                position += 4;
+                break;
+            case ConfigField::Type::Float:
+                memcpy(position, &(config.*field.real), 4);
+                position += 4;
+                break;
+            case ConfigField::Type::Text: {
+                const String& text = config.*field.string;
+                uint8_t length = std::min<size_t>(text.length(), field.maximum);
+                *position++ = length;
+                memcpy(position, text.c_str(), length);
+                position += length;
+                break;
+            }
+            }
+        }
+        return position - buffer;
+    }
+
+    bool ConfigSchema::decode(const uint8_t* buffer, size_t size, Config& config)
+    {
+        const uint8_t* end = buffer + size;
+        if (!size) {
+            return false;
+        }
+        size_t count = std::min<size_t>(*buffer++, fieldCount);
+        for (size_t i = 0; i < count; i++) {
+            auto& field = fields[i];
+            switch (field.type) {
+            case ConfigField::Type::Bool:
+                if (end - buffer < 1) {
+                    return false;
+                }
+                config.*field.boolean = *buffer++;
+                break;
+            case ConfigField::Type::Int:
+                if (end - buffer < 4) {
+                    return false;
+                }
+                memcpy(&(config.*field.integer), buffer, 4);
+                buffer += 4;
+                break;
+            case ConfigField::Type::Float:
+                if (end - buffer < 4) {
+                    return false;
+                }
+                memcpy(&(config.*field.real), buffer, 4);
+                buffer += 4;
+                break;
+            case ConfigField::Type::Text: {
+                if (end - buffer < 1 || end - buffer - 1 < buffer[0] || buffer[0] > field.maximum) {
+                    return false;
+                }
+                // the length byte limits texts to 255 characters
+                char text[256];
+                size_t length = *buffer++;
+                memcpy(text, buffer, length);
+                text[length] = 0;
+                config.*field.string = text;
+                buffer += length;
+                break;
+            }
+            }
+        }
+        return true;
+    }
+
+    void ConfigSchema::serializeSchema(Print& out)
+    {
+        StaticJsonDocument<schemaCapacity> doc;
+        doc["title"] = "Config";
+        doc["type"] = "object";
+        JsonObject properties = doc.createNestedObject("properties");
+        for (auto& field : fields) {
+            JsonObject property = properties.createNestedObject(field.key);
+            property["title"] = field.title;
+            switch (field.type) {
+            case ConfigField::Type::Bool:
+                property["type"] = "boolean";
+                property["default"] = field.defaultNumber != 0;
+                break;
+            case ConfigField::Type::Int:
+                property["type"] = "integer";
+                property["default"] = (int)field.defaultNumber;
+                property["minimum"] = (int)field.minimum;
+                property["maximum"] = (int)field.maximum;
+                break;
+            case ConfigField::Type::Float:
+                property["type"] = "number";
+                property["default"] = field.defaultNumber;
+                property["minimum"] = field.minimum;
+                property["maximum"] = field.maximum;
+                break;
+            case ConfigField::Type::Text:
+                property["type"] = "string";
+                property["default"] = field.defaultText;
+                property["maxLength"] = (int)field.maximum;
+                break;
+            }
+        }
+        serializeJson(doc, out);
+    }
+
+    const ConfigField* ConfigSchema::getFields(size_t& count)
+    {
+        count = fieldCount;
+        return fields;
+    }
+
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <Arduino.h>
+
+// default maximum length of text values
+#define CONFIG_TEXT_LENGTH 64
+// upper bound of the binary encoding of all fields
+#define CONFIG_ENCODED_SIZE 768
+
+namespace weightwhiskers
+{
+
+    /**
+     * @brief Settings of the web interface, stored by ConfigStore and exchanged as JSON
+     *
+     * The keys, defaults and valid ranges are defined once in the field table of Config.cpp,
+     * which drives loading, saving, validation and the schema of the web API.
+     */
+    struct Config {
+        // MQTT
+        bool mqtt_enabled;
+        String mqtt_server;
+        int mqtt_port;
+        String mqtt_user;
+        String mqtt_pass;
+        String mqtt_topic_cat_weight;
+        String mqtt_topic_current_weight;
+        // scale
+        float scale_calib_value;
+        int scale_calib_weight; // gram
+        int scale_weight_min; // gram
+        // scale tare triggers
+        int scale_tare_time; // millis
+        int scale_tare_thresh; // gram
+        // presence detection
+        float presence_time_min; // seconds
+        // weight deviation filter (0.0 = disabled, 0.2 = ±20%)
+        float scale_weight_deviation_percent;
+
+        // default values of all fields
+        Config();
+    };
+
+    /**
+     * @brief describes one value of the Config
+     */
+    struct ConfigField {
+        enum class Type : uint8_t { Bool, Int, Float, Text };
+
+        constexpr ConfigField(const char* key, const char* title, bool Config::*member, bool value)
+            : key(key)
+            , title(title)
+            , type(Type::Bool)
+            , boolean(member)
+            , minimum(0)
+            , maximum(1)
+            , defaultNumber(value)
+            , defaultText(nullptr)
+        {
+        }
+        constexpr ConfigField(const char* key, const char* title, int Config::*member, int value,
+            int minimum, int maximum)
+            : key(key)
+            , title(title)
+            , type(Type::Int)
+            , integer(member)
+            , minimum(minimum)
+            , maximum(maximum)
+            , defaultNumber(value)
+            , defaultText(nullptr)
+        {
+        }
+        constexpr ConfigField(const char* key, const char* title, float Config::*member,
+            float value, float minimum, float maximum)
+            : key(key)
+            , title(title)
+            , type(Type::Float)
+            , real(member)
+            , minimum(minimum)
+            , maximum(maximum)
+            , defaultNumber(value)
+            , defaultText(nullptr)
+        {
+        }
+        constexpr ConfigField(const char* key, const char* title, String Config::*member,
+            const char* value, size_t maxLength = CONFIG_TEXT_LENGTH)
+            : key(key)
+            , title(title)
+            , type(Type::Text)
+            , string(member)
+            , minimum(0)
+            , maximum(maxLength)
+            , defaultNumber(0)
+            , defaultText(value)
+        {
+        }
+
+        // JSON key
+        const char* key;
+        // label in the web interface
+        const char* title;
+        Type type;
+        union {
+            bool Config::*boolean;
+            int Config::*integer;
+            float Config::*real;
+            String Config::*string;
+        };
+        // valid range of numbers, maximum length of texts
+        float minimum;
+        float maximum;
+        float defaultNumber;
+        const char* defaultText;
+    };
+
+    /**
+     * @brief loads, saves and validates the Config with the field table
+     */
+    class ConfigSchema
+    {
+    public:
+        // reads a JSON config file, missing or invalid values keep their current value
+        static bool load(Stream& in, Config& config);
+        /**
+         * @brief applies the values of a JSON object, e.g. a POST of the web interface
+         *
+         * Unknown keys are ignored, missing keys keep their current value.
+         * @return nullptr on success, otherwise the parser error or the key of an invalid value
+         * without changing the config
+         */
+        static const char* parse(const uint8_t* data, size_t size, Config& config);
+        static void serialize(const Config& config, Print& out);
+        /**
+         * @brief binary encoding in the order of the field table for storage
+         *
+         * Fields must only be appended to the table, older encodings then keep the default
+         * of new fields and newer encodings are read up to the known fields.
+         * @return size of the encoding, at most CONFIG_ENCODED_SIZE
+         */
+        static size_t encode(const Config& config, uint8_t* buffer, size_t size);
+        // false if the encoding is truncated or corrupt
+        static bool decode(const uint8_t* buffer, size_t size, Config& config);
+        // JSON schema of all fields for forms of the web interface
+        static void serializeSchema(Print& out);
+        // the field table in storage order
+        static const ConfigField* getFields(size_t& count);
+    };
+
+}
@@ -0,0 +1,115 @@
+#include "ConfigStore.h"
+#include "Crc32.h"
+
+#define TAG "ConfigStore"
+
+namespace weightwhiskers
+{
+
+    bool ConfigStore::begin()
+    {
+        if (!ready) {
+            ready = preferences.begin(CONFIG_STORE_NAMESPACE, false);
+        }
+        if (!ready) {
+            ESP_LOGE(TAG, "Cannot open NVS namespace " CONFIG_STORE_NAMESPACE);
+        }
+        return ready;
+    }
+
+    bool ConfigStore::load(Config& config)
+    {
+        if (!ready) {
+            return false;
+        }
+        uint8_t blob[sizeof(ConfigStoreHeader) + CONFIG_ENCODED_SIZE];
+        bool found = false;
+        for (uint8_t slot = 0; slot < 2; slot++) {
+            ConfigStoreHeader header;
+            if (!readSlot(slot, header, blob)) {
+                continue;
+            }
+            // skip a slot older than the one already loaded
+            if (found && header.sequence - sequence > UINT32_MAX / 2) {
+                continue;
+            }
+            // decode into a copy to keep config on errors
+            Config decoded;
+            if (!ConfigSchema::decode(blob + sizeof(header), header.size, decoded)) {
+                ESP_LOGW(TAG, "Cannot decode config slot %u", slot);
+                continue;
+            }
+            config = decoded;
+            current = slot;
+            sequence = header.sequence;
+            size = sizeof(header) + header.size;
+            found = true;
+        }
+        if (found) {
+            ESP_LOGI(TAG, "Loaded config slot %u, sequence %u", current, sequence);
+        }
+        return found;
+    }
+
+    bool ConfigStore::save(const Config& config)
+    {
+        if (!ready) {
+            return false;
+        }
+        uint8_t blob[sizeof(ConfigStoreHeader) + CONFIG_ENCODED_SIZE];
+        ConfigStoreHeader header;
+        header.size = ConfigSchema::encode(config, blob + sizeof(header), CONFIG_ENCODED_SIZE);
+        header.sequence = sequence + 1;
+        header.crc = checksum(header, blob + sizeof(header));
+        memcpy(blob, &header, sizeof(header));
+
+        // never touch the slot with the current config
+        uint8_t slot = current ^ 1;
+        size_t length = sizeof(header) + header.size;
+        if (preferences.putBytes(slotKey(slot), blob, length) != length) {
+            ESP_LOGE(TAG, "Cannot write config slot %u", slot);
+            return false;
+        }
+        current = slot;
+        sequence = header.sequence;
+        size = length;
+        return true;
+    }
+
+    size_t ConfigStore::getSize() const { return size; }
+
+    bool ConfigStore::readSlot(uint8_t slot, ConfigStoreHeader& header, uint8_t* blob)
+    {
+        const char* key = slotKey(slot);
+        size_t length = preferences.getBytesLength(key);
+        if (length < sizeof(header) || length > sizeof(header) + CONFIG_ENCODED_SIZE) {
+            return false;
+        }
+        if (preferences.getBytes(key, blob, length) != length) {
+            return false;
+        }
+        memcpy(&header, blob, sizeof(header));
+        if (header.magic != CONFIG_STORE_MAGIC
+            || header.version != CONFIG_STORE_VERSION
+            || header.size != length - sizeof(header)) {
+            ESP_LOGW(TAG, "Invalid header in config slot %u", slot);
+            return false;
+        }
+        // a torn write can combine a new header with the old config, so the header is covered
+        if (checksum(header, blob + sizeof(header)) != header.crc) {
+            ESP_LOGW(TAG, "CRC mismatch in config slot %u", slot);
+            return false;
+        }
+        return true;
+    }
+
+    const char* ConfigStore::slotKey(uint8_t slot) { return slot ? "slot1" : "slot0"; }
+
+    uint32_t ConfigStore::checksum(const ConfigStoreHeader& header, const uint8_t* data)
+    {
+        ConfigStoreHeader covered = header;
+        covered.crc = 0;
+        return crc32(data, header.size, crc32(&covered, sizeof(covered)));
+    }
+
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include "Config.h"
+
+#define CONFIG_STORE_MAGIC 0x43575757 // "WWWC"
+#define CONFIG_STORE_VERSION 2
+// NVS namespace of the config slots
+#define CONFIG_STORE_NAMESPACE "config"
+
+namespace weightwhiskers
+{
+
+    struct __attribute__((packed)) ConfigStoreHeader {
+        uint32_t magic = CONFIG_STORE_MAGIC;
+        uint16_t version = CONFIG_STORE_VERSION;
+        // size of the encoded config after the header
+        uint16_t size = 0;
+        // incremented with every save, the newest valid slot wins
+        uint32_t sequence = 0;
+        // CRC-32 of the header with crc = 0 and the encoded config
+        uint32_t crc = 0;
+    };
+
+    static_assert(sizeof(ConfigStoreHeader) == 16, "unexpected config header size");
+
+    /**
+     * @brief Keeps the config as a binary blob with CRC in two alternating NVS slots
+     *
+     * A save always overwrites the older slot, so a power loss during a write leaves at least
+     * the previous config intact. Loading takes the newest slot with a valid header and CRC.
+     * JSON is only used to migrate the old config file and for the web API.
+     */
+    class ConfigStore
+    {
+    public:
+        bool begin();
+        // false if no slot contains a valid config
+        bool load(Config& config);
+        bool save(const Config& config);
+        // size of the newest slot in bytes
+        size_t getSize() const;
+
+    protected:
+        // reads header and encoded config of slot 0 or 1 into blob, false if invalid
+        bool readSlot(uint8_t slot, ConfigStoreHeader& header, uint8_t* blob);
+        static const char* slotKey(uint8_t slot);
+        static uint32_t checksum(const ConfigStoreHeader& header, const uint8_t* data);
+
+        Preferences preferences;
+        bool ready = false;
+        // slot and sequence of the newest valid config
+        uint8_t current = 1;
+        uint32_t sequence = 0;
+        size_t size = 0;
+    };
+
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace weightwhiskers
+{
+
+    /**
+     * @brief CRC-32 (IEEE 802.3), pass the previous result as crc to continue a checksum
+     */
+    uint32_t crc32(const void* data, size_t length, uint32_t crc = 0);
+
+}
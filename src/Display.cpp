@@ -1,20 +1,38 @@
 #include "Display.h"
+#include "Metrics.h"
+
+#define TAG "Display"
 
 namespace weightwhiskers
 {
 
+    namespace
+    {
+        metrics::Histogram metricRenderDuration("display_update_seconds", "Display update time");
+    }
+
     Display::Display(TwoWire *twi)
     {
         this->twi = twi;
     }
 
-    bool Display::begin()
+    bool Display::begin(uint32_t stackSize)
     {
-        display = Adafruit_SSD1306(128, 64, twi);
-        display.begin(SSD1306_EXTERNALVCC, 0x3C); // Address 0x3C for 128x32
+        display = Adafruit_SSD1306(DISPLAY_WIDTH, DISPLAY_HEIGHT, twi);
+        display.begin(SSD1306_EXTERNALVCC, DISPLAY_ADDRESS);
         display.clearDisplay();
         display.display();
+        memcpy(frame, display.getBuffer(), sizeof(frame));
+        bytesSent += sizeof(frame);
 
+        if (stackSize && !taskHandle) {
+            queue = xQueueCreate(1, sizeof(Request));
+            if (!queue
+                || xTaskCreate(task, "taskDisplay", stackSize, this, 1, &taskHandle) != pdPASS) {
+                ESP_LOGE(TAG, "Cannot start display task");
+                return false;
+            }
+        }
         return true;
     }
 
@@ -25,70 +43,166 @@ namespace weightwhiskers
 
     void Display::drawBootScreen()
     {
-        display.clearDisplay();
-        display.setTextSize(DISPLAY_TEXT_SIZE);
-        display.setTextColor(WHITE);
-        display.drawBitmap(0, 0, icon, 128, 64, WHITE);
-        display.display();
+        Request request;
+        request.screen = Screen::Boot;
+        post(request);
     }
 
     void Display::drawError(String err)
     {
-        display.clearDisplay();
-        display.setTextSize(DISPLAY_TEXT_SIZE);
-        display.setTextColor(WHITE);
-        display.setCursor(0, 0);
-        display.println(err);
-        display.display();
+        postText(err.c_str());
     }
 
     void Display::drawText(String text)
     {
-        display.clearDisplay();
-        display.setTextSize(DISPLAY_TEXT_SIZE);
-        display.setTextColor(WHITE);
-        display.setCursor(0, 0);
-        display.println(text);
-        display.display();
+        postText(text.c_str());
     }
 
     void Display::drawWiFi()
     {
-        display.clearDisplay();
-        display.setTextSize(DISPLAY_TEXT_SIZE);
-        display.setTextColor(WHITE);
-        display.setCursor(0, 0);
-        display.println("WiFi...");
-        display.display();
+        postText("WiFi...");
     }
 
     void Display::drawWiFiAPMode()
     {
-        display.clearDisplay();
-        display.setTextSize(DISPLAY_TEXT_SIZE);
-        display.setTextColor(WHITE);
-        display.setCursor(0, 0);
-        display.println("AP Mode");
-        display.display();
+        postText("AP Mode");
     }
 
     void Display::drawTare()
     {
-        drawText("Tare...");
+        postText("Tare...");
     }
 
     void Display::drawCalib(int weight)
+    {
+        char text[DISPLAY_TEXT_LENGTH];
+        snprintf(text, sizeof(text), "Place %dg\nand press button\n", weight);
+        postText(text, 2);
+    }
+
+    void Display::drawWeightScreen(int weight, int lastWeight, int loadingBar)
+    {
+        Request request;
+        request.screen = Screen::Weight;
+        request.weight = weight;
+        request.lastWeight = lastWeight;
+        request.loadingBar = loadingBar;
+        request.wifi = wifi;
+        post(request);
+    }
+
+    void Display::drawOTA(float percentage)
+    {
+        Request request;
+        request.screen = Screen::OTA;
+        request.percentage = percentage;
+        post(request);
+    }
+
+    void Display::setWiFiState(int8_t wifi) { this->wifi = wifi; }
+
+    void Display::setSendDifference(bool enabled) { sendDifference = enabled; }
+
+    uint32_t Display::getBytesSent() const { return bytesSent; }
+
+    uint32_t Display::getSkippedFrames() const { return skippedFrames; }
+
+    void Display::postText(const char* text, uint8_t size)
+    {
+        Request request;
+        request.screen = Screen::Text;
+        request.textSize = size;
+        strlcpy(request.text, text, sizeof(request.text));
+        post(request);
+    }
+
+    void Display::post(const Request& request)
+    {
+        if (queue) {
+            // a text screen the task didn't take yet is not replaced by a weight screen, all
+            // screens are posted from the loop task, so it can only be taken meanwhile
+            Request pending;
+            if (request.screen == Screen::Weight && xQueuePeek(queue, &pending, 0) == pdTRUE
+                && pending.screen != Screen::Weight) {
+                return;
+            }
+            // replaces a request the task didn't take yet
+            xQueueOverwrite(queue, &request);
+        } else {
+            render(request);
+        }
+    }
+
+    void Display::task(void* parameter) { ((Display*)parameter)->run(); }
+
+    void Display::run()
+    {
+        Request request;
+        // another screen than the weight screen is shown since textShown
+        bool holding = false;
+        TickType_t textShown = 0;
+        while (true) {
+            if (xQueueReceive(queue, &request, portMAX_DELAY) != pdTRUE) {
+                continue;
+            }
+            if (request.screen != Screen::Weight) {
+                render(request);
+                holding = true;
+                textShown = xTaskGetTickCount();
+                continue;
+            }
+            // keep the text readable, the loop requests the next weight screen soon
+            if (holding && xTaskGetTickCount() - textShown < pdMS_TO_TICKS(DISPLAY_TEXT_HOLD_MS)) {
+                continue;
+            }
+            holding = false;
+            render(request);
+            // requests that arrive meanwhile are merged into the latest one
+            vTaskDelay(pdMS_TO_TICKS(DISPLAY_MIN_INTERVAL_MS));
+        }
+    }
+
+    void Display::render(const Request& request)
+    {
+        metrics::Timer timer(metricRenderDuration);
+        switch (request.screen) {
+        case Screen::Boot:
+            display.clearDisplay();
+            display.drawBitmap(0, 0, icon, 128, 64, WHITE);
+            flush();
+            break;
+        case Screen::Text:
+            renderText(request.text, request.textSize);
+            break;
+        case Screen::Weight:
+            renderWeightScreen(
+                request.weight, request.lastWeight, request.loadingBar, request.wifi);
+            break;
+        case Screen::OTA:
+            renderOTA(request.percentage);
+            break;
+        }
+    }
+
+    void Display::renderText(const char* text, uint8_t size)
     {
         display.clearDisplay();
-        display.setTextSize(2);
+        display.setTextSize(size);
         display.setTextColor(WHITE);
         display.setCursor(0, 0);
-        display.printf("Place %dg\nand press button\n", weight);
-        display.display();
+        display.println(text);
+        flush();
     }
 
-    void Display::drawWeightScreen(int weight, int lastWeight, int loadingBar)
+    void Display::renderWeightScreen(int weight, int lastWeight, int loadingBar, int8_t wifi)
     {
+        // skip rendering if nothing changed
+        WeightScreen screen = { weight, lastWeight, loadingBar > 0 ? loadingBar : 0, wifi };
+        if (weightScreenValid && !memcmp(&screen, &weightScreen, sizeof(screen))) {
+            skippedFrames++;
+            return;
+        }
+
         display.clearDisplay();
         display.setTextSize(DISPLAY_TEXT_SIZE);
         display.setTextColor(WHITE);
@@ -116,24 +230,12 @@ namespace weightwhiskers
         uint16_t currentHeight = barMinHeight;
         uint16_t startX = display.width() - 4 * barWidth - 4;
         uint16_t startY = display.height();
-        if (WiFi.getMode() == WIFI_STA)
+        if (screen.wifi != -2)
         {
-            if (WiFi.isConnected())
+            if (screen.wifi >= 0)
             {
-                auto rssi = WiFi.RSSI();
-                // display.setTextSize(1);
-                // display.setCursor(0, display.height() - 10);
-                // display.printf("%d", rssi);
                 display.setCursor(0, 0);
-                size_t bars = 4;
-                if (rssi >= -55)
-                    bars = 4;
-                else if (rssi >= -66)
-                    bars = 3;
-                else if (rssi >= -77)
-                    bars = 2;
-                else if (rssi >= -88)
-                    bars = 1;
+                size_t bars = screen.wifi;
                 for (size_t i = 0; i < bars; i++)
                 {
                     uint16_t x = startX + i * barWidth + i;
@@ -166,10 +268,12 @@ namespace weightwhiskers
         display.drawLine(middleX - iconWidth / 2, topY, middleX, display.height() - iconWidth / 2, WHITE);
         display.drawLine(middleX + iconWidth / 2, topY, middleX, display.height() - iconWidth / 2, WHITE);
 
-        display.display();
+        flush();
+        weightScreen = screen;
+        weightScreenValid = true;
     }
 
-    void Display::drawOTA(float percentage)
+    void Display::renderOTA(float percentage)
     {
         display.clearDisplay();
         display.setTextSize(2);
@@ -177,6 +281,61 @@ namespace weightwhiskers
         display.setCursor(0, 0);
         display.printf("Update:%u%%", (uint8_t)(percentage*100));
         display.writeFillRect(0, display.height() - 10, display.width() * percentage, display.height(), WHITE);
-        display.display();
+        flush();
+    }
+
+    void Display::flush()
+    {
+        weightScreenValid = false;
+        uint8_t* buffer = display.getBuffer();
+        if (!sendDifference) {
+            display.display();
+            memcpy(frame, buffer, sizeof(frame));
+            bytesSent += sizeof(frame);
+            return;
+        }
+        bool changed = false;
+        for (uint8_t page = 0; page < DISPLAY_HEIGHT / 8; page++) {
+            uint8_t* current = buffer + page * DISPLAY_WIDTH;
+            uint8_t* shown = frame + page * DISPLAY_WIDTH;
+            // changed columns of this page
+            int first = 0;
+            while (first < DISPLAY_WIDTH && current[first] == shown[first]) {
+                first++;
+            }
+            if (first == DISPLAY_WIDTH) {
+                continue;
+            }
+            int last = DISPLAY_WIDTH - 1;
+            while (current[last] == shown[last]) {
+                last--;
+            }
+            changed = true;
+
+            // address window, each command is sent with its control byte
+            display.ssd1306_command(SSD1306_COLUMNADDR);
+            display.ssd1306_command(first);
+            display.ssd1306_command(last);
+            display.ssd1306_command(SSD1306_PAGEADDR);
+            display.ssd1306_command(page);
+            display.ssd1306_command(page);
+            bytesSent += 6 * 2;
+
+            twi->setClock(DISPLAY_I2C_CLOCK);
+            for (int column = first; column <= last; column += DISPLAY_I2C_CHUNK) {
+                size_t length = min(DISPLAY_I2C_CHUNK, last + 1 - column);
+                twi->beginTransmission(DISPLAY_ADDRESS);
+                // data follows
+                twi->write((uint8_t)0x40);
+                twi->write(current + column, length);
+                twi->endTransmission();
+                bytesSent += length + 1;
+            }
+            twi->setClock(DISPLAY_I2C_CLOCK_IDLE);
+            memcpy(shown + first, current + first, last + 1 - first);
+        }
+        if (!changed) {
+            skippedFrames++;
+        }
     }
-}
\ No newline at end of file
+}
@@ -5,17 +5,42 @@
 #include "icon.h"
 
 #define DISPLAY_TEXT_SIZE 4
+#define DISPLAY_WIDTH 128
+#define DISPLAY_HEIGHT 64
+#define DISPLAY_ADDRESS 0x3C
+// I2C clock while sending and afterwards, same as Adafruit_SSD1306
+#define DISPLAY_I2C_CLOCK 400000
+#define DISPLAY_I2C_CLOCK_IDLE 100000
+// data bytes per I2C transmission, fits into the Wire buffer
+#define DISPLAY_I2C_CHUNK 64
+// minimum time between two weight screen updates of the display task
+#define DISPLAY_MIN_INTERVAL_MS 250
+// weight screens don't replace other screens for this time, e.g. "Log Error"
+#define DISPLAY_TEXT_HOLD_MS 2000
+// longest text of drawText() and drawError(), longer texts are cut
+#define DISPLAY_TEXT_LENGTH 48
 
 namespace weightwhiskers
 {
 
+    /**
+     * @brief renders the screens in its own task
+     *
+     * The draw functions only post the requested screen and never wait for I2C. Only the latest
+     * screen is kept, so screens that are requested faster than the display can show them are
+     * dropped. Weight screens, which the loop requests all the time, never replace a pending
+     * text screen and are only shown DISPLAY_TEXT_HOLD_MS after it. The task renders into the
+     * back buffer of Adafruit_SSD1306 and sends the difference to the front buffer, i.e. what
+     * the display shows, see flush().
+     * Without a task (stack size 0) the screens are rendered by the caller, e.g. in the bench.
+     */
     class Display
     {
     public:
         Display(TwoWire *twi);
-        bool begin();
+        bool begin(uint32_t stackSize = 0);
         Adafruit_SSD1306& getDisplay();
-        
+
         void drawBootScreen();
         void drawError(String err);
         void drawText(String text);
@@ -25,10 +50,70 @@ namespace weightwhiskers
         void drawCalib(int weight);
         void drawWeightScreen(int weight = 0, int lastWeight = 0, int loadingBar = -1);
         void drawOTA(float percentage = 0);
+        // WiFi bars of the following weight screens, -1 not connected, -2 AP mode
+        void setWiFiState(int8_t wifi);
+        // false sends the whole frame buffer on every update like before, for the bench
+        void setSendDifference(bool enabled);
+
+        // I2C bytes sent to the display
+        uint32_t getBytesSent() const;
+        // updates that didn't change anything on the display
+        uint32_t getSkippedFrames() const;
 
     protected:
+        enum class Screen : uint8_t {
+            Boot,
+            Text,
+            Weight,
+            OTA,
+        };
+
+        // requested screen and its content
+        struct Request {
+            Screen screen = Screen::Boot;
+            int weight = 0;
+            int lastWeight = 0;
+            int loadingBar = -1;
+            int8_t wifi = -1;
+            float percentage = 0;
+            uint8_t textSize = DISPLAY_TEXT_SIZE;
+            char text[DISPLAY_TEXT_LENGTH] = {};
+        };
+
+        struct WeightScreen {
+            int weight;
+            int lastWeight;
+            int loadingBar;
+            // WiFi bars, -1 not connected, -2 AP mode
+            int wifi;
+        };
+
+        // hands the request to the display task or renders it right away without task
+        void post(const Request& request);
+        static void task(void* parameter);
+        void run();
+        void render(const Request& request);
+        void renderText(const char* text, uint8_t size);
+        void postText(const char* text, uint8_t size = DISPLAY_TEXT_SIZE);
+        void renderWeightScreen(int weight, int lastWeight, int loadingBar, int8_t wifi);
+        void renderOTA(float percentage);
+        // sends the pages of the frame buffer that differ from the display content
+        void flush();
+
         TwoWire* twi = nullptr;
         Adafruit_SSD1306 display;
+        TaskHandle_t taskHandle = nullptr;
+        // holds only the latest request
+        QueueHandle_t queue = nullptr;
+        volatile int8_t wifi = -1;
+        // what the display currently shows
+        uint8_t frame[DISPLAY_WIDTH * DISPLAY_HEIGHT / 8];
+        // the weight screen is shown with these values
+        bool weightScreenValid = false;
+        WeightScreen weightScreen;
+        bool sendDifference = true;
+        volatile uint32_t bytesSent = 0;
+        volatile uint32_t skippedFrames = 0;
     };
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,111 @@
+#include "FixedPoint.h"
+
+// log2(e) as Q16
+#define Q16_LOG2E 94548
+// 2 * pi as Q24
+#define Q24_TWO_PI 105414357LL
+
+namespace weightwhiskers
+{
+
+    q16_t expNegQ16(q16_t x)
+    {
+        if (x <= 0) {
+            return Q16_ONE;
+        }
+        // e^-x = 2^-(x * log2(e)), split into integer shift and fraction
+        int64_t y = ((int64_t)x * Q16_LOG2E) >> Q16_SHIFT;
+        int64_t n = y >> Q16_SHIFT;
+        if (n >= Q16_SHIFT) {
+            return 0;
+        }
+        // 2^-f = e^(-f * ln2) as taylor series in horner form with Q30 precision
+        int64_t f = (y & (Q16_ONE - 1)) << 14;
+        int64_t r = 16377;
+        r = 165394 - ((r * f) >> 30);
+        r = 1431680 - ((r * f) >> 30);
+        r = 10327387 - ((r * f) >> 30);
+        r = 59597083 - ((r * f) >> 30);
+        r = 257941248 - ((r * f) >> 30);
+        r = 744261118 - ((r * f) >> 30);
+        r = (1LL << 30) - ((r * f) >> 30);
+        n += 14;
+        return (q16_t)((r + (1LL << (n - 1))) >> n);
+    }
+
+    uint32_t isqrt64(uint64_t value)
+    {
+        uint64_t result = 0;
+        uint64_t bit = 1ULL << 62;
+        while (bit > value) {
+            bit >>= 2;
+        }
+        while (bit) {
+            if (value >= result + bit) {
+                value -= result + bit;
+                result = (result >> 1) + bit;
+            } else {
+                result >>= 1;
+            }
+            bit >>= 2;
+        }
+        return (uint32_t)result;
+    }
+
+    void ScaleCalibration::setOffset(int32_t offset) { this->offset = offset; }
+
+    int32_t ScaleCalibration::getOffset() const { return offset; }
+
+    void ScaleCalibration::setScale(float scale)
+    {
+        if (scale == 0.f) {
+            scale = 1.f;
+        }
+        this->scale = scale;
+        inverseScale = (int64_t)(4294967296. / scale);
+    }
+
+    float ScaleCalibration::getScale() const { return scale; }
+
+    fixed_t ScaleCalibration::toWeight(int32_t raw) const
+    {
+        return (fixed_t)(((int64_t)(raw - offset) * inverseScale) >> (32 - FIXED_SHIFT));
+    }
+
+    int32_t ScaleCalibration::toRaw(fixed_t weight) const
+    {
+        float raw = toFloat(weight) * scale;
+        return (int32_t)(raw + (raw < 0 ? -0.5f : 0.5f));
+    }
+
+    FixedLowPass::FixedLowPass(float frequency) { setFrequency(frequency); }
+
+    void FixedLowPass::setFrequency(float frequency)
+    {
+        rate = (int64_t)(Q24_TWO_PI * frequency / 1000.f + 0.5f);
+    }
+
+    void FixedLowPass::setToNewValue(fixed64_t value, uint32_t now)
+    {
+        y = value;
+        last = now;
+        started = true;
+    }
+
+    fixed64_t FixedLowPass::input(fixed64_t value, uint32_t now)
+    {
+        if (!started) {
+            setToNewValue(value, now);
+            return y;
+        }
+        // a = e^(-dt / tau), dt / tau as Q16
+        int64_t x = ((int64_t)(now - last) * rate + 128) >> 8;
+        q16_t a = x > INT32_MAX ? 0 : expNegQ16((q16_t)x);
+        y += ((value - y) * (Q16_ONE - a)) >> Q16_SHIFT;
+        last = now;
+        return y;
+    }
+
+    fixed64_t FixedLowPass::output() const { return y; }
+
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stdint.h>
+
+// weights are stored as signed Q20.12 gram (resolution 0.25mg, range ±524kg)
+#define FIXED_SHIFT 12
+#define FIXED_ONE (1 << FIXED_SHIFT)
+// filter coefficients are stored as unsigned Q16
+#define Q16_SHIFT 16
+#define Q16_ONE (1 << Q16_SHIFT)
+
+namespace weightwhiskers
+{
+
+    // weight in Q20.12 gram
+    typedef int32_t fixed_t;
+    // Q20.12 with 64 bit storage for squared weights
+    typedef int64_t fixed64_t;
+    // Q16.16 coefficient
+    typedef int32_t q16_t;
+
+    constexpr fixed_t toFixed(float value)
+    {
+        return (fixed_t)(value * FIXED_ONE + (value < 0 ? -0.5f : 0.5f));
+    }
+
+    constexpr fixed_t toFixed(int32_t value) { return value * FIXED_ONE; }
+
+    constexpr float toFloat(fixed64_t value) { return value / (float)FIXED_ONE; }
+
+    // rounds to integer gram
+    constexpr int32_t toGram(fixed64_t value)
+    {
+        return (int32_t)((value + (value < 0 ? -FIXED_ONE / 2 : FIXED_ONE / 2)) / FIXED_ONE);
+    }
+
+    // e^-x for x >= 0
+    q16_t expNegQ16(q16_t x);
+    uint32_t isqrt64(uint64_t value);
+
+    /**
+     * @brief Converts raw HX711 values to gram without floating point math
+     *
+     * The calibration factor is stored as Q32 reciprocal, so converting a sample is a
+     * subtraction, one 64 bit multiplication and a shift.
+     */
+    class ScaleCalibration
+    {
+    public:
+        void setOffset(int32_t offset);
+        int32_t getOffset() const;
+        void setScale(float scale);
+        float getScale() const;
+
+        fixed_t toWeight(int32_t raw) const;
+        // raw difference of a weight, used to move the offset
+        int32_t toRaw(fixed_t weight) const;
+
+    protected:
+        int32_t offset = 0;
+        float scale = 1.f;
+        int64_t inverseScale = 1LL << 32;
+    };
+
+    /**
+     * @brief Fixed point one pole low pass, same response as FilterOnePole(LOWPASS)
+     *
+     * Y = (1 - a) * X + a * Y with a = exp(-dt / tau) and tau = 1 / (2 * pi * f). The time
+     * step is taken from the sample timestamps instead of micros().
+     */
+    class FixedLowPass
+    {
+    public:
+        FixedLowPass(float frequency = 1.f);
+        void setFrequency(float frequency);
+        void setToNewValue(fixed64_t value, uint32_t now);
+        fixed64_t input(fixed64_t value, uint32_t now);
+        fixed64_t output() const;
+
+    protected:
+        // 2 * pi * f per millisecond as Q24
+        int64_t rate = 0;
+        fixed64_t y = 0;
+        uint32_t last = 0;
+        bool started = false;
+    };
+
+}
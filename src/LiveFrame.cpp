@@ -0,0 +1,63 @@
+#include "LiveFrame.h"
+#include <algorithm>
+#include <string.h>
+
+namespace weightwhiskers
+{
+
+    namespace
+    {
+        uint8_t* writeValue(uint8_t* buffer, int32_t value, int32_t& previous)
+        {
+            int32_t delta = value - previous;
+            previous = value;
+            if (delta > INT16_MIN && delta <= INT16_MAX) {
+                int16_t delta16 = delta;
+                memcpy(buffer, &delta16, sizeof(delta16));
+                return buffer + sizeof(delta16);
+            }
+            int16_t escape = LIVE_DELTA_ESCAPE;
+            memcpy(buffer, &escape, sizeof(escape));
+            memcpy(buffer + sizeof(escape), &value, sizeof(value));
+            return buffer + sizeof(escape) + sizeof(value);
+        }
+    }
+
+    size_t encodeLiveFrame(const LiveSample* samples, size_t count, uint32_t index,
+        uint32_t decimation, uint8_t flags, uint16_t sequence, uint8_t* buffer)
+    {
+        LiveFrameHeader header;
+        header.flags = flags;
+        header.sequence = sequence;
+        uint8_t* position = buffer + sizeof(header);
+        int32_t previousWeight = 0;
+        int32_t previousUnfiltered = 0;
+        uint32_t previousTimestamp = 0;
+        for (size_t i = 0; i < count; i++) {
+            // keep decimation aligned across frames
+            if ((index + i) % decimation) {
+                continue;
+            }
+            const LiveSample& sample = samples[i];
+            if (header.count == 0) {
+                header.timestamp = sample.timestamp;
+                previousTimestamp = sample.timestamp;
+            }
+            // samples are flushed long before the delta could overflow
+            uint16_t timeDelta
+                = std::min(sample.timestamp - previousTimestamp, (uint32_t)UINT16_MAX);
+            previousTimestamp = sample.timestamp;
+            memcpy(position, &timeDelta, sizeof(timeDelta));
+            position += sizeof(timeDelta);
+            position = writeValue(position, sample.weight, previousWeight);
+            position = writeValue(position, sample.weightUnfiltered, previousUnfiltered);
+            header.count++;
+        }
+        if (header.count == 0) {
+            return 0;
+        }
+        memcpy(buffer, &header, sizeof(header));
+        return position - buffer;
+    }
+
+}
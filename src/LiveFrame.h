@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LIVE_FRAME_VERSION 2
+// samples kept between two flushes (6.4s at 10 SPS)
+#define LIVE_BUFFER_SIZE 64
+// delta that is followed by an absolute int32 value
+#define LIVE_DELTA_ESCAPE INT16_MIN
+// frame flags
+#define LIVE_FLAG_ACTIVE 0x01
+
+namespace weightwhiskers
+{
+
+    /**
+     * @brief header of a binary live frame, all values little endian
+     *
+     * The header is followed by count samples. Each sample starts with the milliseconds since
+     * the previous sample of the frame as uint16 (0 for the first one), followed by the
+     * filtered and the unfiltered weight in 0.1g as int16 deltas to the previous sample of the
+     * frame, starting from 0. A delta of LIVE_DELTA_ESCAPE is followed by the absolute value
+     * as int32.
+     */
+    struct __attribute__((packed)) LiveFrameHeader {
+        uint8_t version = LIVE_FRAME_VERSION;
+        uint8_t flags = 0;
+        // per client, gaps show skipped frames
+        uint16_t sequence = 0;
+        // millis() of the first sample
+        uint32_t timestamp = 0;
+        uint16_t count = 0;
+    };
+
+    // largest frame: header, time delta and two escaped values per sample
+    constexpr size_t LIVE_FRAME_SIZE = sizeof(LiveFrameHeader) + LIVE_BUFFER_SIZE * (2 + 2 * 6);
+
+    struct LiveSample {
+        uint32_t timestamp;
+        // 0.1g
+        int32_t weight;
+        int32_t weightUnfiltered;
+    };
+
+    /**
+     * @brief encodes every decimation-th sample into a live frame
+     *
+     * @param index number of samples before samples[0], decimation is aligned to it
+     * @param buffer at least LIVE_FRAME_SIZE bytes
+     * @return frame length, 0 if decimation left no sample
+     */
+    size_t encodeLiveFrame(const LiveSample* samples, size_t count, uint32_t index,
+        uint32_t decimation, uint8_t flags, uint16_t sequence, uint8_t* buffer);
+
+}
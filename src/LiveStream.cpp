@@ -0,0 +1,135 @@
+#include "LiveStream.h"
+#include <ArduinoJson.h>
+#include <algorithm>
+
+#define TAG "LiveStream"
+
+#ifndef WS_MAX_QUEUED_MESSAGES
+#define WS_MAX_QUEUED_MESSAGES 32
+#endif
+
+namespace weightwhiskers
+{
+
+    namespace
+    {
+        // Q20.12 to 0.1g
+        int32_t toDecigram(fixed_t value)
+        {
+            return (int32_t)(((fixed64_t)value * 10 + FIXED_ONE / 2) >> FIXED_SHIFT);
+        }
+    }
+
+    LiveStream::LiveStream(AsyncWebSocket& ws)
+        : ws(ws)
+    {
+    }
+
+    void LiveStream::begin()
+    {
+        if (!mutex) {
+            mutex = xSemaphoreCreateMutex();
+        }
+    }
+
+    void LiveStream::add(uint32_t timestamp, fixed_t weight, fixed_t weightUnfiltered)
+    {
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        // flush is overdue, drop the oldest sample
+        if (sampleCount == LIVE_BUFFER_SIZE) {
+            memmove(samples, samples + 1, (LIVE_BUFFER_SIZE - 1) * sizeof(LiveSample));
+            sampleCount--;
+            sampleIndex++;
+        }
+        samples[sampleCount++] = { timestamp, toDecigram(weight), toDecigram(weightUnfiltered) };
+        xSemaphoreGive(mutex);
+    }
+
+    void LiveStream::setActive(bool active) { this->active = active; }
+
+    void LiveStream::flush()
+    {
+        static uint8_t frame[LIVE_FRAME_SIZE];
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        size_t queueLength = 0;
+        for (auto& client : clients) {
+            AsyncWebSocketClient* wsClient = ws.client(client.id);
+            if (!wsClient) {
+                continue;
+            }
+            queueLength = std::max(queueLength, wsClient->queueLen());
+            // slow client: skip this frame and send less data from now on
+            if (wsClient->queueIsFull() || wsClient->queueLen() > WS_MAX_QUEUED_MESSAGES / 4) {
+                client.backoff = std::min(client.backoff * 2, LIVE_BACKOFF_MAX);
+                client.sequence++;
+                skippedFrames++;
+                ESP_LOGD(TAG, "Client %u backoff %u", client.id, client.backoff);
+                continue;
+            }
+            if (wsClient->queueLen() == 0 && client.backoff > 1) {
+                client.backoff /= 2;
+            }
+            size_t length = encode(client, frame);
+            if (length) {
+                wsClient->binary(frame, length);
+                client.sequence++;
+            }
+        }
+        sampleIndex += sampleCount;
+        sampleCount = 0;
+        maxQueueLength = queueLength;
+        xSemaphoreGive(mutex);
+    }
+
+    void LiveStream::onConnect(AsyncWebSocketClient* client)
+    {
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        Client state;
+        state.id = client->id();
+        clients.push_back(state);
+        xSemaphoreGive(mutex);
+    }
+
+    void LiveStream::onDisconnect(AsyncWebSocketClient* client)
+    {
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        uint32_t id = client->id();
+        clients.erase(std::remove_if(clients.begin(), clients.end(),
+                          [id](const Client& state) { return state.id == id; }),
+            clients.end());
+        xSemaphoreGive(mutex);
+    }
+
+    void LiveStream::onMessage(AsyncWebSocketClient* client, const uint8_t* data, size_t length)
+    {
+        // rate negotiation {"active": 1, "idle": 5}
+        StaticJsonDocument<64> doc;
+        if (deserializeJson(doc, data, length)) {
+            ESP_LOGW(TAG, "Invalid message from client %u", client->id());
+            return;
+        }
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        for (auto& state : clients) {
+            if (state.id == client->id()) {
+                state.decimationActive = constrain(doc["active"] | state.decimationActive, 1, 255);
+                state.decimationIdle = constrain(doc["idle"] | state.decimationIdle, 1, 255);
+                ESP_LOGI(TAG, "Client %u decimation active=%u idle=%u", state.id,
+                    state.decimationActive, state.decimationIdle);
+            }
+        }
+        xSemaphoreGive(mutex);
+    }
+
+    uint32_t LiveStream::getSkippedFrames() const { return skippedFrames; }
+
+    size_t LiveStream::getMaxQueueLength() const { return maxQueueLength; }
+
+    size_t LiveStream::encode(const Client& client, uint8_t* buffer)
+    {
+        uint32_t decimation = (active ? client.decimationActive : client.decimationIdle);
+        decimation *= client.backoff;
+        return encodeLiveFrame(samples, sampleCount, sampleIndex, decimation,
+            active ? LIVE_FLAG_ACTIVE : 0, client.sequence, buffer);
+    }
+
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <vector>
+#include "FixedPoint.h"
+#include "LiveFrame.h"
+
+// default decimation while a cat is on the scale and while idle
+#define LIVE_DECIMATION_ACTIVE 1
+#define LIVE_DECIMATION_IDLE 5
+// largest additional decimation for slow clients
+#define LIVE_BACKOFF_MAX 16
+
+namespace weightwhiskers
+{
+
+    /**
+     * @brief Batches samples and sends them as binary frames to all websocket clients
+     *
+     * Every client chooses a decimation for idle and active (visit) phases by sending
+     * {"active": n, "idle": m}. Clients whose send queue fills up get additional decimation
+     * instead of being disconnected, it is reduced again once the queue drains.
+     */
+    class LiveStream
+    {
+    public:
+        LiveStream(AsyncWebSocket& ws);
+
+        void begin();
+        void add(uint32_t timestamp, fixed_t weight, fixed_t weightUnfiltered);
+        void setActive(bool active);
+        // sends all samples since the last flush
+        void flush();
+
+        // websocket events, called from the async TCP task
+        void onConnect(AsyncWebSocketClient* client);
+        void onDisconnect(AsyncWebSocketClient* client);
+        void onMessage(AsyncWebSocketClient* client, const uint8_t* data, size_t length);
+
+        // frames that weren't sent because a client was too slow
+        uint32_t getSkippedFrames() const;
+        // longest send queue of all clients at the last flush
+        size_t getMaxQueueLength() const;
+
+    protected:
+        struct Client {
+            uint32_t id;
+            uint16_t sequence = 0;
+            uint8_t decimationActive = LIVE_DECIMATION_ACTIVE;
+            uint8_t decimationIdle = LIVE_DECIMATION_IDLE;
+            uint8_t backoff = 1;
+        };
+
+        size_t encode(const Client& client, uint8_t* buffer);
+
+        AsyncWebSocket& ws;
+        SemaphoreHandle_t mutex = nullptr;
+        std::vector<Client> clients;
+        LiveSample samples[LIVE_BUFFER_SIZE];
+        size_t sampleCount = 0;
+        // number of samples before samples[0], decimation is aligned to it
+        uint32_t sampleIndex = 0;
+        bool active = false;
+        volatile uint32_t skippedFrames = 0;
+        volatile size_t maxQueueLength = 0;
+    };
+
+}
@@ -0,0 +1,31 @@
+#include "LiveWeightPublisher.h"
+
+namespace weightwhiskers
+{
+
+    void LiveWeightPublisher::setConfig(const LiveWeightConfig& config) { this->config = config; }
+
+    const LiveWeightConfig& LiveWeightPublisher::getConfig() const { return config; }
+
+    bool LiveWeightPublisher::update(uint32_t now, fixed_t weight, bool occupied)
+    {
+        uint32_t elapsed = now - lastPublish;
+        fixed_t change = weight > this->weight ? weight - this->weight : this->weight - weight;
+        bool publish = !published || occupied != this->occupied
+            || elapsed >= config.maxIntervalMs
+            || (change > config.deadband && elapsed >= config.minIntervalMs);
+        if (!publish) {
+            return false;
+        }
+        published = true;
+        lastPublish = now;
+        this->weight = weight;
+        this->occupied = occupied;
+        return true;
+    }
+
+    fixed_t LiveWeightPublisher::getWeight() const { return weight; }
+
+    bool LiveWeightPublisher::isOccupied() const { return occupied; }
+
+}
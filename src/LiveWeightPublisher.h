@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+#include "FixedPoint.h"
+
+namespace weightwhiskers
+{
+
+    struct LiveWeightConfig {
+        // weight change that is published
+        fixed_t deadband = toFixed(50);
+        // minimum time between two publishes of weight changes
+        uint32_t minIntervalMs = 1000;
+        // the weight is published at least this often
+        uint32_t maxIntervalMs = 60000;
+    };
+
+    /**
+     * @brief Decides which samples of the filtered weight are published as live weight
+     *
+     * A sample is published if the occupied state changed, if the weight moved more than the
+     * deadband and the last publish is older than minIntervalMs, or if nothing was published
+     * for maxIntervalMs. It doesn't send anything itself, so a recorded session can be
+     * replayed to count the messages.
+     */
+    class LiveWeightPublisher
+    {
+    public:
+        void setConfig(const LiveWeightConfig& config);
+        const LiveWeightConfig& getConfig() const;
+
+        // true if the sample should be published
+        bool update(uint32_t now, fixed_t weight, bool occupied);
+
+        // last published values
+        fixed_t getWeight() const;
+        bool isOccupied() const;
+
+    protected:
+        LiveWeightConfig config;
+        bool published = false;
+        uint32_t lastPublish = 0;
+        fixed_t weight = 0;
+        bool occupied = false;
+    };
+
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+
+namespace weightwhiskers
+{
+
+    struct CatMeasurement {
+        // UNIX timetamp in seconds
+        time_t time = 0;
+        // weight in gram
+        uint16_t weight = 0.;
+        // standard deviation
+        float std = 0.;
+        // duration in seconds
+        float duration = 0.;
+        // weight of poo/urine "dropping"
+        uint16_t weightDropping = 0;
+    };
+
+}
@@ -0,0 +1,409 @@
+#include "MeasurementLog.h"
+#include <algorithm>
+
+#define TAG "MeasurementLog"
+
+namespace weightwhiskers
+{
+
+    MeasurementLog::CsvStream::CsvStream(MeasurementLog& log, size_t first, size_t last)
+        : file(log.open())
+        , index(first)
+        , last(std::min(last, log.count()))
+    {
+        lineLength = snprintf(line, sizeof(line), "%s\n", MEASUREMENT_CSV_HEADER);
+        if (file) {
+            file.seek(sizeof(MeasurementLogHeader) + first * sizeof(MeasurementRecord));
+        }
+    }
+
+    MeasurementLog::CsvStream::~CsvStream() { file.close(); }
+
+    size_t MeasurementLog::CsvStream::read(uint8_t* buffer, size_t size)
+    {
+        size_t length = 0;
+        while (length < size) {
+            // next line if the current one is done
+            if (linePosition >= lineLength) {
+                MeasurementRecord record;
+                if (index >= last || !file
+                    || file.read((uint8_t*)&record, sizeof(record)) != sizeof(record)) {
+                    break;
+                }
+                index++;
+                if (!record.isValid()) {
+                    ESP_LOGW(TAG, "Skipping corrupt measurement record %u", index - 1);
+                    continue;
+                }
+                if (record.isDeleted()) {
+                    continue;
+                }
+                lineLength = record.toCsv(line, sizeof(line));
+                linePosition = 0;
+            }
+            size_t chunk = std::min(lineLength - linePosition, size - length);
+            memcpy(buffer + length, line + linePosition, chunk);
+            linePosition += chunk;
+            length += chunk;
+        }
+        return length;
+    }
+
+    MeasurementLog::Import::Import(MeasurementLog& log)
+        : log(log)
+        , tmpPath(String(log.getPath()) + "_import")
+    {
+    }
+
+    MeasurementLog::Import::~Import()
+    {
+        // aborted import, keep the log
+        if (file) {
+            file.close();
+        }
+        if (!committed) {
+            log.fs.remove(tmpPath);
+        }
+    }
+
+    bool MeasurementLog::Import::begin()
+    {
+        parser.reset();
+        file = log.fs.open(tmpPath, FILE_WRITE);
+        if (!file || !log.writeHeader(file)) {
+            ESP_LOGE(TAG, "Cannot create %s", tmpPath.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    void MeasurementLog::Import::write(const uint8_t* data, size_t length)
+    {
+        parser.input((const char*)data, length, [this](const MeasurementRecord& record) {
+            records[recordCount++] = record;
+            if (recordCount == sizeof(records) / sizeof(records[0])) {
+                flush();
+            }
+        });
+    }
+
+    int MeasurementLog::Import::commit()
+    {
+        parser.finish([this](const MeasurementRecord& record) {
+            records[recordCount++] = record;
+            flush();
+        });
+        flush();
+        if (!file) {
+            return -1;
+        }
+        file.close();
+        ESP_LOGI(TAG, "Import: %u rows accepted, %u rejected", getAccepted(), getRejected());
+
+        // replace log with imported data, rename swaps atomically and keeps the old log if
+        // the power fails
+        log.lock();
+        committed = log.fs.rename(tmpPath, log.path);
+        if (committed) {
+            log.deleted = 0;
+            log.revision++;
+        }
+        log.unlock();
+        if (!committed) {
+            ESP_LOGE(TAG, "Cannot rename %s", tmpPath.c_str());
+            return -1;
+        }
+        return getAccepted();
+    }
+
+    void MeasurementLog::Import::flush()
+    {
+        if (recordCount && file) {
+            file.write((uint8_t*)records, recordCount * sizeof(MeasurementRecord));
+        }
+        recordCount = 0;
+    }
+
+    MeasurementLog::MeasurementLog(fs::FS& fs, const char* path)
+        : fs(fs)
+        , path(path)
+    {
+    }
+
+    bool MeasurementLog::begin(const char* csvPath)
+    {
+        if (!mutex) {
+            mutex = xSemaphoreCreateMutex();
+        }
+        if (!fs.exists(path)) {
+            ESP_LOGI(TAG, "Creating measurement log %s", path);
+            File file = fs.open(path, FILE_WRITE, true);
+            if (!file || !writeHeader(file)) {
+                ESP_LOGE(TAG, "Cannot create measurement log %s", path);
+                return false;
+            }
+            file.close();
+
+            // one-time migration of the old CSV file
+            if (csvPath && fs.exists(csvPath)) {
+                int rows = importCsv(csvPath);
+                ESP_LOGI(TAG, "Imported %d measurements from %s", rows, csvPath);
+                if (rows >= 0) {
+                    fs.rename(csvPath, String(csvPath) + ".bak");
+                }
+            }
+            return true;
+        }
+
+        File file = fs.open(path, FILE_READ);
+        MeasurementLogHeader header;
+        if (!file || file.read((uint8_t*)&header, sizeof(header)) != sizeof(header)
+            || header.magic != MEASUREMENT_LOG_MAGIC || header.version != MEASUREMENT_LOG_VERSION
+            || header.recordSize != sizeof(MeasurementRecord)) {
+            ESP_LOGE(TAG, "Invalid measurement log header in %s", path);
+            return false;
+        }
+        file.close();
+        deleted = header.deleted;
+        return true;
+    }
+
+    const char* MeasurementLog::getPath() const { return path; }
+
+    bool MeasurementLog::append(const CatMeasurement& m)
+    {
+        lock();
+        File file = fs.open(path, FILE_APPEND);
+        if (!file) {
+            ESP_LOGE(TAG, "Cannot open measurement log %s", path);
+            unlock();
+            return false;
+        }
+        auto record = MeasurementRecord::from(m);
+        bool success = file.write((uint8_t*)&record, sizeof(record)) == sizeof(record);
+        file.close();
+        unlock();
+        return success;
+    }
+
+    size_t MeasurementLog::count()
+    {
+        size_t size = fileSize();
+        return size > sizeof(MeasurementLogHeader)
+            ? (size - sizeof(MeasurementLogHeader)) / sizeof(MeasurementRecord)
+            : 0;
+    }
+
+    size_t MeasurementLog::fileSize()
+    {
+        File file = fs.open(path, FILE_READ);
+        size_t size = file ? file.size() : 0;
+        file.close();
+        return size;
+    }
+
+    size_t MeasurementLog::deletedCount() const { return deleted; }
+
+    bool MeasurementLog::read(size_t index, MeasurementRecord& record)
+    {
+        File file = open();
+        bool success = read(file, index, record);
+        file.close();
+        return success;
+    }
+
+    bool MeasurementLog::read(fs::File& file, size_t index, MeasurementRecord& record)
+    {
+        if (!file
+            || !file.seek(sizeof(MeasurementLogHeader) + index * sizeof(MeasurementRecord))) {
+            return false;
+        }
+        if (file.read((uint8_t*)&record, sizeof(record)) != sizeof(record)) {
+            return false;
+        }
+        if (!record.isValid()) {
+            ESP_LOGW(TAG, "Corrupt measurement record %u", index);
+            return false;
+        }
+        return !record.isDeleted();
+    }
+
+    size_t MeasurementLog::lowerBound(fs::File& file, uint32_t time)
+    {
+        if (!file || file.size() < sizeof(MeasurementLogHeader)) {
+            return 0;
+        }
+        size_t first = 0;
+        size_t last = (file.size() - sizeof(MeasurementLogHeader)) / sizeof(MeasurementRecord);
+        while (first < last) {
+            size_t middle = first + (last - first) / 2;
+            if (readTime(file, middle) < time) {
+                first = middle + 1;
+            } else {
+                last = middle;
+            }
+        }
+        return first;
+    }
+
+    uint32_t MeasurementLog::readTime(fs::File& file, size_t index)
+    {
+        // the timestamp is the first field of a record
+        uint32_t time = 0;
+        if (file.seek(sizeof(MeasurementLogHeader) + index * sizeof(MeasurementRecord))) {
+            file.read((uint8_t*)&time, sizeof(time));
+        }
+        return time;
+    }
+
+    fs::File MeasurementLog::open() { return fs.open(path, FILE_READ); }
+
+    int MeasurementLog::importCsv(const char* csvPath)
+    {
+        File csv = fs.open(csvPath, FILE_READ);
+        if (!csv) {
+            ESP_LOGE(TAG, "Cannot open %s", csvPath);
+            return -1;
+        }
+        Import csvImport(*this);
+        if (!csvImport.begin()) {
+            return -1;
+        }
+        uint8_t buffer[512];
+        size_t length;
+        while ((length = csv.read(buffer, sizeof(buffer))) > 0) {
+            csvImport.write(buffer, length);
+        }
+        csv.close();
+        return csvImport.commit();
+    }
+
+    size_t MeasurementLog::remove(const uint32_t* timestamps, size_t count)
+    {
+        lock();
+        File file = fs.open(path, "r+");
+        if (!file) {
+            ESP_LOGE(TAG, "Cannot open measurement log for deletion");
+            unlock();
+            return 0;
+        }
+
+        // flag records in place, O(log n) per timestamp
+        size_t removed = 0;
+        size_t records = file.size() > sizeof(MeasurementLogHeader)
+            ? (file.size() - sizeof(MeasurementLogHeader)) / sizeof(MeasurementRecord)
+            : 0;
+        MeasurementRecord record;
+        for (size_t i = 0; i < count; i++) {
+            for (size_t index = lowerBound(file, timestamps[i]); index < records; index++) {
+                size_t offset = sizeof(MeasurementLogHeader) + index * sizeof(MeasurementRecord);
+                file.seek(offset);
+                if (file.read((uint8_t*)&record, sizeof(record)) != sizeof(record)
+                    || record.time != timestamps[i]) {
+                    break;
+                }
+                if (record.isDeleted() || !record.isValid()) {
+                    continue;
+                }
+                record.flags |= MEASUREMENT_FLAG_DELETED;
+                record.updateCrc();
+                file.seek(offset);
+                file.write((uint8_t*)&record, sizeof(record));
+                removed++;
+            }
+        }
+
+        // keep the number of dead records in the header
+        if (removed) {
+            deleted += removed;
+            revision++;
+            file.seek(0);
+            writeHeader(file, deleted);
+        }
+        file.close();
+        unlock();
+        ESP_LOGI(TAG, "Deleted %u measurements, %u deleted records in log", removed, deleted);
+        return removed;
+    }
+
+    bool MeasurementLog::compact()
+    {
+        // copy without the lock, append() keeps working during the copy
+        lock();
+        uint32_t startRevision = revision;
+        unlock();
+        File oldFile = open();
+        String tmpPath = String(path) + "_tmp";
+        File newFile = fs.open(tmpPath, FILE_WRITE);
+        if (!oldFile || !newFile || !writeHeader(newFile)) {
+            ESP_LOGE(TAG, "Cannot open measurement log for compaction");
+            return false;
+        }
+        size_t records = oldFile.size() > sizeof(MeasurementLogHeader)
+            ? (oldFile.size() - sizeof(MeasurementLogHeader)) / sizeof(MeasurementRecord)
+            : 0;
+        oldFile.seek(sizeof(MeasurementLogHeader));
+        size_t copied = copyRecords(oldFile, newFile, records);
+        oldFile.close();
+
+        lock();
+        // records were deleted or the log was replaced meanwhile, try again later
+        if (revision != startRevision || copied != records) {
+            unlock();
+            newFile.close();
+            fs.remove(tmpPath);
+            ESP_LOGW(TAG, "Measurement log changed during compaction");
+            return false;
+        }
+        // take over what was appended during the copy
+        oldFile = open();
+        oldFile.seek(sizeof(MeasurementLogHeader) + records * sizeof(MeasurementRecord));
+        copyRecords(oldFile, newFile, SIZE_MAX);
+        oldFile.close();
+        newFile.close();
+
+        // rename replaces the log atomically, a power loss keeps either the old or new log
+        bool success = fs.rename(tmpPath, path);
+        if (success) {
+            deleted = 0;
+            revision++;
+        } else {
+            ESP_LOGE(TAG, "Cannot rename %s", tmpPath.c_str());
+            fs.remove(tmpPath);
+        }
+        unlock();
+        return success;
+    }
+
+    size_t MeasurementLog::copyRecords(fs::File& from, fs::File& to, size_t count)
+    {
+        // copy all records that are not deleted
+        MeasurementRecord record;
+        size_t copied = 0;
+        while (copied < count && from.read((uint8_t*)&record, sizeof(record)) == sizeof(record)) {
+            if (!record.isDeleted()) {
+                to.write((uint8_t*)&record, sizeof(record));
+            }
+            copied++;
+        }
+        return copied;
+    }
+
+    bool MeasurementLog::writeHeader(fs::File& file, uint32_t deleted)
+    {
+        MeasurementLogHeader header;
+        header.recordSize = sizeof(MeasurementRecord);
+        header.deleted = deleted;
+        return file.write((uint8_t*)&header, sizeof(header)) == sizeof(header);
+    }
+
+    bool MeasurementLog::lock() { return !mutex || xSemaphoreTake(mutex, portMAX_DELAY) == pdTRUE; }
+
+    void MeasurementLog::unlock()
+    {
+        if (mutex) {
+            xSemaphoreGive(mutex);
+        }
+    }
+
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FS.h>
+#include "MeasurementRecord.h"
+
+namespace weightwhiskers
+{
+
+    /**
+     * @brief Append-only binary log of measurements
+     *
+     * The file starts with a versioned header followed by fixed size records with their own
+     * CRC, so any record can be read by index and appends don't touch existing data. CSV is
+     * only produced on demand for the web interface and downloads.
+     *
+     * Deleted records are only flagged in place and skipped by readers. compact() drops them
+     * later by copying the log, which is too slow for a web request.
+     */
+    class MeasurementLog
+    {
+    public:
+        /**
+         * @brief streams records [first, last) as CSV into buffers of any size
+         */
+        class CsvStream
+        {
+        public:
+            CsvStream(MeasurementLog& log, size_t first = 0, size_t last = SIZE_MAX);
+            ~CsvStream();
+
+            // fills buffer with up to size bytes, 0 at the end
+            size_t read(uint8_t* buffer, size_t size);
+
+        protected:
+            fs::File file;
+            size_t index;
+            size_t last;
+            // current line and how much of it was already returned
+            char line[MEASUREMENT_CSV_LINE_LENGTH];
+            size_t lineLength;
+            size_t linePosition = 0;
+        };
+
+        /**
+         * @brief imports CSV data chunk by chunk into a temporary file
+         *
+         * The log is only replaced by commit(), an import that is destroyed before keeps the
+         * existing log untouched.
+         */
+        class Import
+        {
+        public:
+            Import(MeasurementLog& log);
+            ~Import();
+
+            bool begin();
+            void write(const uint8_t* data, size_t length);
+            // replaces the log with the imported rows, number of rows or -1 on error
+            int commit();
+
+            size_t getAccepted() const { return parser.getAccepted(); }
+            size_t getRejected() const { return parser.getRejected(); }
+            bool isCommitted() const { return committed; }
+
+        protected:
+            void flush();
+
+            MeasurementLog& log;
+            fs::File file;
+            String tmpPath;
+            MeasurementCsvParser parser;
+            // records are written in blocks
+            MeasurementRecord records[16];
+            size_t recordCount = 0;
+            bool committed = false;
+        };
+
+        MeasurementLog(fs::FS& fs, const char* path);
+
+        /**
+         * @brief opens or creates the log and imports csvPath once if the log doesn't exist
+         */
+        bool begin(const char* csvPath = nullptr);
+        const char* getPath() const;
+
+        bool append(const CatMeasurement& m);
+        // number of records in the log
+        size_t count();
+        size_t fileSize();
+        // number of deleted records that are still stored in the log
+        size_t deletedCount() const;
+        // reads record with index, false if it doesn't exist, is corrupt or deleted
+        bool read(size_t index, MeasurementRecord& record);
+        bool read(fs::File& file, size_t index, MeasurementRecord& record);
+        /**
+         * @brief index of the first record with a timestamp >= time (count() if none)
+         *
+         * Records are appended in time order, so this is a binary search that reads
+         * O(log n) timestamps instead of the whole file.
+         */
+        size_t lowerBound(fs::File& file, uint32_t time);
+        // timestamp of the record with index, also of deleted records, 0 if it doesn't exist
+        uint32_t readTime(fs::File& file, size_t index);
+        fs::File open();
+
+        /**
+         * @brief replaces the log with the rows of a CSV file
+         *
+         * @return number of imported rows or -1 on error
+         */
+        int importCsv(const char* csvPath);
+        /**
+         * @brief marks all records with the given, sorted timestamps as deleted
+         *
+         * @return number of deleted records
+         */
+        size_t remove(const uint32_t* timestamps, size_t count);
+        /**
+         * @brief rewrites the log without deleted records
+         *
+         * The copy runs without the lock, so appends aren't blocked. Records appended
+         * meanwhile are taken over, if records were deleted meanwhile it gives up.
+         */
+        bool compact();
+
+    protected:
+        bool writeHeader(fs::File& file, uint32_t deleted = 0);
+        // copies up to count records without the deleted ones, number of records read
+        size_t copyRecords(fs::File& from, fs::File& to, size_t count);
+        bool lock();
+        void unlock();
+
+        fs::FS& fs;
+        const char* path;
+        // serializes modifications of the file
+        SemaphoreHandle_t mutex = nullptr;
+        size_t deleted = 0;
+        // changed whenever existing records change, appends don't count
+        uint32_t revision = 0;
+    };
+
+}
@@ -0,0 +1,127 @@
+#include "MeasurementRecord.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include "Crc32.h"
+
+namespace weightwhiskers
+{
+
+    namespace
+    {
+        bool isLineEnd(char c) { return c == '\0' || c == '\r' || c == '\n'; }
+
+        // strtoul would accept a sign and wrap "-1" or an overflow into range
+        bool parseUnsigned(const char* text, char** end, uint64_t maximum, uint64_t& value)
+        {
+            *end = (char*)text;
+            while (*text == ' ') {
+                text++;
+            }
+            if (*text < '0' || *text > '9') {
+                return false;
+            }
+            errno = 0;
+            value = strtoull(text, end, 10);
+            return errno != ERANGE && value <= maximum;
+        }
+
+        // lines are parsed in place and not terminated, strtof would skip a line break and
+        // continue in the next line or past the end of the chunk
+        bool parseFloat(const char* text, char** end, float& value)
+        {
+            *end = (char*)text;
+            while (*text == ' ') {
+                text++;
+            }
+            if ((*text < '0' || *text > '9') && *text != '-' && *text != '+' && *text != '.') {
+                return false;
+            }
+            value = strtof(text, end);
+            return *end != text;
+        }
+    }
+
+    MeasurementRecord MeasurementRecord::from(const CatMeasurement& m)
+    {
+        MeasurementRecord record;
+        record.time = m.time;
+        record.weight = m.weight;
+        record.weightDropping = m.weightDropping;
+        record.std = m.std;
+        record.duration = m.duration;
+        record.updateCrc();
+        return record;
+    }
+
+    CatMeasurement MeasurementRecord::toMeasurement() const
+    {
+        CatMeasurement m;
+        m.time = time;
+        m.weight = weight;
+        m.weightDropping = weightDropping;
+        m.std = std;
+        m.duration = duration;
+        return m;
+    }
+
+    void MeasurementRecord::updateCrc() { crc = crc32(this, offsetof(MeasurementRecord, crc)); }
+
+    bool MeasurementRecord::isValid() const
+    {
+        return crc == crc32(this, offsetof(MeasurementRecord, crc));
+    }
+
+    size_t MeasurementRecord::toCsv(char* buffer, size_t size) const
+    {
+        int length = snprintf(buffer, size, "%lu,%hu,%.2f,%.2f,%hu\n", (unsigned long)time,
+            weight, std, duration, weightDropping);
+        return length < 0 ? 0 : std::min((size_t)length, size - 1);
+    }
+
+    bool MeasurementRecord::fromCsv(const char* line, MeasurementRecord& record)
+    {
+        // time,weight,std,duration,dropping
+        char* end;
+        record = MeasurementRecord();
+        uint64_t time;
+        if (!parseUnsigned(line, &end, UINT32_MAX, time) || *end != ',' || time == 0) {
+            return false;
+        }
+        record.time = time;
+        line = end + 1;
+        uint64_t weight;
+        if (!parseUnsigned(line, &end, UINT16_MAX, weight) || *end != ',') {
+            return false;
+        }
+        record.weight = weight;
+        line = end + 1;
+        float std;
+        if (!parseFloat(line, &end, std) || *end != ',') {
+            return false;
+        }
+        record.std = std;
+        line = end + 1;
+        float duration;
+        if (!parseFloat(line, &end, duration)) {
+            return false;
+        }
+        record.duration = duration;
+        // droppings were added later and may be missing
+        if (*end == ',') {
+            line = end + 1;
+            uint64_t dropping;
+            if (!parseUnsigned(line, &end, UINT16_MAX, dropping)) {
+                return false;
+            }
+            record.weightDropping = dropping;
+        }
+        if (!isLineEnd(*end)) {
+            return false;
+        }
+        record.updateCrc();
+        return true;
+    }
+
+}
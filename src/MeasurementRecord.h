@@ -0,0 +1,156 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "Measurement.h"
+
+#define MEASUREMENT_LOG_MAGIC 0x4c4d5757 // "WWML"
+#define MEASUREMENT_LOG_VERSION 1
+#define MEASUREMENT_CSV_HEADER "time,weight,std,duration,dropping"
+// maximum length of a CSV line
+#define MEASUREMENT_CSV_LINE_LENGTH 96
+// record flags
+#define MEASUREMENT_FLAG_DELETED 0x01
+
+namespace weightwhiskers
+{
+
+    struct __attribute__((packed)) MeasurementLogHeader {
+        uint32_t magic = MEASUREMENT_LOG_MAGIC;
+        uint16_t version = MEASUREMENT_LOG_VERSION;
+        uint16_t recordSize = 0;
+        // number of records with MEASUREMENT_FLAG_DELETED
+        uint32_t deleted = 0;
+        uint32_t reserved = 0;
+    };
+
+    /**
+     * @brief fixed size on-flash representation of a CatMeasurement
+     */
+    struct __attribute__((packed)) MeasurementRecord {
+        // UNIX timestamp in seconds
+        uint32_t time = 0;
+        uint16_t weight = 0;
+        uint16_t weightDropping = 0;
+        float std = 0.f;
+        float duration = 0.f;
+        uint8_t flags = 0;
+        uint8_t reserved[3] = { 0, 0, 0 };
+        // CRC-32 of all previous fields
+        uint32_t crc = 0;
+
+        static MeasurementRecord from(const CatMeasurement& m);
+        CatMeasurement toMeasurement() const;
+        void updateCrc();
+        bool isValid() const;
+        bool isDeleted() const { return flags & MEASUREMENT_FLAG_DELETED; }
+
+        // formats the record as CSV line including the line break, returns the length
+        size_t toCsv(char* buffer, size_t size) const;
+        /**
+         * @brief parses a CSV line that ends with a line break or '\0'
+         *
+         * @return false for the header and invalid lines
+         */
+        static bool fromCsv(const char* line, MeasurementRecord& record);
+    };
+
+    static_assert(sizeof(MeasurementLogHeader) == 16, "unexpected log header size");
+    static_assert(sizeof(MeasurementRecord) == 24, "unexpected record size");
+
+    /**
+     * @brief Incremental CSV parser for data that arrives in chunks
+     *
+     * Complete lines are parsed in place in the chunk. Only a line that is split between
+     * two chunks is copied into a small buffer. Rows must be sorted by time, older rows
+     * are rejected to keep the log searchable.
+     */
+    class MeasurementCsvParser
+    {
+    public:
+        void reset()
+        {
+            partialLength = 0;
+            overflow = false;
+            lastTime = 0;
+            accepted = 0;
+            rejected = 0;
+        }
+
+        /**
+         * @brief parses all complete lines of data and calls onRecord(const MeasurementRecord&)
+         */
+        template <typename F> void input(const char* data, size_t length, F onRecord)
+        {
+            const char* end = data + length;
+            while (data < end) {
+                auto newline = static_cast<const char*>(memchr(data, '\n', end - data));
+                if (!newline) {
+                    append(data, end - data);
+                    break;
+                }
+                if (partialLength || overflow) {
+                    append(data, newline - data);
+                    parseLine(partial, onRecord);
+                    partialLength = 0;
+                    overflow = false;
+                } else {
+                    parseLine(data, onRecord);
+                }
+                data = newline + 1;
+            }
+        }
+
+        // parses the last line if the data didn't end with a line break
+        template <typename F> void finish(F onRecord)
+        {
+            if (partialLength || overflow) {
+                parseLine(partial, onRecord);
+            }
+            partialLength = 0;
+            overflow = false;
+        }
+
+        size_t getAccepted() const { return accepted; }
+        size_t getRejected() const { return rejected; }
+
+    protected:
+        template <typename F> void parseLine(const char* line, F onRecord)
+        {
+            // ignore empty lines and the header
+            if (*line == '\n' || *line == '\r' || *line == '\0'
+                || strncmp(line, "time,", 5) == 0) {
+                return;
+            }
+            MeasurementRecord record;
+            if (overflow || !MeasurementRecord::fromCsv(line, record) || record.time < lastTime) {
+                rejected++;
+                return;
+            }
+            lastTime = record.time;
+            accepted++;
+            onRecord(record);
+        }
+
+        void append(const char* data, size_t length)
+        {
+            if (partialLength + length >= sizeof(partial)) {
+                overflow = true;
+                length = sizeof(partial) - 1 - partialLength;
+            }
+            memcpy(partial + partialLength, data, length);
+            partialLength += length;
+            partial[partialLength] = '\0';
+        }
+
+        char partial[MEASUREMENT_CSV_LINE_LENGTH] = { 0 };
+        size_t partialLength = 0;
+        // line didn't fit into partial
+        bool overflow = false;
+        uint32_t lastTime = 0;
+        size_t accepted = 0;
+        size_t rejected = 0;
+    };
+
+}
@@ -0,0 +1,152 @@
+#include "MeasurementStats.h"
+#include <memory>
+#include "Crc32.h"
+
+#define TAG "MeasurementStats"
+#define SECONDS_PER_DAY 86400
+
+namespace weightwhiskers
+{
+
+    MeasurementStats::MeasurementStats(fs::FS& fs, const char* path)
+        : fs(fs)
+        , path(path)
+    {
+    }
+
+    bool MeasurementStats::begin()
+    {
+        if (!mutex) {
+            mutex = xSemaphoreCreateMutex();
+        }
+        File file = fs.open(path, FILE_READ);
+        if (!file) {
+            return false;
+        }
+        std::unique_ptr<Data> loaded(new Data);
+        bool valid = file.read((uint8_t*)loaded.get(), sizeof(Data)) == sizeof(Data)
+            && loaded->magic == MEASUREMENT_STATS_MAGIC
+            && loaded->version == MEASUREMENT_STATS_VERSION
+            && loaded->dayCount == MEASUREMENT_STATS_DAYS
+            && loaded->crc == crc32(loaded.get(), offsetof(Data, crc));
+        file.close();
+        if (!valid) {
+            ESP_LOGW(TAG, "Invalid stats %s", path);
+            return false;
+        }
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        data = *loaded;
+        xSemaphoreGive(mutex);
+        return true;
+    }
+
+    bool MeasurementStats::save()
+    {
+        File file = fs.open(path, FILE_WRITE);
+        if (!file) {
+            ESP_LOGE(TAG, "Cannot open stats %s", path);
+            return false;
+        }
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        data.crc = crc32(&data, offsetof(Data, crc));
+        bool success = file.write((uint8_t*)&data, sizeof(data)) == sizeof(data);
+        xSemaphoreGive(mutex);
+        file.close();
+        return success;
+    }
+
+    void MeasurementStats::rebuild(MeasurementLog& log)
+    {
+        uint32_t start = millis();
+        std::unique_ptr<Data> rebuilt(new Data);
+
+        // scan the log without blocking new measurements
+        File file = log.open();
+        size_t count = log.count();
+        MeasurementRecord record;
+        for (size_t i = 0; i < count; i++) {
+            if (log.read(file, i, record)) {
+                add(*rebuilt, record);
+            }
+        }
+
+        // catch up with measurements that were appended during the scan, then swap
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        for (size_t i = count; i < log.count(); i++) {
+            if (log.read(file, i, record)) {
+                add(*rebuilt, record);
+            }
+        }
+        data = *rebuilt;
+        xSemaphoreGive(mutex);
+        file.close();
+        ESP_LOGI(TAG, "Rebuilt stats from %u records in %ums", count, millis() - start);
+    }
+
+    void MeasurementStats::add(const MeasurementRecord& record)
+    {
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        add(data, record);
+        xSemaphoreGive(mutex);
+    }
+
+    void MeasurementStats::add(Data& data, const MeasurementRecord& record)
+    {
+        // already counted, e.g. by a rebuild that ran while the record was written
+        if (record.time <= data.lastTime) {
+            return;
+        }
+        data.lastTime = record.time;
+        data.total++;
+        data.hours[(record.time / 3600) % 24]++;
+
+        uint16_t day = record.time / SECONDS_PER_DAY;
+        Day& stats = data.days[day % MEASUREMENT_STATS_DAYS];
+        if (stats.day != day) {
+            stats = Day();
+            stats.day = day;
+            stats.weightMin = UINT16_MAX;
+        }
+        stats.count++;
+        stats.weightSum += record.weight;
+        if (record.weight < stats.weightMin) {
+            stats.weightMin = record.weight;
+        }
+        if (record.weight > stats.weightMax) {
+            stats.weightMax = record.weight;
+        }
+        if (record.weightDropping) {
+            stats.droppingSum += record.weightDropping;
+            stats.droppingCount++;
+        }
+    }
+
+    void MeasurementStats::toJson(JsonDocument& doc, size_t days)
+    {
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        doc["total"] = data.total;
+        auto hours = doc.createNestedArray("hours");
+        for (size_t hour = 0; hour < 24; hour++) {
+            hours.add(data.hours[hour]);
+        }
+        // oldest day first
+        auto dayArray = doc.createNestedArray("days");
+        uint16_t lastDay = data.lastTime / SECONDS_PER_DAY;
+        days = std::min(days, (size_t)MEASUREMENT_STATS_DAYS);
+        for (uint16_t day = lastDay + 1 - days; data.lastTime && day <= lastDay; day++) {
+            const Day& stats = data.days[day % MEASUREMENT_STATS_DAYS];
+            if (stats.day != day || !stats.count) {
+                continue;
+            }
+            auto entry = dayArray.createNestedArray();
+            entry.add((uint32_t)stats.day * SECONDS_PER_DAY);
+            entry.add(stats.count);
+            entry.add(stats.weightSum / stats.count);
+            entry.add(stats.weightMin);
+            entry.add(stats.weightMax);
+            entry.add(stats.droppingSum);
+        }
+        xSemaphoreGive(mutex);
+    }
+
+}
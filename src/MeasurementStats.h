@@ -0,0 +1,80 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FS.h>
+#include <ArduinoJson.h>
+#include "MeasurementLog.h"
+
+#define MEASUREMENT_STATS_MAGIC 0x53445757 // "WWDS"
+#define MEASUREMENT_STATS_VERSION 1
+// number of days with daily aggregates
+#define MEASUREMENT_STATS_DAYS 92
+
+namespace weightwhiskers
+{
+
+    /**
+     * @brief Daily and hour-of-day aggregates of the measurements
+     *
+     * The aggregates are updated with every new measurement and saved to a small file, so the
+     * web interface gets them without downloading the measurements. Days and hours are UTC.
+     * Deletes and imports need a rebuild() from the log because minimum and maximum can't be
+     * undone.
+     */
+    class MeasurementStats
+    {
+    public:
+        struct __attribute__((packed)) Day {
+            // days since 1970-01-01, 0 for an unused slot
+            uint16_t day = 0;
+            uint16_t count = 0;
+            uint16_t weightMin = 0;
+            uint16_t weightMax = 0;
+            uint32_t weightSum = 0;
+            uint32_t droppingSum = 0;
+            uint16_t droppingCount = 0;
+            uint16_t reserved = 0;
+        };
+
+        MeasurementStats(fs::FS& fs, const char* path);
+
+        // loads the aggregates, false if they are missing or corrupt
+        bool begin();
+        bool save();
+        // recalculates all aggregates from the log
+        void rebuild(MeasurementLog& log);
+
+        void add(const MeasurementRecord& record);
+
+        /**
+         * @brief writes hour histogram and the last days as compact arrays
+         *
+         * {"total": n, "hours": [24 counts], "days": [[time, count, mean, min, max, dropping]]}
+         */
+        void toJson(JsonDocument& doc, size_t days);
+
+    protected:
+        struct __attribute__((packed)) Data {
+            uint32_t magic = MEASUREMENT_STATS_MAGIC;
+            uint16_t version = MEASUREMENT_STATS_VERSION;
+            uint16_t dayCount = MEASUREMENT_STATS_DAYS;
+            // time of the newest measurement in the aggregates
+            uint32_t lastTime = 0;
+            uint32_t total = 0;
+            uint32_t hours[24] = { 0 };
+            // ring buffer indexed by day % MEASUREMENT_STATS_DAYS
+            Day days[MEASUREMENT_STATS_DAYS];
+            // CRC-32 of all previous fields
+            uint32_t crc = 0;
+        };
+
+        static void add(Data& data, const MeasurementRecord& record);
+
+        fs::FS& fs;
+        const char* path;
+        // guards data between the measurement, web server and maintenance tasks
+        SemaphoreHandle_t mutex = nullptr;
+        Data data;
+    };
+
+}
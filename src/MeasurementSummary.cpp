@@ -0,0 +1,109 @@
+#include "MeasurementSummary.h"
+#include "Crc32.h"
+
+#define TAG "MeasurementSummary"
+
+namespace weightwhiskers
+{
+
+    MeasurementSummary::MeasurementSummary(fs::FS& fs, const char* path)
+        : fs(fs)
+        , path(path)
+    {
+    }
+
+    bool MeasurementSummary::load()
+    {
+        File file = fs.open(path, FILE_READ);
+        if (!file) {
+            return false;
+        }
+        Data loaded;
+        bool valid = file.read((uint8_t*)&loaded, sizeof(loaded)) == sizeof(loaded)
+            && loaded.magic == MEASUREMENT_SUMMARY_MAGIC
+            && loaded.version == MEASUREMENT_SUMMARY_VERSION
+            && loaded.weightCount <= WEIGHT_HISTORY_SIZE
+            && loaded.weightIndex < WEIGHT_HISTORY_SIZE
+            && loaded.crc == crc32(&loaded, offsetof(Data, crc));
+        file.close();
+        if (!valid) {
+            ESP_LOGW(TAG, "Invalid summary %s", path);
+            return false;
+        }
+        data = loaded;
+        return true;
+    }
+
+    bool MeasurementSummary::save()
+    {
+        data.crc = crc32(&data, offsetof(Data, crc));
+        File file = fs.open(path, FILE_WRITE);
+        if (!file) {
+            ESP_LOGE(TAG, "Cannot open summary %s", path);
+            return false;
+        }
+        bool success = file.write((uint8_t*)&data, sizeof(data)) == sizeof(data);
+        file.close();
+        return success;
+    }
+
+    void MeasurementSummary::invalidate() { fs.remove(path); }
+
+    void MeasurementSummary::rebuild(MeasurementLog& log)
+    {
+        data = Data();
+        File file = log.open();
+        size_t count = log.count();
+        data.total = count - log.deletedCount();
+
+        // collect the newest weights backwards, then add them oldest first
+        uint16_t weights[WEIGHT_HISTORY_SIZE];
+        uint8_t weightCount = 0;
+        MeasurementRecord record;
+        for (size_t i = count; i > 0 && weightCount < WEIGHT_HISTORY_SIZE; i--) {
+            if (log.read(file, i - 1, record)) {
+                if (weightCount == 0) {
+                    data.last = record;
+                }
+                weights[weightCount++] = record.weight;
+            }
+        }
+        file.close();
+        for (uint8_t i = weightCount; i > 0; i--) {
+            data.weights[data.weightIndex] = weights[i - 1];
+            data.weightIndex = (data.weightIndex + 1) % WEIGHT_HISTORY_SIZE;
+        }
+        data.weightCount = weightCount;
+        ESP_LOGI(TAG, "Rebuilt summary from %u records", count);
+    }
+
+    void MeasurementSummary::add(const MeasurementRecord& record)
+    {
+        data.weights[data.weightIndex] = record.weight;
+        data.weightIndex = (data.weightIndex + 1) % WEIGHT_HISTORY_SIZE;
+        if (data.weightCount < WEIGHT_HISTORY_SIZE) {
+            data.weightCount++;
+        }
+        data.total++;
+        data.last = record;
+    }
+
+    uint8_t MeasurementSummary::getWeightCount() const { return data.weightCount; }
+
+    float MeasurementSummary::getAverageWeight() const
+    {
+        if (data.weightCount == 0) {
+            return 0.f;
+        }
+        float sum = 0.f;
+        for (uint8_t i = 0; i < data.weightCount; i++) {
+            sum += data.weights[i];
+        }
+        return sum / data.weightCount;
+    }
+
+    uint32_t MeasurementSummary::getTotal() const { return data.total; }
+
+    const MeasurementRecord& MeasurementSummary::getLast() const { return data.last; }
+
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FS.h>
+#include "MeasurementLog.h"
+
+#define MEASUREMENT_SUMMARY_MAGIC 0x53535757 // "WWSS"
+#define MEASUREMENT_SUMMARY_VERSION 1
+// number of last weights for the deviation filter
+#define WEIGHT_HISTORY_SIZE 5
+
+namespace weightwhiskers
+{
+
+    /**
+     * @brief Small persisted summary of the measurement log
+     *
+     * Holds the last weights for the deviation filter, the number of measurements and the last
+     * measurement. It is updated with every new measurement, so the boot doesn't depend on the
+     * size of the log. If the file is missing or corrupt, it is rebuilt from the end of the log.
+     */
+    class MeasurementSummary
+    {
+    public:
+        MeasurementSummary(fs::FS& fs, const char* path);
+
+        // loads the summary, false if it is missing or corrupt
+        bool load();
+        bool save();
+        // removes the file, the next boot rebuilds the summary
+        void invalidate();
+        // rebuilds the summary by reading the log backwards until the history is full
+        void rebuild(MeasurementLog& log);
+
+        void add(const MeasurementRecord& record);
+
+        // number of weights in the history (0 - WEIGHT_HISTORY_SIZE)
+        uint8_t getWeightCount() const;
+        float getAverageWeight() const;
+        // number of measurements in the log
+        uint32_t getTotal() const;
+        // last measurement, time is 0 if there is none
+        const MeasurementRecord& getLast() const;
+
+    protected:
+        struct __attribute__((packed)) Data {
+            uint32_t magic = MEASUREMENT_SUMMARY_MAGIC;
+            uint16_t version = MEASUREMENT_SUMMARY_VERSION;
+            // circular buffer of the last weights
+            uint8_t weightCount = 0;
+            uint8_t weightIndex = 0;
+            uint16_t weights[WEIGHT_HISTORY_SIZE] = { 0 };
+            uint32_t total = 0;
+            MeasurementRecord last;
+            // CRC-32 of all previous fields
+            uint32_t crc = 0;
+        };
+
+        fs::FS& fs;
+        const char* path;
+        Data data;
+    };
+
+}
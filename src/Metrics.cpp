@@ -0,0 +1,82 @@
+#include "Metrics.h"
+
+namespace weightwhiskers
+{
+    namespace metrics
+    {
+
+        namespace
+        {
+            // upper bounds of the histogram buckets in microseconds
+            constexpr uint32_t bucketBounds[METRICS_BUCKETS] = { 100, 250, 500, 1000, 2500, 5000,
+                10000, 25000, 50000, 100000, 500000, 5000000 };
+        }
+
+        // zero initialized before any constructor runs
+        Metric* Metric::first = nullptr;
+
+        Metric::Metric(const char* name, const char* help)
+            : name(name)
+            , help(help)
+            , next(first)
+        {
+            first = this;
+        }
+
+        void Metric::writeAll(Print& out)
+        {
+            for (Metric* metric = first; metric; metric = metric->next) {
+                metric->write(out);
+            }
+        }
+
+        void Metric::writeHeader(Print& out, const char* type) const
+        {
+            out.printf("# HELP " METRICS_PREFIX "%s %s\n# TYPE " METRICS_PREFIX "%s %s\n", name,
+                help, name, type);
+        }
+
+        void Counter::write(Print& out) const
+        {
+            writeHeader(out, "counter");
+            out.printf(METRICS_PREFIX "%s %u\n", name,
+                (unsigned)value.load(std::memory_order_relaxed));
+        }
+
+        void Gauge::write(Print& out) const
+        {
+            writeHeader(out, "gauge");
+            out.printf(METRICS_PREFIX "%s %d\n", name, (int)value.load(std::memory_order_relaxed));
+        }
+
+        void Histogram::record(uint32_t micros)
+        {
+#if METRICS
+            size_t bucket = 0;
+            while (bucket < METRICS_BUCKETS && micros > bucketBounds[bucket]) {
+                bucket++;
+            }
+            buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+            sum.fetch_add(micros, std::memory_order_relaxed);
+#endif
+        }
+
+        void Histogram::write(Print& out) const
+        {
+            writeHeader(out, "histogram");
+            // buckets are cumulative in the export
+            uint32_t cumulative = 0;
+            for (size_t i = 0; i < METRICS_BUCKETS; i++) {
+                cumulative += buckets[i].load(std::memory_order_relaxed);
+                out.printf(METRICS_PREFIX "%s_bucket{le=\"%g\"} %u\n", name,
+                    bucketBounds[i] / 1e6, (unsigned)cumulative);
+            }
+            cumulative += buckets[METRICS_BUCKETS].load(std::memory_order_relaxed);
+            out.printf(METRICS_PREFIX "%s_bucket{le=\"+Inf\"} %u\n", name, (unsigned)cumulative);
+            out.printf(METRICS_PREFIX "%s_sum %.6f\n", name,
+                sum.load(std::memory_order_relaxed) / 1e6);
+            out.printf(METRICS_PREFIX "%s_count %u\n", name, (unsigned)cumulative);
+        }
+
+    }
+}
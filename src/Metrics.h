@@ -0,0 +1,127 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+
+// compile the instrumentation in (1) or out (0), e.g. with -DMETRICS=0
+#ifndef METRICS
+#define METRICS 1
+#endif
+// prefix of all exported metric names
+#define METRICS_PREFIX "weightwhiskers_"
+// number of latency buckets, the bounds are the same for all histograms
+#define METRICS_BUCKETS 12
+
+namespace weightwhiskers
+{
+    namespace metrics
+    {
+
+        /**
+         * @brief base of all metrics, metrics register themselves in a static list
+         *
+         * Metrics are meant to be globals, registration happens during static initialization
+         * and is never changed afterwards. Recording only uses relaxed atomics, so it can be
+         * done from any task without locks.
+         */
+        class Metric
+        {
+        public:
+            Metric(const char* name, const char* help);
+
+            // writes all registered metrics in the Prometheus text format
+            static void writeAll(Print& out);
+
+        protected:
+            virtual void write(Print& out) const = 0;
+            void writeHeader(Print& out, const char* type) const;
+
+            const char* name;
+            const char* help;
+            Metric* next;
+            static Metric* first;
+        };
+
+        class Counter : public Metric
+        {
+        public:
+            using Metric::Metric;
+
+            void add(uint32_t value = 1)
+            {
+#if METRICS
+                this->value.fetch_add(value, std::memory_order_relaxed);
+#endif
+            }
+            // for counters that are kept elsewhere, e.g. ScaleReader
+            void set(uint32_t value)
+            {
+#if METRICS
+                this->value.store(value, std::memory_order_relaxed);
+#endif
+            }
+
+        protected:
+            void write(Print& out) const override;
+
+            std::atomic<uint32_t> value { 0 };
+        };
+
+        class Gauge : public Metric
+        {
+        public:
+            using Metric::Metric;
+
+            void set(int32_t value)
+            {
+#if METRICS
+                this->value.store(value, std::memory_order_relaxed);
+#endif
+            }
+
+        protected:
+            void write(Print& out) const override;
+
+            std::atomic<int32_t> value { 0 };
+        };
+
+        /**
+         * @brief latency histogram with fixed buckets from 100us to 5s
+         */
+        class Histogram : public Metric
+        {
+        public:
+            using Metric::Metric;
+
+            void record(uint32_t micros);
+
+        protected:
+            void write(Print& out) const override;
+
+            // the last bucket is +Inf
+            std::atomic<uint32_t> buckets[METRICS_BUCKETS + 1] = {};
+            // total in microseconds, wraps like a counter reset after 71 minutes of recorded time
+            // because 64 bit atomics take a lock on the ESP32-S2
+            std::atomic<uint32_t> sum { 0 };
+        };
+
+        /**
+         * @brief records the lifetime of the scope into a histogram
+         */
+        class Timer
+        {
+        public:
+            Timer(Histogram& histogram)
+                : histogram(histogram)
+                , start(micros())
+            {
+            }
+            ~Timer() { histogram.record(micros() - start); }
+
+        protected:
+            Histogram& histogram;
+            uint32_t start;
+        };
+
+    }
+}
@@ -0,0 +1,179 @@
+#include "MqttOutbox.h"
+#include <algorithm>
+
+#define TAG "MqttOutbox"
+
+namespace weightwhiskers
+{
+
+    MqttOutbox::MqttOutbox(fs::FS& fs, const char* path)
+        : fs(fs)
+        , path(path)
+    {
+    }
+
+    bool MqttOutbox::begin()
+    {
+        if (!mutex) {
+            mutex = xSemaphoreCreateMutex();
+        }
+        if (!fs.exists(path)) {
+            return true;
+        }
+        File file = fs.open(path, FILE_READ);
+        MqttOutboxHeader header;
+        if (!file || file.read((uint8_t*)&header, sizeof(header)) != sizeof(header)
+            || header.magic != MQTT_OUTBOX_MAGIC || header.version != MQTT_OUTBOX_VERSION
+            || header.recordSize != sizeof(MeasurementRecord)) {
+            ESP_LOGE(TAG, "Invalid outbox %s, discarding it", path);
+            file.close();
+            fs.remove(path);
+            return false;
+        }
+        records = count(file);
+        delivered = std::min((size_t)header.delivered, records);
+        base = header.base;
+        file.close();
+        ESP_LOGI(TAG, "%u measurements waiting in outbox", records - delivered);
+        return true;
+    }
+
+    bool MqttOutbox::push(const MeasurementRecord& record)
+    {
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        // keep the newest measurements if the broker is gone for a long time
+        bool dropped = records - delivered >= MQTT_OUTBOX_SIZE;
+        if (dropped) {
+            ESP_LOGW(TAG, "Outbox full, dropping oldest measurement");
+            delivered++;
+        }
+
+        // drop delivered records once they take as much space as the pending ones
+        if (records >= 2 * MQTT_OUTBOX_SIZE) {
+            String tmpPath = String(path) + "_tmp";
+            File oldFile = fs.open(path, FILE_READ);
+            File newFile = fs.open(tmpPath, FILE_WRITE);
+            bool success = oldFile && newFile && writeHeader(newFile, base + delivered, 0)
+                && oldFile.seek(sizeof(MqttOutboxHeader) + delivered * sizeof(MeasurementRecord));
+            MeasurementRecord buffer[16];
+            while (success && oldFile.available()) {
+                size_t length = oldFile.read((uint8_t*)buffer, sizeof(buffer));
+                success = newFile.write((uint8_t*)buffer, length) == length;
+            }
+            oldFile.close();
+            newFile.close();
+            // rename replaces the old file, a power loss keeps either the old or the new one
+            if (success && fs.rename(tmpPath, path)) {
+                base += delivered;
+                records -= delivered;
+                delivered = 0;
+            } else {
+                ESP_LOGE(TAG, "Cannot compact outbox");
+                fs.remove(tmpPath);
+            }
+        }
+
+        File file;
+        if (records == 0) {
+            file = fs.open(path, FILE_WRITE, true);
+            delivered = 0;
+            if (!file || !writeHeader(file, base, 0)) {
+                ESP_LOGE(TAG, "Cannot create outbox %s", path);
+                file.close();
+                xSemaphoreGive(mutex);
+                return false;
+            }
+        } else {
+            file = fs.open(path, FILE_APPEND);
+        }
+        bool success = file && file.write((uint8_t*)&record, sizeof(record)) == sizeof(record);
+        file.close();
+        if (success) {
+            records++;
+        } else {
+            ESP_LOGE(TAG, "Cannot write outbox %s", path);
+        }
+        if (dropped && delivered) {
+            file = fs.open(path, "r+");
+            if (!file || !writeHeader(file, base, delivered)) {
+                ESP_LOGE(TAG, "Cannot update outbox %s", path);
+            }
+            file.close();
+        }
+        xSemaphoreGive(mutex);
+        return success;
+    }
+
+    uint32_t MqttOutbox::front()
+    {
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        uint32_t id = base + delivered;
+        xSemaphoreGive(mutex);
+        return id;
+    }
+
+    bool MqttOutbox::peek(uint32_t id, MeasurementRecord& record)
+    {
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        bool success = false;
+        // dropped records are below base + delivered
+        if (id >= base + delivered && id < base + records) {
+            File file = fs.open(path, FILE_READ);
+            success = file
+                && file.seek(sizeof(MqttOutboxHeader) + (id - base) * sizeof(MeasurementRecord))
+                && file.read((uint8_t*)&record, sizeof(record)) == sizeof(record);
+            file.close();
+        }
+        xSemaphoreGive(mutex);
+        return success;
+    }
+
+    void MqttOutbox::pop(uint32_t end)
+    {
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        if (end <= base + delivered) {
+            // already delivered or dropped
+            xSemaphoreGive(mutex);
+            return;
+        }
+        delivered = std::min((size_t)(end - base), records);
+        if (delivered == records) {
+            // everything was delivered, start with a new file
+            fs.remove(path);
+            base += records;
+            records = 0;
+            delivered = 0;
+        } else {
+            File file = fs.open(path, "r+");
+            if (!file || !writeHeader(file, base, delivered)) {
+                ESP_LOGE(TAG, "Cannot update outbox %s", path);
+            }
+            file.close();
+        }
+        xSemaphoreGive(mutex);
+    }
+
+    size_t MqttOutbox::size()
+    {
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        size_t size = records - delivered;
+        xSemaphoreGive(mutex);
+        return size;
+    }
+
+    size_t MqttOutbox::count(File& file)
+    {
+        return file.size() > sizeof(MqttOutboxHeader)
+            ? (file.size() - sizeof(MqttOutboxHeader)) / sizeof(MeasurementRecord)
+            : 0;
+    }
+
+    bool MqttOutbox::writeHeader(File& file, uint32_t base, size_t delivered)
+    {
+        MqttOutboxHeader header;
+        header.delivered = delivered;
+        header.base = base;
+        return file.seek(0) && file.write((uint8_t*)&header, sizeof(header)) == sizeof(header);
+    }
+
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FS.h>
+#include "MeasurementRecord.h"
+
+#define MQTT_OUTBOX_MAGIC 0x424f5757 // "WWOB"
+#define MQTT_OUTBOX_VERSION 1
+// oldest measurements are dropped beyond this (12 KiB)
+#define MQTT_OUTBOX_SIZE 512
+
+namespace weightwhiskers
+{
+
+    struct __attribute__((packed)) MqttOutboxHeader {
+        uint32_t magic = MQTT_OUTBOX_MAGIC;
+        uint16_t version = MQTT_OUTBOX_VERSION;
+        uint16_t recordSize = sizeof(MeasurementRecord);
+        // number of records that were delivered
+        uint32_t delivered = 0;
+        // id of the first record in the file, ids keep counting when the file is compacted
+        uint32_t base = 0;
+    };
+
+    static_assert(sizeof(MqttOutboxHeader) == 16, "unexpected outbox header size");
+
+    /**
+     * @brief Durable FIFO of measurements that still have to be published
+     *
+     * Records are appended to a file and only counted as delivered in the header, so nothing
+     * is lost when the broker or WiFi is gone or the scale reboots. The file is removed once
+     * everything was delivered.
+     *
+     * Records are addressed by a running id instead of their position, so a record that is
+     * published while push() drops the oldest or compacts the file is still popped correctly.
+     */
+    class MqttOutbox
+    {
+    public:
+        MqttOutbox(fs::FS& fs, const char* path);
+
+        bool begin();
+        bool push(const MeasurementRecord& record);
+        // id of the oldest record that wasn't delivered yet
+        uint32_t front();
+        bool peek(uint32_t id, MeasurementRecord& record);
+        // marks all records before the id end as delivered
+        void pop(uint32_t end);
+        // number of records that weren't delivered yet
+        size_t size();
+
+    protected:
+        size_t count(File& file);
+        bool writeHeader(File& file, uint32_t base, size_t delivered);
+
+        fs::FS& fs;
+        const char* path;
+        SemaphoreHandle_t mutex = nullptr;
+        uint32_t base = 0;
+        size_t delivered = 0;
+        size_t records = 0;
+    };
+
+}
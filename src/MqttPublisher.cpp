@@ -0,0 +1,267 @@
+#include "MqttPublisher.h"
+#include <algorithm>
+
+#define TAG "MqttPublisher"
+
+namespace weightwhiskers
+{
+
+    MqttPublisher::MqttPublisher(MqttOutbox& outbox)
+        : outbox(outbox)
+        , mqtt(client)
+    {
+    }
+
+    void MqttPublisher::begin(uint32_t stackSize)
+    {
+        if (!mutex) {
+            mutex = xSemaphoreCreateMutex();
+        }
+        mqtt.setKeepAlive(MQTT_KEEPALIVE_S);
+        mqtt.setCallback([this](char* topic, uint8_t* payload, unsigned int length) {
+            receive(topic, payload, length);
+        });
+        xTaskCreate(task, "taskMQTT", stackSize, this, 1, &taskHandle);
+    }
+
+    void MqttPublisher::configure(const MqttSettings& settings)
+    {
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        this->settings = settings;
+        reconfigure = true;
+        enabled = settings.enabled;
+        xSemaphoreGive(mutex);
+        notify();
+    }
+
+    bool MqttPublisher::publish(const CatMeasurement& measurement)
+    {
+        if (!enabled) {
+            ESP_LOGI(TAG, "MQTT not enabled");
+            return false;
+        }
+        bool success = outbox.push(MeasurementRecord::from(measurement));
+        notify();
+        return success;
+    }
+
+    void MqttPublisher::publishWeight(fixed_t weight, bool occupied)
+    {
+        if (!enabled) {
+            return;
+        }
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        this->weight = weight;
+        this->occupied = occupied;
+        weightPending = true;
+        xSemaphoreGive(mutex);
+        notify();
+    }
+
+    void MqttPublisher::notify()
+    {
+        if (taskHandle) {
+            xTaskNotifyGive(taskHandle);
+        }
+    }
+
+    bool MqttPublisher::isConnected() const { return connected; }
+
+    size_t MqttPublisher::getPending() { return outbox.size(); }
+
+    uint32_t MqttPublisher::getConnectFailures() const { return connectFailures; }
+
+    uint32_t MqttPublisher::getPublishFailures() const { return publishFailures; }
+
+    uint32_t MqttPublisher::getConfirmTimeouts() const { return confirmTimeouts; }
+
+    void MqttPublisher::task(void* parameter) { ((MqttPublisher*)parameter)->run(); }
+
+    void MqttPublisher::run()
+    {
+        TickType_t timeout = portMAX_DELAY;
+        while (true) {
+            ulTaskNotifyTake(pdTRUE, timeout);
+            timeout = portMAX_DELAY;
+
+            xSemaphoreTake(mutex, portMAX_DELAY);
+            if (reconfigure) {
+                reconfigure = false;
+                active = settings;
+                xSemaphoreGive(mutex);
+                if (mqtt.connected()) {
+                    mqtt.disconnect();
+                }
+                // setServer() keeps the pointer, active is only changed here
+                mqtt.setServer(active.server.c_str(), active.port);
+                backoff = MQTT_BACKOFF_MIN_MS;
+                lastConnect = millis() - backoff;
+                inFlight = 0;
+                confirmFailed = false;
+            } else {
+                xSemaphoreGive(mutex);
+            }
+
+            // sleep until WiFi or the settings change
+            if (!active.enabled || !active.server.length() || !WiFi.isConnected()) {
+                if (mqtt.connected()) {
+                    mqtt.disconnect();
+                }
+                connected = false;
+                inFlight = 0;
+                backoff = MQTT_BACKOFF_MIN_MS;
+                lastConnect = millis() - backoff;
+                continue;
+            }
+
+            if (!mqtt.connected() || !mqtt.loop()) {
+                connected = false;
+                // unconfirmed messages are published again
+                inFlight = 0;
+                uint32_t elapsed = millis() - lastConnect;
+                if (elapsed < backoff) {
+                    timeout = pdMS_TO_TICKS(backoff - elapsed);
+                    continue;
+                }
+                if (!connect()) {
+                    timeout = pdMS_TO_TICKS(backoff);
+                    continue;
+                }
+            }
+
+            flushWeight();
+            timeout = pdMS_TO_TICKS(std::min(flush(), (uint32_t)MQTT_LOOP_INTERVAL_MS));
+        }
+    }
+
+    bool MqttPublisher::connect()
+    {
+        lastConnect = millis();
+        ESP_LOGI(TAG, "Connect to %s:%u", active.server.c_str(), active.port);
+        if (!mqtt.connect(MQTT_CLIENT_ID, active.user.c_str(), active.pass.c_str())) {
+            backoff = std::min(backoff * 2, (uint32_t)MQTT_BACKOFF_MAX_MS);
+            connectFailures++;
+            ESP_LOGE(TAG, "Cannot connect to MQTT (state %d), retry in %us", mqtt.state(),
+                backoff / 1000);
+            return false;
+        }
+        if (!mqtt.subscribe(MQTT_CONFIRM_TOPIC)) {
+            mqtt.disconnect();
+            backoff = std::min(backoff * 2, (uint32_t)MQTT_BACKOFF_MAX_MS);
+            connectFailures++;
+            ESP_LOGE(TAG, "Cannot subscribe %s, retry in %us", MQTT_CONFIRM_TOPIC,
+                backoff / 1000);
+            return false;
+        }
+        ESP_LOGI(TAG, "Connected, %u measurements pending", outbox.size());
+        connected = true;
+        // a broker that accepts connections but drops messages isn't retried every second
+        if (!confirmFailed) {
+            backoff = MQTT_BACKOFF_MIN_MS;
+        }
+        return true;
+    }
+
+    uint32_t MqttPublisher::flush()
+    {
+        if (inFlight) {
+            if (!confirmed) {
+                uint32_t elapsed = millis() - publishTime;
+                if (elapsed < MQTT_CONFIRM_TIMEOUT_MS) {
+                    return MQTT_CONFIRM_POLL_MS;
+                }
+                // the broker is gone without closing the connection, publish again later
+                ESP_LOGE(TAG, "No confirmation for %u measurements, reconnect", inFlight);
+                confirmTimeouts++;
+                confirmFailed = true;
+                mqtt.disconnect();
+                connected = false;
+                inFlight = 0;
+                backoff = std::min(backoff * 2, (uint32_t)MQTT_BACKOFF_MAX_MS);
+                lastConnect = millis();
+                return backoff;
+            }
+            // the broker has the messages, dropped records in between are skipped by the id
+            outbox.pop(inFlightEnd);
+            inFlight = 0;
+            confirmFailed = false;
+            backoff = MQTT_BACKOFF_MIN_MS;
+        }
+
+        MeasurementRecord record;
+        uint32_t id = outbox.front();
+        while (inFlight < MQTT_PUBLISH_BATCH && outbox.peek(id + inFlight, record)) {
+            String msg = format(record);
+            ESP_LOGV(TAG, "Send MQTT message on topic %s: %s", active.topicCatWeight.c_str(),
+                msg.c_str());
+            if (!mqtt.publish(active.topicCatWeight.c_str(), msg.c_str())) {
+                ESP_LOGE(TAG, "Could not publish MQTT message!");
+                publishFailures++;
+                break;
+            }
+            inFlight++;
+        }
+        if (!inFlight) {
+            return MQTT_LOOP_INTERVAL_MS;
+        }
+
+        inFlightEnd = id + inFlight;
+        confirmed = false;
+        publishTime = millis();
+        if (!mqtt.publish(MQTT_CONFIRM_TOPIC, String(++confirmSequence).c_str())) {
+            ESP_LOGE(TAG, "Could not publish confirmation marker!");
+            publishFailures++;
+            // the batch is published again
+            inFlight = 0;
+            return MQTT_LOOP_INTERVAL_MS;
+        }
+        return MQTT_CONFIRM_POLL_MS;
+    }
+
+    void MqttPublisher::flushWeight()
+    {
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        bool pending = weightPending;
+        fixed_t weight = this->weight;
+        bool occupied = this->occupied;
+        weightPending = false;
+        xSemaphoreGive(mutex);
+        if (!pending || !active.topicCurrentWeight.length()) {
+            return;
+        }
+
+        String msg = "sensors,device=cat_scale,field=current_weight value="
+            + String(toFloat(weight), 1) + ",occupied=" + (occupied ? "true" : "false");
+        ESP_LOGV(TAG, "Send MQTT message on topic %s: %s", active.topicCurrentWeight.c_str(),
+            msg.c_str());
+        if (!mqtt.publish(active.topicCurrentWeight.c_str(), msg.c_str(), true)) {
+            ESP_LOGE(TAG, "Could not publish live weight!");
+            publishFailures++;
+            // try again after reconnecting, this->weight is the latest value
+            xSemaphoreTake(mutex, portMAX_DELAY);
+            weightPending = true;
+            xSemaphoreGive(mutex);
+        }
+    }
+
+    void MqttPublisher::receive(char* topic, uint8_t* payload, unsigned int length)
+    {
+        // called from mqtt.loop() in the MQTT task
+        if (strcmp(topic, MQTT_CONFIRM_TOPIC) != 0) {
+            return;
+        }
+        String marker = String(confirmSequence);
+        if (length == marker.length() && memcmp(payload, marker.c_str(), length) == 0) {
+            confirmed = true;
+        }
+    }
+
+    String MqttPublisher::format(const MeasurementRecord& record)
+    {
+        // measurements can be sent late, the time field holds the UNIX time of the visit
+        return "sensors,device=cat_scale,field=cat_weight value=" + String(record.weight)
+            + ",std=" + String(record.std) + ",duration=" + String(record.duration)
+            + ",time=" + String(record.time) + "i";
+    }
+
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <PubSubClient.h>
+#include "FixedPoint.h"
+#include "MqttOutbox.h"
+
+#define MQTT_CLIENT_ID "cat_scale"
+#define MQTT_KEEPALIVE_S 30
+// interval of mqtt.loop() while connected, also the keepalive resolution
+#define MQTT_LOOP_INTERVAL_MS 1000
+// reconnect backoff
+#define MQTT_BACKOFF_MIN_MS 1000
+#define MQTT_BACKOFF_MAX_MS 300000
+// a batch is confirmed by the echo of a marker on this topic
+#define MQTT_CONFIRM_TOPIC MQTT_CLIENT_ID "/confirm"
+// interval of mqtt.loop() while waiting for the echo
+#define MQTT_CONFIRM_POLL_MS 100
+// the connection is dropped if the echo doesn't arrive in time
+#define MQTT_CONFIRM_TIMEOUT_MS 5000
+// messages in flight before waiting for the confirmation
+#define MQTT_PUBLISH_BATCH 8
+// compile POST /api/mqtt/test in (1), test/integration/mqtt_broker_restart.sh uses it
+#ifndef MQTT_TEST_ENDPOINT
+#define MQTT_TEST_ENDPOINT 0
+#endif
+
+namespace weightwhiskers
+{
+
+    struct MqttSettings {
+        bool enabled = false;
+        String server;
+        uint16_t port = 1883;
+        String user;
+        String pass;
+        String topicCatWeight;
+        String topicCurrentWeight;
+    };
+
+    /**
+     * @brief Keeps a MQTT connection open and publishes measurements from the outbox
+     *
+     * All MQTT traffic happens in its own task, which sleeps until it is notified (new
+     * measurement, WiFi or config change) or the connection needs service. Lost connections
+     * are retried with exponential backoff.
+     *
+     * PubSubClient can only publish with QoS 0. After each batch a marker is published to
+     * MQTT_CONFIRM_TOPIC, which the publisher subscribed itself. The broker handles the
+     * messages of a connection in order, so once the marker comes back the batch reached the
+     * broker and is removed from the outbox. Without the echo (e.g. a half-open connection
+     * after a broker restart) the connection is dropped and the batch is published again,
+     * i.e. every measurement reaches the broker at least once.
+     *
+     * The live weight isn't stored, a newer value replaces one that wasn't sent yet.
+     */
+    class MqttPublisher
+    {
+    public:
+        MqttPublisher(MqttOutbox& outbox);
+
+        void begin(uint32_t stackSize);
+        // applies new settings in the MQTT task
+        void configure(const MqttSettings& settings);
+        // stores the measurement in the outbox if MQTT is enabled
+        bool publish(const CatMeasurement& measurement);
+        // publishes the live weight as retained message, only the latest value is kept
+        void publishWeight(fixed_t weight, bool occupied);
+        // wakes up the MQTT task, e.g. after WiFi connected
+        void notify();
+
+        bool isConnected() const;
+        size_t getPending();
+        uint32_t getConnectFailures() const;
+        uint32_t getPublishFailures() const;
+        uint32_t getConfirmTimeouts() const;
+
+    protected:
+        static void task(void* parameter);
+        void run();
+        bool connect();
+        // publishes pending measurements, returns the time until the next call is needed
+        uint32_t flush();
+        void flushWeight();
+        void receive(char* topic, uint8_t* payload, unsigned int length);
+        static String format(const MeasurementRecord& record);
+
+        MqttOutbox& outbox;
+        WiFiClient client;
+        PubSubClient mqtt;
+        TaskHandle_t taskHandle = nullptr;
+        SemaphoreHandle_t mutex = nullptr;
+        // written by configure(), copied to active by the MQTT task
+        MqttSettings settings;
+        bool reconfigure = false;
+        volatile bool enabled = false;
+        MqttSettings active;
+        volatile bool connected = false;
+        volatile uint32_t connectFailures = 0;
+        volatile uint32_t publishFailures = 0;
+        uint32_t backoff = MQTT_BACKOFF_MIN_MS;
+        uint32_t lastConnect = 0;
+        volatile uint32_t confirmTimeouts = 0;
+        // published but not confirmed messages, the ids before inFlightEnd
+        size_t inFlight = 0;
+        uint32_t inFlightEnd = 0;
+        uint32_t publishTime = 0;
+        // marker of the batch in flight and whether its echo arrived
+        uint32_t confirmSequence = 0;
+        bool confirmed = false;
+        // the last batch timed out, the next connect doesn't reset the backoff
+        bool confirmFailed = false;
+        // live weight that wasn't published yet
+        bool weightPending = false;
+        fixed_t weight = 0;
+        bool occupied = false;
+    };
+
+}
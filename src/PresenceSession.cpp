@@ -0,0 +1,137 @@
+#include "PresenceSession.h"
+
+namespace weightwhiskers
+{
+
+    void PresenceSession::setConfig(const PresenceConfig& config) { this->config = config; }
+
+    const PresenceConfig& PresenceSession::getConfig() const { return config; }
+
+    PresenceSession::Event PresenceSession::update(uint32_t now, fixed_t weight, fixed_t filtered)
+    {
+        switch (state) {
+        case State::Idle:
+            if (filtered > config.weightMin) {
+                // cat sits on the throne
+                presenceStart = now;
+                duration = 0;
+                statistics.reset();
+                statistics.setWindowMs(config.presenceTimeMinMs);
+                enter(State::Occupied, now);
+                return Event::Entered;
+            }
+            break;
+
+        case State::Occupied:
+            if (filtered > config.weightMin) {
+                duration = now - presenceStart;
+                // the window with the lowest std dev is used once minimum presence time is
+                // reached, the statistics track it while the window slides over the visit
+                statistics.input(weight, now);
+                break;
+            }
+            // cat left the throne, measure droppings if minimum presence time was reached
+            if (duration > config.presenceTimeMinMs) {
+                measurement = CatMeasurement();
+                measurement.weight = toGram(getBestWeight());
+                measurement.std = toFloat(getBestWeightStd());
+                measurement.duration = duration / 1000.f;
+                enter(State::Settling, now);
+                return Event::Left;
+            }
+            enter(State::Retare, now);
+            return Event::Aborted;
+
+        case State::Settling:
+            // wait for settlement to measure droppings
+            if (now - stateStart >= config.settleTimeMs) {
+                enter(State::Dropping, now);
+            }
+            break;
+
+        case State::Dropping:
+            sum += weight;
+            if (++count >= config.droppingSamples) {
+                measurement.weightDropping = sum > 0 ? toGram(sum / count) : 0;
+                enter(State::Retare, now);
+                return Event::Measured;
+            }
+            break;
+
+        case State::Retare:
+            if (now - stateStart < config.tareDelayMs) {
+                break;
+            }
+            sum += weight;
+            if (++count >= config.tareSamples) {
+                tareWeight = (fixed_t)(sum / count);
+                enter(State::Idle, now);
+                return Event::Tared;
+            }
+            break;
+        }
+        return Event::None;
+    }
+
+    void PresenceSession::reset() { enter(State::Idle, stateStart); }
+
+    PresenceSession::State PresenceSession::getState() const { return state; }
+
+    bool PresenceSession::isActive() const { return state != State::Idle; }
+
+    uint32_t PresenceSession::getDuration() const { return duration; }
+
+    int PresenceSession::getProgress() const
+    {
+        return config.presenceTimeMinMs ? (100ULL * duration) / config.presenceTimeMinMs : 100;
+    }
+
+    fixed_t PresenceSession::getBestWeight() const
+    {
+        // window might not be complete if the cat left right after the minimum presence time
+        auto& best = statistics.getBestWindow();
+        return best.count ? best.mean : statistics.mean();
+    }
+
+    fixed_t PresenceSession::getBestWeightStd() const
+    {
+        auto& best = statistics.getBestWindow();
+        return best.count ? (fixed_t)isqrt64((uint64_t)best.variance << FIXED_SHIFT)
+                          : statistics.sigma();
+    }
+
+    const SlidingWindowStatistics<PRESENCE_WINDOW_SIZE>& PresenceSession::getStatistics() const
+    {
+        return statistics;
+    }
+
+    const CatMeasurement& PresenceSession::getMeasurement() const { return measurement; }
+
+    fixed_t PresenceSession::getTareWeight() const { return tareWeight; }
+
+    const char* PresenceSession::toString(State state)
+    {
+        switch (state) {
+        case State::Idle:
+            return "idle";
+        case State::Occupied:
+            return "occupied";
+        case State::Settling:
+            return "settling";
+        case State::Dropping:
+            return "dropping";
+        case State::Retare:
+            return "retare";
+        }
+        return "unknown";
+    }
+
+    void PresenceSession::enter(State state, uint32_t now)
+    {
+        this->state = state;
+        stateStart = now;
+        sum = 0;
+        count = 0;
+    }
+
+}
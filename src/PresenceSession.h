@@ -0,0 +1,101 @@
+#pragma once
+
+#include <stdint.h>
+#include "FixedPoint.h"
+#include "Measurement.h"
+#include "SlidingWindowStatistics.h"
+
+// samples kept for the best weight window (51s at 10 SPS)
+#define PRESENCE_WINDOW_SIZE 512
+
+namespace weightwhiskers
+{
+
+    struct PresenceConfig {
+        // filtered weight that marks the scale as occupied
+        fixed_t weightMin = toFixed(2000);
+        // minimum presence time for a valid measurement, also the best weight window size
+        uint32_t presenceTimeMinMs = 5000;
+        // time the litter needs to settle before the droppings are weighed
+        uint32_t settleTimeMs = 5000;
+        // number of samples averaged for the droppings weight
+        uint16_t droppingSamples = 10;
+        // time to wait before re-taring after the cat left
+        uint32_t tareDelayMs = 1000;
+        // number of samples averaged for the re-tare
+        uint16_t tareSamples = 10;
+    };
+
+    /**
+     * @brief Non-blocking state machine for a single litter box visit
+     *
+     * Idle -> Occupied -> Settling -> Dropping -> Retare -> Idle
+     *
+     * The session is driven by update() with every new sample and never waits itself, so the
+     * caller's loop keeps running during a visit. Timestamps are passed in by the caller which
+     * allows feeding a recorded or synthetic sample stream.
+     */
+    class PresenceSession
+    {
+    public:
+        enum class State { Idle, Occupied, Settling, Dropping, Retare };
+        enum class Event {
+            None,
+            // cat entered the scale
+            Entered,
+            // cat left after the minimum presence time, measurement is pending
+            Left,
+            // cat left before the minimum presence time
+            Aborted,
+            // droppings weighed, measurement is complete
+            Measured,
+            // re-tare done, offset correction available via getTareWeight()
+            Tared
+        };
+
+        void setConfig(const PresenceConfig& config);
+        const PresenceConfig& getConfig() const;
+
+        /**
+         * @brief feeds the next sample into the state machine
+         *
+         * @param now sample timestamp in milliseconds
+         * @param weight unfiltered weight
+         * @param filtered low pass filtered weight
+         * @return event that happened with this sample
+         */
+        Event update(uint32_t now, fixed_t weight, fixed_t filtered);
+        void reset();
+
+        State getState() const;
+        bool isActive() const;
+        // presence duration in milliseconds of the current/last visit
+        uint32_t getDuration() const;
+        // progress to minimum presence time in percent
+        int getProgress() const;
+        fixed_t getBestWeight() const;
+        fixed_t getBestWeightStd() const;
+        const SlidingWindowStatistics<PRESENCE_WINDOW_SIZE>& getStatistics() const;
+        // measurement of the last visit, time is not set
+        const CatMeasurement& getMeasurement() const;
+        // weight the scale showed when empty, subtract it from the offset
+        fixed_t getTareWeight() const;
+
+        static const char* toString(State state);
+
+    protected:
+        void enter(State state, uint32_t now);
+
+        PresenceConfig config;
+        State state = State::Idle;
+        uint32_t stateStart = 0;
+        uint32_t presenceStart = 0;
+        uint32_t duration = 0;
+        SlidingWindowStatistics<PRESENCE_WINDOW_SIZE> statistics;
+        fixed64_t sum = 0;
+        uint16_t count = 0;
+        CatMeasurement measurement;
+        fixed_t tareWeight = 0;
+    };
+
+}
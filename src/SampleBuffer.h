@@ -0,0 +1,142 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace weightwhiskers
+{
+
+    struct Sample
+    {
+        // millis() when the conversion was read
+        uint32_t timestamp = 0;
+        // raw (sign extended 24 bit) HX711 value
+        int32_t raw = 0;
+    };
+
+    /**
+     * @brief Lock-free single producer / multi consumer ring buffer for scale samples
+     *
+     * The producer never blocks and overwrites the oldest samples. Every consumer owns a
+     * Reader with its own position, so slow consumers can't stall the producer or other
+     * consumers. Each slot carries the sequence number it was written with (seqlock), which
+     * allows a reader to detect that it has been lapped and count the lost samples.
+     */
+    template <size_t N>
+    class SampleBuffer
+    {
+        static_assert(N && (N & (N - 1)) == 0, "SampleBuffer size must be a power of two");
+
+    public:
+        class Reader
+        {
+        public:
+            Reader() = default;
+
+            /**
+             * @brief reads the next sample
+             *
+             * @return false if there is no new sample
+             */
+            bool read(Sample& sample)
+            {
+                while (buffer) {
+                    uint32_t head = buffer->head.load(std::memory_order_acquire);
+                    if (head == next) {
+                        return false;
+                    }
+                    // producer lapped us, skip to the oldest sample that still exists
+                    if (head - next > N) {
+                        overruns += head - next - N;
+                        next = head - N;
+                    }
+                    const Slot& slot = buffer->slots[next & (N - 1)];
+                    uint32_t seq = slot.seq.load(std::memory_order_acquire);
+                    if (seq == next + 1) {
+                        sample = slot.sample;
+                        std::atomic_thread_fence(std::memory_order_acquire);
+                        if (slot.seq.load(std::memory_order_relaxed) == seq) {
+                            next++;
+                            return true;
+                        }
+                    }
+                    // slot was overwritten while reading, retry with the new head
+                    overruns++;
+                    next++;
+                }
+                return false;
+            }
+
+            /**
+             * @brief skips all pending samples
+             */
+            void skip()
+            {
+                if (buffer) {
+                    next = buffer->head.load(std::memory_order_acquire);
+                }
+            }
+
+            size_t available() const
+            {
+                if (!buffer) {
+                    return 0;
+                }
+                uint32_t pending = buffer->head.load(std::memory_order_acquire) - next;
+                return pending > N ? N : pending;
+            }
+
+            // number of samples this reader lost because it was too slow
+            uint32_t getOverruns() const { return overruns; }
+
+        protected:
+            friend class SampleBuffer;
+            Reader(const SampleBuffer* buffer, uint32_t next)
+                : buffer(buffer)
+                , next(next)
+            {
+            }
+
+            const SampleBuffer* buffer = nullptr;
+            uint32_t next = 0;
+            uint32_t overruns = 0;
+        };
+
+        /**
+         * @brief appends a sample, must only be called from a single producer
+         */
+        void push(const Sample& sample)
+        {
+            uint32_t seq = head.load(std::memory_order_relaxed);
+            Slot& slot = slots[seq & (N - 1)];
+            // invalidate slot while writing
+            slot.seq.store(0, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            slot.sample = sample;
+            slot.seq.store(seq + 1, std::memory_order_release);
+            head.store(seq + 1, std::memory_order_release);
+        }
+
+        /**
+         * @brief creates a reader that starts with the next pushed sample
+         */
+        Reader createReader() const { return Reader(this, head.load(std::memory_order_acquire)); }
+
+        // total number of pushed samples
+        uint32_t count() const { return head.load(std::memory_order_acquire); }
+
+        static constexpr size_t capacity() { return N; }
+
+    protected:
+        struct Slot
+        {
+            std::atomic<uint32_t> seq { 0 };
+            Sample sample;
+        };
+
+        Slot slots[N];
+        std::atomic<uint32_t> head { 0 };
+    };
+
+}
@@ -0,0 +1,49 @@
+#include "ScalePipeline.h"
+
+namespace weightwhiskers
+{
+
+    ScalePipeline::ScalePipeline(ScaleCalibration& calibration, FixedLowPass& lowPass,
+        PresenceSession& session, LiveWeightPublisher& liveWeight, ZeroTracker& zeroTracker)
+        : calibration(calibration)
+        , lowPass(lowPass)
+        , session(session)
+        , liveWeight(liveWeight)
+        , zeroTracker(zeroTracker)
+    {
+    }
+
+    ScalePipeline::Result ScalePipeline::process(uint32_t timestamp, int32_t raw)
+    {
+        Result result;
+        result.weight = calibration.toWeight(raw);
+        result.filtered = lowPass.input(result.weight, timestamp);
+        result.event = session.update(timestamp, result.weight, result.filtered);
+        result.occupied = session.getState() == PresenceSession::State::Occupied;
+        result.publishWeight = liveWeight.update(timestamp, result.filtered, result.occupied);
+        if (result.event == PresenceSession::Event::Tared) {
+            // apply weight of the empty scale to the offset
+            calibration.setOffset(
+                calibration.getOffset() + calibration.toRaw(session.getTareWeight()));
+        }
+        // the session has its own re-tare after a visit
+        if (result.event != PresenceSession::Event::None
+            || session.getState() != PresenceSession::State::Idle) {
+            zeroTracker.reset();
+            return result;
+        }
+        result.zeroCorrection = zeroTracker.update(timestamp, result.weight);
+        if (result.zeroCorrection) {
+            calibration.setOffset(
+                calibration.getOffset() + calibration.toRaw(result.zeroCorrection));
+            // move the filter along, otherwise it would show the correction as a step
+            lowPass.setToNewValue(lowPass.output() - result.zeroCorrection, timestamp);
+        }
+        return result;
+    }
+
+    const PresenceSession& ScalePipeline::getSession() const { return session; }
+
+    const ZeroTracker& ScalePipeline::getZeroTracker() const { return zeroTracker; }
+
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdint.h>
+#include "FixedPoint.h"
+#include "LiveWeightPublisher.h"
+#include "PresenceSession.h"
+#include "ZeroTracker.h"
+
+namespace weightwhiskers
+{
+
+    /**
+     * @brief Turns raw samples into weights, presence events and live weight updates
+     *
+     * This is the hardware independent part of the sample processing. The firmware feeds it
+     * from the HX711 task and handles the results (LEDs, storage, MQTT), the replay tool
+     * feeds it recorded or synthetic samples on the host with a virtual clock.
+     */
+    class ScalePipeline
+    {
+    public:
+        struct Result {
+            fixed_t weight = 0;
+            fixed_t filtered = 0;
+            PresenceSession::Event event = PresenceSession::Event::None;
+            // a cat is on the scale
+            bool occupied = false;
+            // weight and occupancy should be published as live weight
+            bool publishWeight = false;
+            // zero correction applied to the offset with this sample
+            fixed_t zeroCorrection = 0;
+        };
+
+        ScalePipeline(ScaleCalibration& calibration, FixedLowPass& lowPass,
+            PresenceSession& session, LiveWeightPublisher& liveWeight, ZeroTracker& zeroTracker);
+
+        /**
+         * @brief processes one sample
+         *
+         * Moves the calibration offset when the session re-tares after a visit or when the zero
+         * tracker corrects the empty scale.
+         */
+        Result process(uint32_t timestamp, int32_t raw);
+        const PresenceSession& getSession() const;
+        const ZeroTracker& getZeroTracker() const;
+
+    protected:
+        ScaleCalibration& calibration;
+        FixedLowPass& lowPass;
+        PresenceSession& session;
+        LiveWeightPublisher& liveWeight;
+        ZeroTracker& zeroTracker;
+    };
+
+}
@@ -0,0 +1,104 @@
+#include "ScaleReader.h"
+
+#define TAG "ScaleReader"
+
+namespace weightwhiskers
+{
+
+    ScaleReader::ScaleReader(HX711& scale, uint8_t doutPin, uint8_t sckPin)
+        : scale(scale)
+        , doutPin(doutPin)
+        , sckPin(sckPin)
+    {
+    }
+
+    bool ScaleReader::begin(UBaseType_t priority)
+    {
+        if (taskHandle) {
+            return true;
+        }
+        scale.begin(doutPin, sckPin);
+        // the acquisition task needs a higher priority than loop() to never miss a conversion
+        if (xTaskCreate(task, "taskScale", 4096, this, priority, &taskHandle) != pdPASS) {
+            ESP_LOGE(TAG, "Cannot create acquisition task");
+            taskHandle = nullptr;
+            return false;
+        }
+        attachInterruptArg(digitalPinToInterrupt(doutPin), onDataReady, this, FALLING);
+        return true;
+    }
+
+    bool ScaleReader::isRunning() const { return taskHandle != nullptr; }
+
+    ScaleSampleBuffer& ScaleReader::getBuffer() { return buffer; }
+
+    ScaleSampleBuffer::Reader ScaleReader::createReader() const { return buffer.createReader(); }
+
+    bool ScaleReader::waitForSample(
+        ScaleSampleBuffer::Reader& reader, Sample& sample, uint32_t timeoutMs)
+    {
+        auto start = millis();
+        while (!reader.read(sample)) {
+            if (millis() - start > timeoutMs) {
+                return false;
+            }
+            delay(1);
+        }
+        return true;
+    }
+
+    uint32_t ScaleReader::getSampleCount() const { return buffer.count(); }
+
+    uint32_t ScaleReader::getDroppedCount() const { return dropped; }
+
+    uint32_t ScaleReader::getTimeoutCount() const { return timeouts; }
+
+    void IRAM_ATTR ScaleReader::onDataReady(void* arg)
+    {
+        auto reader = static_cast<ScaleReader*>(arg);
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR(reader->taskHandle, &woken);
+        if (woken) {
+            portYIELD_FROM_ISR();
+        }
+    }
+
+    void ScaleReader::task(void* parameter) { static_cast<ScaleReader*>(parameter)->run(); }
+
+    void ScaleReader::run()
+    {
+        while (true) {
+            // wait for DOUT falling edge, fall back to polling if the edge was missed
+            if (!ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(2 * SCALE_SAMPLE_PERIOD_MS))
+                && !scale.is_ready()) {
+                if (millis() - lastTimestamp > SCALE_SAMPLE_TIMEOUT_MS) {
+                    timeouts++;
+                    lastTimestamp = millis();
+                    ESP_LOGE(TAG, "HX711 not found.");
+                }
+                continue;
+            }
+            if (!scale.is_ready()) {
+                continue;
+            }
+
+            Sample sample;
+            sample.raw = scale.read();
+            sample.timestamp = millis();
+            // clocking out the data toggles DOUT, ignore the edges caused by reading
+            ulTaskNotifyTake(pdTRUE, 0);
+
+            // count conversions that were missed since the last sample
+            if (buffer.count()) {
+                uint32_t periods = (sample.timestamp - lastTimestamp + SCALE_SAMPLE_PERIOD_MS / 2)
+                    / SCALE_SAMPLE_PERIOD_MS;
+                if (periods > 1) {
+                    dropped += periods - 1;
+                }
+            }
+            lastTimestamp = sample.timestamp;
+            buffer.push(sample);
+        }
+    }
+
+}
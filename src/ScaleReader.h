@@ -0,0 +1,61 @@
+#pragma once
+
+#include <Arduino.h>
+#include <HX711.h>
+#include "SampleBuffer.h"
+
+// samples kept in the ring buffer (25s at 10 SPS)
+#define SCALE_SAMPLE_BUFFER_SIZE 256
+// nominal HX711 conversion period (RATE pin low = 10 SPS, high = 80 SPS)
+#define SCALE_SAMPLE_PERIOD_MS 100
+// HX711 is considered missing if there is no conversion within this time
+#define SCALE_SAMPLE_TIMEOUT_MS 1000
+
+namespace weightwhiskers
+{
+
+    typedef SampleBuffer<SCALE_SAMPLE_BUFFER_SIZE> ScaleSampleBuffer;
+
+    /**
+     * @brief Interrupt driven HX711 acquisition
+     *
+     * A dedicated task is woken by the falling edge of DOUT (data ready), reads every
+     * conversion exactly once and pushes it into a lock-free ring buffer. All other code
+     * consumes the samples through its own ScaleSampleBuffer::Reader and must not talk to
+     * the HX711 directly anymore.
+     */
+    class ScaleReader
+    {
+    public:
+        ScaleReader(HX711& scale, uint8_t doutPin, uint8_t sckPin);
+        bool begin(UBaseType_t priority = 5);
+        bool isRunning() const;
+
+        ScaleSampleBuffer& getBuffer();
+        ScaleSampleBuffer::Reader createReader() const;
+        bool waitForSample(ScaleSampleBuffer::Reader& reader, Sample& sample,
+            uint32_t timeoutMs = SCALE_SAMPLE_TIMEOUT_MS);
+
+        // number of conversions read
+        uint32_t getSampleCount() const;
+        // number of conversions that were missed by the acquisition task
+        uint32_t getDroppedCount() const;
+        // number of times the HX711 didn't signal data ready in time
+        uint32_t getTimeoutCount() const;
+
+    protected:
+        static void IRAM_ATTR onDataReady(void* arg);
+        static void task(void* parameter);
+        void run();
+
+        HX711& scale;
+        uint8_t doutPin;
+        uint8_t sckPin;
+        TaskHandle_t taskHandle = nullptr;
+        ScaleSampleBuffer buffer;
+        uint32_t lastTimestamp = 0;
+        volatile uint32_t dropped = 0;
+        volatile uint32_t timeouts = 0;
+    };
+
+}
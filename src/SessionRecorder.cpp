@@ -0,0 +1,209 @@
+#include "SessionRecorder.h"
+
+#if SESSION_RECORDER
+
+#include <algorithm>
+
+#define TAG "SessionRecorder"
+
+namespace weightwhiskers
+{
+
+    namespace
+    {
+        // Q20.12 to 0.1g
+        int32_t toDecigram(fixed_t value)
+        {
+            return (int32_t)(((fixed64_t)value * 10 + FIXED_ONE / 2) >> FIXED_SHIFT);
+        }
+    }
+
+    SessionRecorder::Cursor::Cursor(const SessionRecorder& recorder, const Session& session)
+        : recorder(recorder)
+        , position(session.offset)
+        , end(session.offset + session.length)
+        , timestamp(0)
+    {
+    }
+
+    bool SessionRecorder::Cursor::next(uint32_t& timestamp, int32_t& weight)
+    {
+        uint32_t start = position;
+        if (position + 2 > end || !recorder.isAvailable(start)) {
+            return false;
+        }
+        this->timestamp += recorder.read(position++);
+        int16_t delta = (int16_t)recorder.read(position++);
+        if (delta == SESSION_RECORDER_ESCAPE) {
+            if (position + 2 > end) {
+                return false;
+            }
+            uint32_t low = recorder.read(position++);
+            uint32_t high = recorder.read(position++);
+            this->weight = (int32_t)(low | (high << 16));
+        } else {
+            this->weight += delta;
+        }
+        // the words may have been overwritten while they were read
+        if (!recorder.isAvailable(start)) {
+            return false;
+        }
+        timestamp = this->timestamp;
+        weight = this->weight;
+        return true;
+    }
+
+    SessionRecorder::~SessionRecorder() { free(words); }
+
+    bool SessionRecorder::setEnabled(bool enabled)
+    {
+        if (enabled && !words) {
+            words = (uint16_t*)malloc(SESSION_RECORDER_WORDS * sizeof(uint16_t));
+            if (!words) {
+                ESP_LOGE(TAG, "Cannot allocate %u bytes", SESSION_RECORDER_WORDS * 2);
+                return false;
+            }
+        }
+        if (!enabled) {
+            stop();
+        }
+        this->enabled = enabled;
+        ESP_LOGI(TAG, "Session recorder %s", enabled ? "enabled" : "disabled");
+        return true;
+    }
+
+    bool SessionRecorder::isEnabled() const { return enabled; }
+
+    void SessionRecorder::start(uint32_t timestamp, time_t time)
+    {
+        if (!enabled) {
+            return;
+        }
+        current = nextId % SESSION_RECORDER_SESSIONS;
+        Session& session = sessions[current];
+        session = Session();
+        session.id = nextId++;
+        session.time = time;
+        session.timestamp = timestamp;
+        session.offset = writePosition;
+        lastTimestamp = timestamp;
+        lastWeight = 0;
+    }
+
+    void SessionRecorder::add(uint32_t timestamp, fixed_t weight)
+    {
+        if (current < 0) {
+            return;
+        }
+        Session& session = sessions[current];
+        // stop before the session overwrites its own beginning
+        if (session.length + 4 > SESSION_RECORDER_WORDS) {
+            return;
+        }
+        uint32_t delta = timestamp - lastTimestamp;
+        write(delta > UINT16_MAX ? UINT16_MAX : delta);
+        int32_t value = toDecigram(weight);
+        int32_t weightDelta = value - lastWeight;
+        if (weightDelta > INT16_MIN && weightDelta <= INT16_MAX) {
+            write((uint16_t)(int16_t)weightDelta);
+            session.length += 2;
+        } else {
+            write((uint16_t)SESSION_RECORDER_ESCAPE);
+            write((uint32_t)value & 0xffff);
+            write((uint32_t)value >> 16);
+            session.length += 4;
+        }
+        session.samples++;
+        lastTimestamp = timestamp;
+        lastWeight = value;
+    }
+
+    void SessionRecorder::stop() { current = -1; }
+
+    size_t SessionRecorder::getSessionCount() const
+    {
+        size_t count = 0;
+        Session session;
+        while (getSession(count, session)) {
+            count++;
+        }
+        return count;
+    }
+
+    bool SessionRecorder::getSession(size_t index, Session& session) const
+    {
+        if (index >= SESSION_RECORDER_SESSIONS || index + 1 >= nextId) {
+            return false;
+        }
+        uint32_t id = nextId - 1 - index;
+        session = sessions[id % SESSION_RECORDER_SESSIONS];
+        return session.id == id && isAvailable(session.offset);
+    }
+
+    bool SessionRecorder::save(size_t index, fs::FS& fs, const char* path) const
+    {
+        Session session;
+        if (!getSession(index, session)) {
+            return false;
+        }
+        File file = fs.open(path, FILE_WRITE);
+        if (!file) {
+            ESP_LOGE(TAG, "Cannot open %s", path);
+            return false;
+        }
+        file.println("time,weight");
+        Cursor cursor(*this, session);
+        uint32_t timestamp;
+        int32_t weight;
+        char line[32];
+        while (cursor.next(timestamp, weight)) {
+            file.write((uint8_t*)line, formatCsv(timestamp, weight, line, sizeof(line)));
+        }
+        file.close();
+        return true;
+    }
+
+    size_t SessionRecorder::copy(
+        const Session& session, size_t position, uint8_t* buffer, size_t size) const
+    {
+        size_t length = 0;
+        size_t end = session.length * sizeof(uint16_t);
+        while (position + length < end && length < size) {
+            size_t offset = position + length;
+            uint16_t word = read(session.offset + offset / 2);
+            buffer[length++] = offset % 2 ? word >> 8 : word & 0xff;
+        }
+        // words were overwritten by a newer session while copying
+        if (!isAvailable(session.offset + position / 2)) {
+            return 0;
+        }
+        return length;
+    }
+
+    size_t SessionRecorder::formatCsv(
+        uint32_t timestamp, int32_t weight, char* buffer, size_t size)
+    {
+        int length = snprintf(buffer, size, "%lu,%s%ld.%ld\n", (unsigned long)timestamp,
+            weight < 0 ? "-" : "", (long)(abs(weight) / 10), (long)(abs(weight) % 10));
+        return length < 0 ? 0 : std::min((size_t)length, size - 1);
+    }
+
+    void SessionRecorder::write(uint16_t word)
+    {
+        words[writePosition % SESSION_RECORDER_WORDS] = word;
+        writePosition++;
+    }
+
+    uint16_t SessionRecorder::read(uint32_t position) const
+    {
+        return words[position % SESSION_RECORDER_WORDS];
+    }
+
+    bool SessionRecorder::isAvailable(uint32_t position) const
+    {
+        return words && writePosition - position <= SESSION_RECORDER_WORDS;
+    }
+
+}
+
+#endif
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FS.h>
+#include "FixedPoint.h"
+
+// compile the recorder in (1) or out (0), e.g. with -DSESSION_RECORDER=0
+#ifndef SESSION_RECORDER
+#define SESSION_RECORDER 1
+#endif
+// number of sessions that are kept
+#define SESSION_RECORDER_SESSIONS 4
+// 16 bit words for all sessions, a sample takes 2 words (about 13 minutes at 10 SPS)
+#define SESSION_RECORDER_WORDS 16384
+// weight delta that is followed by the absolute weight in two words
+#define SESSION_RECORDER_ESCAPE INT16_MIN
+
+namespace weightwhiskers
+{
+
+    /**
+     * @brief Records the weight samples of the last sessions (visits) in RAM
+     *
+     * Samples are stored as pairs of 16 bit words in a ring buffer: the milliseconds since
+     * the previous sample and the weight delta in 0.1g. Larger weight changes are escaped and
+     * followed by the absolute value. Nothing is written to flash unless save() is called.
+     *
+     * The buffer is only allocated once recording is enabled at runtime. Old sessions are
+     * overwritten by new ones; readers notice that and stop.
+     */
+    class SessionRecorder
+    {
+    public:
+        struct Session {
+            // increasing id, 0 for an unused slot
+            uint32_t id = 0;
+            // UNIX time and millis() of the first sample
+            time_t time = 0;
+            uint32_t timestamp = 0;
+            // absolute word position and length in words
+            uint32_t offset = 0;
+            uint32_t length = 0;
+            uint32_t samples = 0;
+        };
+
+        /**
+         * @brief decodes the samples of a session one by one
+         */
+        class Cursor
+        {
+        public:
+            Cursor(const SessionRecorder& recorder, const Session& session);
+
+            // next sample, false at the end or if the session was overwritten
+            bool next(uint32_t& timestamp, int32_t& weight);
+
+        protected:
+            const SessionRecorder& recorder;
+            uint32_t position;
+            uint32_t end;
+            uint32_t timestamp;
+            int32_t weight = 0;
+        };
+
+        ~SessionRecorder();
+
+        // allocates the buffer on first use, disabling stops recording but keeps the data
+        bool setEnabled(bool enabled);
+        bool isEnabled() const;
+
+        void start(uint32_t timestamp, time_t time);
+        void add(uint32_t timestamp, fixed_t weight);
+        void stop();
+
+        // number of sessions that are still in the buffer
+        size_t getSessionCount() const;
+        // session by age, 0 is the newest, false if it doesn't exist
+        bool getSession(size_t index, Session& session) const;
+        // writes a session as CSV "time,weight" with time in ms since the first sample
+        bool save(size_t index, fs::FS& fs, const char* path) const;
+        /**
+         * @brief copies the encoded words of a session from byte position into buffer
+         *
+         * @return number of bytes, 0 at the end or if the session was overwritten
+         */
+        size_t copy(const Session& session, size_t position, uint8_t* buffer, size_t size) const;
+        // formats a sample as CSV line "time,weight" including the line break
+        static size_t formatCsv(uint32_t timestamp, int32_t weight, char* buffer, size_t size);
+
+    protected:
+        void write(uint16_t word);
+        uint16_t read(uint32_t position) const;
+        // true if data at the absolute position wasn't overwritten yet
+        bool isAvailable(uint32_t position) const;
+
+        bool enabled = false;
+        uint16_t* words = nullptr;
+        // total number of written words, wraps the ring buffer
+        volatile uint32_t writePosition = 0;
+        Session sessions[SESSION_RECORDER_SESSIONS];
+        // slot of the session that is recorded, -1 if none
+        int current = -1;
+        uint32_t nextId = 1;
+        uint32_t lastTimestamp = 0;
+        int32_t lastWeight = 0;
+    };
+
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "FixedPoint.h"
+
+namespace weightwhiskers
+{
+
+    /**
+     * @brief Exact mean/variance over a sliding window of samples
+     *
+     * The window is limited by a number of samples and/or a duration in milliseconds and is
+     * backed by a ring buffer of N samples. Pushing and evicting a sample is O(1): the sums
+     * of the values and squared values are updated with integers, so removing a sample
+     * subtracts exactly what was added and the sums never drift. The sums are taken relative
+     * to a reference that follows the window mean, which keeps the squares small and the
+     * rounding of the mean negligible.
+     *
+     * The window with the lowest variance seen since reset() is tracked without keeping the
+     * sample history.
+     */
+    template <size_t N>
+    class SlidingWindowStatistics
+    {
+    public:
+        struct Window {
+            fixed_t mean = 0;
+            fixed64_t variance = INT64_MAX;
+            // timestamp of the newest sample in the window
+            uint32_t timestamp = 0;
+            uint16_t count = 0;
+        };
+
+        /**
+         * @brief limits the window to a number of samples (0 = capacity N)
+         */
+        void setWindowSamples(size_t samples)
+        {
+            windowSamples = (samples == 0 || samples > N) ? N : samples;
+        }
+
+        /**
+         * @brief limits the window to a duration in milliseconds (0 = disabled)
+         */
+        void setWindowMs(uint32_t ms) { windowMs = ms; }
+
+        void reset()
+        {
+            head = 0;
+            size = 0;
+            sum = 0;
+            sumSquares = 0;
+            complete = false;
+            best = Window();
+        }
+
+        void input(fixed_t value, uint32_t now)
+        {
+            if (size == 0 && !complete) {
+                reference = value;
+            }
+            // evict samples that left the window
+            while (size
+                && (size >= windowSamples
+                    || (windowMs && now - entries[head].timestamp >= windowMs))) {
+                pop();
+                complete = true;
+            }
+            Entry& entry = entries[(head + size) % N];
+            entry.value = value;
+            entry.timestamp = now;
+            fixed64_t delta = value - reference;
+            sum += delta;
+            sumSquares += delta * delta;
+            size++;
+            if (size >= windowSamples) {
+                complete = true;
+            }
+            // move reference to the window mean if it is more than 1g off (exact rebase)
+            if (sum > (fixed64_t)size * FIXED_ONE || sum < -(fixed64_t)size * FIXED_ONE) {
+                fixed64_t shift = sum / (fixed64_t)size;
+                sumSquares += (fixed64_t)size * shift * shift - 2 * shift * sum;
+                sum -= (fixed64_t)size * shift;
+                reference += shift;
+            }
+
+            // track window with lowest variance
+            if (complete) {
+                fixed64_t currentVariance = variance();
+                if (currentVariance < best.variance) {
+                    best.mean = mean();
+                    best.variance = currentVariance;
+                    best.timestamp = now;
+                    best.count = (uint16_t)size;
+                }
+            }
+        }
+
+        size_t count() const { return size; }
+
+        // true once the window spans the configured number of samples or duration
+        bool isComplete() const { return complete; }
+
+        fixed_t mean() const { return size ? (fixed_t)(reference + sum / (fixed64_t)size) : 0; }
+
+        // population variance in Q20.12 gram²
+        fixed64_t variance() const
+        {
+            if (!size) {
+                return 0;
+            }
+            fixed64_t mean = sum / (fixed64_t)size;
+            fixed64_t variance = (sumSquares / (fixed64_t)size - mean * mean) >> FIXED_SHIFT;
+            return variance > 0 ? variance : 0;
+        }
+
+        fixed_t sigma() const { return (fixed_t)isqrt64((uint64_t)variance() << FIXED_SHIFT); }
+
+        // window with the lowest variance since reset(), variance is INT64_MAX if none
+        const Window& getBestWindow() const { return best; }
+
+        static constexpr size_t capacity() { return N; }
+
+    protected:
+        struct Entry {
+            fixed_t value;
+            uint32_t timestamp;
+        };
+
+        void pop()
+        {
+            fixed64_t delta = entries[head].value - reference;
+            sum -= delta;
+            sumSquares -= delta * delta;
+            head = (head + 1) % N;
+            size--;
+        }
+
+        Entry entries[N];
+        size_t head = 0;
+        size_t size = 0;
+        size_t windowSamples = N;
+        uint32_t windowMs = 0;
+        fixed_t reference = 0;
+        // sum of (value - reference) as Q20.12
+        fixed64_t sum = 0;
+        // sum of (value - reference)² as Q40.24
+        fixed64_t sumSquares = 0;
+        bool complete = false;
+        Window best;
+    };
+
+}
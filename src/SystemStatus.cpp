@@ -0,0 +1,103 @@
+#include "SystemStatus.h"
+#include <WiFi.h>
+
+#define TAG "SystemStatus"
+
+namespace weightwhiskers
+{
+
+    SystemStatus::SystemStatus(fs::LittleFSFS& fs, MeasurementLog& log)
+        : fs(fs)
+        , log(log)
+    {
+    }
+
+    void SystemStatus::begin(uint32_t stackSize)
+    {
+        if (!mutex) {
+            mutex = xSemaphoreCreateMutex();
+        }
+        refresh();
+        if (!taskHandle) {
+            xTaskCreate(task, "taskStatus", stackSize, this, 1, &taskHandle);
+        }
+    }
+
+    void SystemStatus::notify()
+    {
+        if (taskHandle) {
+            xTaskNotifyGive(taskHandle);
+        }
+    }
+
+    void SystemStatus::invalidateFlash() { flashStale = true; }
+
+    SystemSnapshot SystemStatus::get()
+    {
+        if (!mutex) {
+            return snapshot;
+        }
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        SystemSnapshot copy = snapshot;
+        xSemaphoreGive(mutex);
+        return copy;
+    }
+
+    void SystemStatus::task(void* parameter) { ((SystemStatus*)parameter)->run(); }
+
+    void SystemStatus::run()
+    {
+        while (true) {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(STATUS_INTERVAL_MS));
+            refresh();
+        }
+    }
+
+    void SystemStatus::refresh()
+    {
+        // collect everything without holding the lock
+        SystemSnapshot next = get();
+        next.timestamp = millis();
+        if (WiFi.getMode() != WIFI_STA) {
+            next.wifi = -2;
+            next.rssi = 0;
+        } else if (!WiFi.isConnected()) {
+            next.wifi = -1;
+            next.rssi = 0;
+        } else {
+            next.rssi = WiFi.RSSI();
+            next.wifi = toBars(next.rssi);
+        }
+        next.heapSize = ESP.getHeapSize();
+        next.heapFree = ESP.getFreeHeap();
+        next.heapMin = ESP.getMinFreeHeap();
+        next.heapMax = ESP.getMaxAllocHeap();
+        if (flashStale || next.timestamp - next.flashTimestamp > STATUS_FLASH_INTERVAL_MS) {
+            flashStale = false;
+            uint32_t start = millis();
+            next.flashTimestamp = next.timestamp;
+            next.flashTotal = fs.totalBytes();
+            next.flashUsed = fs.usedBytes();
+            next.measurementsSize = log.fileSize();
+            ESP_LOGD(TAG, "Filesystem usage took %ums", millis() - start);
+        }
+
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        snapshot = next;
+        xSemaphoreGive(mutex);
+    }
+
+    int8_t SystemStatus::toBars(int8_t rssi)
+    {
+        if (rssi >= -55)
+            return 4;
+        else if (rssi >= -66)
+            return 3;
+        else if (rssi >= -77)
+            return 2;
+        else if (rssi >= -88)
+            return 1;
+        return 0;
+    }
+
+}
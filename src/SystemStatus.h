@@ -0,0 +1,65 @@
+#pragma once
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include "MeasurementLog.h"
+
+// refresh interval of WiFi and heap
+#define STATUS_INTERVAL_MS 2000
+// refresh interval of the filesystem usage if it wasn't invalidated before
+#define STATUS_FLASH_INTERVAL_MS 60000
+
+namespace weightwhiskers
+{
+
+    struct SystemSnapshot {
+        uint32_t timestamp = 0;
+        // WiFi bars 0-4, -1 not connected, -2 AP mode
+        int8_t wifi = -1;
+        int8_t rssi = 0;
+        uint32_t heapSize = 0;
+        uint32_t heapFree = 0;
+        uint32_t heapMin = 0;
+        uint32_t heapMax = 0;
+        uint32_t flashTimestamp = 0;
+        size_t flashTotal = 0;
+        size_t flashUsed = 0;
+        size_t measurementsSize = 0;
+    };
+
+    /**
+     * @brief Polls WiFi, heap and filesystem usage in its own task
+     *
+     * Consumers like the display, /api/system and the metrics only copy the latest snapshot
+     * and never touch the radio driver or LittleFS themselves. The filesystem usage walks the
+     * LittleFS metadata, so it's only refreshed after invalidateFlash() or every
+     * STATUS_FLASH_INTERVAL_MS.
+     */
+    class SystemStatus
+    {
+    public:
+        SystemStatus(fs::LittleFSFS& fs, MeasurementLog& log);
+
+        // takes the first snapshot and starts the task
+        void begin(uint32_t stackSize);
+        // refreshes the snapshot right away, e.g. after a WiFi event
+        void notify();
+        // refreshes the filesystem usage with the next snapshot, e.g. after writing a file
+        void invalidateFlash();
+        SystemSnapshot get();
+
+    protected:
+        static void task(void* parameter);
+        void run();
+        void refresh();
+        static int8_t toBars(int8_t rssi);
+
+        fs::LittleFSFS& fs;
+        MeasurementLog& log;
+        TaskHandle_t taskHandle = nullptr;
+        SemaphoreHandle_t mutex = nullptr;
+        SystemSnapshot snapshot;
+        volatile bool flashStale = true;
+    };
+
+}
@@ -0,0 +1,101 @@
+#include "ZeroTracker.h"
+
+namespace weightwhiskers
+{
+
+    void ZeroTracker::setConfig(const ZeroTrackerConfig& config) { this->config = config; }
+
+    const ZeroTrackerConfig& ZeroTracker::getConfig() const { return config; }
+
+    fixed_t ZeroTracker::update(uint32_t now, fixed_t weight)
+    {
+        if (!started) {
+            restart(now, weight);
+            return 0;
+        }
+        if (weight < minimum) {
+            minimum = weight;
+        }
+        if (weight > maximum) {
+            maximum = weight;
+        }
+        if (maximum - minimum > config.stableRange) {
+            // something moves, a possible step keeps its start
+            restart(now, weight);
+            return 0;
+        }
+        sum += weight;
+        count++;
+        if (now - windowStart < config.windowMs) {
+            return 0;
+        }
+
+        fixed_t mean = (fixed_t)(sum / count);
+        uint32_t start = windowStart;
+        restart(now, weight);
+        if (zeroRequested) {
+            zeroRequested = false;
+            return correct(mean, stepCorrections);
+        }
+        if (mean >= -config.band && mean <= config.band) {
+            stepping = false;
+            if (mean >= -config.driftMin && mean <= config.driftMin) {
+                return 0;
+            }
+            // the shift of a negative value would round away from zero
+            fixed_t correction = mean / (1 << config.driftShift);
+            if (correction > config.driftMax) {
+                correction = config.driftMax;
+            } else if (correction < -config.driftMax) {
+                correction = -config.driftMax;
+            }
+            return correct(correction, driftCorrections);
+        }
+        fixed_t change = mean > stepWeight ? mean - stepWeight : stepWeight - mean;
+        if (!stepping || change > config.stableRange) {
+            stepping = true;
+            stepStart = start;
+            stepWeight = mean;
+            return 0;
+        }
+        if (now - stepStart < config.stepHoldMs) {
+            return 0;
+        }
+        return correct(mean, stepCorrections);
+    }
+
+    void ZeroTracker::requestZero() { zeroRequested = true; }
+
+    void ZeroTracker::reset()
+    {
+        started = false;
+        stepping = false;
+    }
+
+    uint32_t ZeroTracker::getDriftCorrections() const { return driftCorrections; }
+
+    uint32_t ZeroTracker::getStepCorrections() const { return stepCorrections; }
+
+    fixed_t ZeroTracker::getTotalCorrection() const { return totalCorrection; }
+
+    void ZeroTracker::restart(uint32_t now, fixed_t weight)
+    {
+        started = true;
+        windowStart = now;
+        minimum = weight;
+        maximum = weight;
+        sum = 0;
+        count = 0;
+    }
+
+    fixed_t ZeroTracker::correct(fixed_t correction, uint32_t& counter)
+    {
+        // the samples of the next window are already corrected
+        started = false;
+        stepping = false;
+        counter++;
+        totalCorrection += correction;
+        return correction;
+    }
+
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdint.h>
+#include "FixedPoint.h"
+
+namespace weightwhiskers
+{
+
+    struct ZeroTrackerConfig {
+        // stable weights within this band are drift and followed slowly
+        fixed_t band = toFixed(50);
+        // largest spread of the samples of a stable window
+        fixed_t stableRange = toFixed(20);
+        // duration of one window, the mean of a stable window is the current zero error
+        uint32_t windowMs = 2000;
+        // drift corrections take 1 / 2^driftShift of the error per window
+        uint8_t driftShift = 2;
+        // but at most this much, a light load within the band must not vanish within minutes
+        fixed_t driftMax = toFixed(0.25f);
+        // smaller errors are ignored
+        fixed_t driftMin = toFixed(0.5f);
+        // stable weights outside the band are taken completely after this time, e.g. new litter
+        uint32_t stepHoldMs = 60000;
+    };
+
+    /**
+     * @brief Keeps the empty scale at zero from the idle sample stream
+     *
+     * Instead of blocking for a tare, the samples of the empty scale are collected in windows.
+     * If a window is stable, its mean is the zero error: within the band a small, capped part of
+     * it is corrected (temperature drift, creep), outside the band it's corrected completely once
+     * the scale stayed at the same weight for stepHoldMs (litter added or removed).
+     *
+     * It only returns the correction, the caller moves the calibration offset. Only feed it
+     * while nobody is on the scale, the replay tool feeds it drifting synthetic samples.
+     */
+    class ZeroTracker
+    {
+    public:
+        void setConfig(const ZeroTrackerConfig& config);
+        const ZeroTrackerConfig& getConfig() const;
+
+        /**
+         * @brief feeds the next sample of the empty scale
+         *
+         * @param now sample timestamp in milliseconds
+         * @param weight unfiltered weight
+         * @return weight to subtract from the zero, 0 if nothing changed
+         */
+        fixed_t update(uint32_t now, fixed_t weight);
+        // the next stable window is corrected completely, e.g. on a button press
+        void requestZero();
+        // starts over, e.g. while a cat is on the scale
+        void reset();
+
+        uint32_t getDriftCorrections() const;
+        uint32_t getStepCorrections() const;
+        // sum of all corrections since boot
+        fixed_t getTotalCorrection() const;
+
+    protected:
+        void restart(uint32_t now, fixed_t weight);
+        fixed_t correct(fixed_t correction, uint32_t& counter);
+
+        ZeroTrackerConfig config;
+        bool started = false;
+        uint32_t windowStart = 0;
+        fixed_t minimum = 0;
+        fixed_t maximum = 0;
+        fixed64_t sum = 0;
+        uint32_t count = 0;
+        // stable windows outside the band at about the same weight
+        bool stepping = false;
+        uint32_t stepStart = 0;
+        fixed_t stepWeight = 0;
+        bool zeroRequested = false;
+        uint32_t driftCorrections = 0;
+        uint32_t stepCorrections = 0;
+        fixed_t totalCorrection = 0;
+    };
+
+}
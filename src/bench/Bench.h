@@ -0,0 +1,108 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <chrono>
+#endif
+
+namespace weightwhiskers
+{
+    namespace bench
+    {
+
+        // prevents the compiler from optimizing benchmarked code away
+        extern volatile int64_t sink;
+        // number of operator new calls, only counted on host
+        extern volatile uint32_t allocations;
+        // number of failed accuracy checks, the host run exits with 1 if there are any
+        extern uint32_t failures;
+
+        inline uint64_t now()
+        {
+#ifdef ARDUINO
+            // cpu cycles on target
+            return ESP.getCycleCount();
+#else
+            // nanoseconds on host
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch())
+                .count();
+#endif
+        }
+
+        // seconds per unit of now()
+        inline double secondsPerTick()
+        {
+#ifdef ARDUINO
+            return 1e-6 / ESP.getCpuFreqMHz();
+#else
+            return 1e-9;
+#endif
+        }
+
+        inline int32_t freeHeap()
+        {
+#ifdef ARDUINO
+            return ESP.getFreeHeap();
+#else
+            return 0;
+#endif
+        }
+
+        /**
+         * @brief prints an error against its limit as JSON line, counts it as failure above
+         */
+        inline bool check(const char* name, double value, double limit)
+        {
+            bool passed = value <= limit;
+            printf("{\"name\": \"%s\", \"value\": %.4f, \"limit\": %.4f, \"passed\": %s}\n",
+                name, value, limit, passed ? "true" : "false");
+            failures += !passed;
+            return passed;
+        }
+
+        /**
+         * @brief runs f(i) iterations times and prints the cost per call as JSON line
+         *
+         * Also prints the allocations per call (host) or how much heap the calls kept
+         * (target), both should be 0 for the per sample paths.
+         *
+         * @return cost per call in cycles (target) or nanoseconds (host)
+         */
+        template <typename F> double run(const char* name, uint32_t iterations, F f)
+        {
+            // warm up caches
+            for (uint32_t i = 0; i < iterations / 10; i++) {
+                f(i);
+            }
+            int32_t heap = freeHeap();
+            uint32_t allocated = allocations;
+            uint64_t start = now();
+            for (uint32_t i = 0; i < iterations; i++) {
+                f(i);
+            }
+            uint64_t elapsed = now() - start;
+#ifdef ARDUINO
+            // the cycle counter has 32 bit and wraps
+            elapsed = (uint32_t)elapsed;
+#endif
+            allocated = allocations - allocated;
+#ifdef ARDUINO
+            printf("{\"name\": \"%s\", \"iterations\": %u, \"cycles_per_op\": %.1f, "
+                   "\"heap_delta\": %d}\n",
+                name, iterations, (double)elapsed / iterations, heap - freeHeap());
+#else
+            printf("{\"name\": \"%s\", \"iterations\": %u, \"ns_per_op\": %.1f, "
+                   "\"allocs_per_op\": %.2f}\n",
+                name, iterations, (double)elapsed / iterations, (double)allocated / iterations);
+            (void)heap;
+#endif
+            return (double)elapsed / iterations;
+        }
+
+    }
+}
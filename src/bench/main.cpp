@@ -0,0 +1,356 @@
+/**
+ * Micro benchmarks for the firmware hot paths
+ *
+ * Target (cycles per op, printed over serial):
+ *   pio run -e esp32s2_bench -t upload -t monitor
+ * Host (nanoseconds and allocations per op):
+ *   pio run -e native_bench -t exec
+ */
+#include <math.h>
+#include <new>
+#include <stdlib.h>
+#include "Bench.h"
+#include "FixedPoint.h"
+#include "LiveFrame.h"
+#include "SlidingWindowStatistics.h"
+#include "MeasurementRecord.h"
+#include "ScalePipeline.h"
+#ifdef ARDUINO
+#include <Wire.h>
+#include "Display.h"
+#endif
+
+#define BENCH_SAMPLES 1024
+#define BENCH_ITERATIONS 20000
+// HX711 at 10 SPS
+#define BENCH_SAMPLE_PERIOD_MS 100
+// accepted deviation of the fixed point path from the float path
+#define BENCH_MAX_ERROR_G 0.1
+// accepted deviation of the sliding window variance from a brute force computation
+#define BENCH_MAX_VARIANCE_ERROR_G2 0.01
+// rows of the CSV import benchmark, small enough for the RAM of the target
+#define BENCH_CSV_ROWS 1000
+// TCP segment size, the web server delivers uploads in chunks of about this size
+#define BENCH_CSV_CHUNK 1436
+// display I2C pins, same as main.cpp
+#define BENCH_SDA 42
+#define BENCH_SCL 41
+// weight screens per display benchmark, each one takes tens of milliseconds
+#define BENCH_DISPLAY_FRAMES 50
+
+using namespace weightwhiskers;
+
+volatile int64_t bench::sink = 0;
+volatile uint32_t bench::allocations = 0;
+uint32_t bench::failures = 0;
+
+#ifndef ARDUINO
+void* operator new(size_t size)
+{
+    bench::allocations++;
+    void* p = malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+#endif
+
+namespace
+{
+
+    int32_t rawSamples[BENCH_SAMPLES];
+
+    // synthetic visit: empty scale, ~4.5kg cat with noise, empty scale
+    void createSamples()
+    {
+        uint32_t seed = 1;
+        for (int i = 0; i < BENCH_SAMPLES; i++) {
+            seed = seed * 1664525 + 1013904223;
+            int32_t noise = (int32_t)(seed >> 22) - 512;
+            int32_t weight = (i > BENCH_SAMPLES / 4 && i < 3 * BENCH_SAMPLES / 4) ? 4500 : 0;
+            rawSamples[i] = 123456 + weight * 230 + noise * 8;
+        }
+    }
+
+    /**
+     * @brief float one pole low pass with the math of FilterOnePole(LOWPASS)
+     */
+    struct FloatLowPass {
+        float tau;
+        float y = 0;
+        uint32_t last = 0;
+
+        FloatLowPass(float frequency)
+            : tau(1.f / (2.f * M_PI * frequency))
+        {
+        }
+
+        float input(float x, uint32_t now)
+        {
+            float a = expf(-(float)(now - last) / 1000.f / tau);
+            y = (1.f - a) * x + a * y;
+            last = now;
+            return y;
+        }
+    };
+
+    /**
+     * @brief float statistics with the math of RunningStatistics
+     */
+    struct FloatStatistics {
+        FloatLowPass average { 0.2f };
+        FloatLowPass averageSquare { 0.2f };
+
+        void input(float x, uint32_t now)
+        {
+            average.input(x, now);
+            averageSquare.input(x * x, now);
+        }
+
+        float sigma() const { return sqrtf(averageSquare.y - average.y * average.y); }
+    };
+
+    void benchPipeline()
+    {
+        // before: HX711::get_units + FilterOnePole + RunningStatistics in soft-float
+        const long offset = 123456;
+        const float scale = 230.61f;
+        FloatLowPass lowPass(0.5f);
+        FloatStatistics statistics;
+        bench::run("pipeline_float", BENCH_ITERATIONS, [&](uint32_t i) {
+            uint32_t now = i * BENCH_SAMPLE_PERIOD_MS;
+            float weight = (float)(rawSamples[i % BENCH_SAMPLES] - offset) / scale;
+            lowPass.input(weight, now);
+            statistics.input(weight, now);
+            bench::sink += (int64_t)statistics.sigma();
+        });
+
+        // after: ScaleCalibration + FixedLowPass + SlidingWindowStatistics of the session
+        ScaleCalibration calibration;
+        calibration.setOffset(offset);
+        calibration.setScale(scale);
+        FixedLowPass fixedLowPass(0.5f);
+        static SlidingWindowStatistics<64> fixedStatistics;
+        fixedStatistics.setWindowMs(5000);
+        fixedStatistics.reset();
+        bench::run("pipeline_fixed", BENCH_ITERATIONS, [&](uint32_t i) {
+            uint32_t now = i * BENCH_SAMPLE_PERIOD_MS;
+            fixed_t weight = calibration.toWeight(rawSamples[i % BENCH_SAMPLES]);
+            fixedLowPass.input(weight, now);
+            fixedStatistics.input(weight, now);
+            bench::sink += fixedStatistics.variance();
+        });
+
+        // accuracy of the fixed point path against the float path
+        FloatLowPass checkLowPass(0.5f);
+        FixedLowPass checkFixedLowPass(0.5f);
+        checkFixedLowPass.setToNewValue(0, 0);
+        float maxError = 0.f;
+        for (uint32_t i = 0; i < BENCH_SAMPLES; i++) {
+            uint32_t now = (i + 1) * BENCH_SAMPLE_PERIOD_MS;
+            float expected
+                = checkLowPass.input((float)(rawSamples[i] - offset) / scale, now);
+            float actual
+                = toFloat(checkFixedLowPass.input(calibration.toWeight(rawSamples[i]), now));
+            maxError = fmaxf(maxError, fabsf(expected - actual));
+        }
+        bench::check("pipeline_fixed_max_error_g", maxError, BENCH_MAX_ERROR_G);
+    }
+
+    void benchSlidingWindow()
+    {
+        ScaleCalibration calibration;
+        calibration.setOffset(123456);
+        calibration.setScale(230.61f);
+
+        // 5s window at 10 SPS
+        static SlidingWindowStatistics<64> statistics;
+        statistics.setWindowMs(5000);
+        statistics.reset();
+        bench::run("sliding_window_input", BENCH_ITERATIONS, [&](uint32_t i) {
+            statistics.input(
+                calibration.toWeight(rawSamples[i % BENCH_SAMPLES]), i * BENCH_SAMPLE_PERIOD_MS);
+            bench::sink += statistics.variance();
+        });
+
+        // compare mean/variance with a brute force computation over the same window
+        statistics.reset();
+        double maxMeanError = 0;
+        double maxVarianceError = 0;
+        for (uint32_t i = 0; i < BENCH_SAMPLES; i++) {
+            statistics.input(calibration.toWeight(rawSamples[i]), i * BENCH_SAMPLE_PERIOD_MS);
+            uint32_t n = statistics.count();
+            double mean = 0;
+            for (uint32_t j = i + 1 - n; j <= i; j++) {
+                mean += calibration.toWeight(rawSamples[j]) / (double)FIXED_ONE;
+            }
+            mean /= n;
+            double variance = 0;
+            for (uint32_t j = i + 1 - n; j <= i; j++) {
+                double d = calibration.toWeight(rawSamples[j]) / (double)FIXED_ONE - mean;
+                variance += d * d;
+            }
+            variance /= n;
+            maxMeanError
+                = fmax(maxMeanError, fabs(mean - statistics.mean() / (double)FIXED_ONE));
+            maxVarianceError = fmax(
+                maxVarianceError, fabs(variance - statistics.variance() / (double)FIXED_ONE));
+        }
+        bench::check("sliding_window_max_mean_error_g", maxMeanError, BENCH_MAX_ERROR_G);
+        bench::check(
+            "sliding_window_max_variance_error_g2", maxVarianceError, BENCH_MAX_VARIANCE_ERROR_G2);
+    }
+
+    void benchCsvImport()
+    {
+        // one visit every ~75 minutes
+        static char csv[BENCH_CSV_ROWS * 40];
+        size_t length = snprintf(csv, sizeof(csv), "%s\n", MEASUREMENT_CSV_HEADER);
+        MeasurementRecord record;
+        for (uint32_t i = 0; i < BENCH_CSV_ROWS; i++) {
+            record.time = 1600000000 + i * 4500;
+            record.weight = 4000 + rawSamples[i % BENCH_SAMPLES] % 1000;
+            record.std = 12.34f;
+            record.duration = 61.5f;
+            record.weightDropping = i % 4 ? 0 : 42;
+            length += record.toCsv(csv + length, sizeof(csv) - length);
+        }
+
+        // parse in upload sized chunks, rows are split at chunk boundaries
+        MeasurementCsvParser parser;
+        double perImport = bench::run("csv_import_1000_rows", 50, [&](uint32_t) {
+            parser.reset();
+            for (size_t offset = 0; offset < length; offset += BENCH_CSV_CHUNK) {
+                size_t chunk
+                    = length - offset < BENCH_CSV_CHUNK ? length - offset : BENCH_CSV_CHUNK;
+                parser.input(csv + offset, chunk,
+                    [](const MeasurementRecord& record) { bench::sink += record.weight; });
+            }
+            parser.finish([](const MeasurementRecord& record) { bench::sink += record.weight; });
+        });
+        printf("{\"name\": \"csv_import_rows_per_s\", \"value\": %.0f, \"accepted\": %u, "
+               "\"rejected\": %u}\n",
+            BENCH_CSV_ROWS / (perImport * bench::secondsPerTick()), (unsigned)parser.getAccepted(),
+            (unsigned)parser.getRejected());
+    }
+
+    void benchScalePipeline()
+    {
+        // everything that runs per sample: calibration, low pass, presence, live weight and zero
+        ScaleCalibration calibration;
+        calibration.setOffset(123456);
+        calibration.setScale(230.61f);
+        FixedLowPass lowPass(0.5f);
+        PresenceSession session;
+        LiveWeightPublisher liveWeight;
+        ZeroTracker zeroTracker;
+        ScalePipeline pipeline(calibration, lowPass, session, liveWeight, zeroTracker);
+        bench::run("scale_pipeline_process", BENCH_ITERATIONS, [&](uint32_t i) {
+            auto result
+                = pipeline.process(i * BENCH_SAMPLE_PERIOD_MS, rawSamples[i % BENCH_SAMPLES]);
+            bench::sink += result.filtered + (int)result.event;
+        });
+    }
+
+    void benchCsvLine()
+    {
+        MeasurementRecord record;
+        record.time = 1600000000;
+        record.weight = 4321;
+        record.std = 12.34f;
+        record.duration = 61.5f;
+        record.weightDropping = 42;
+        char line[MEASUREMENT_CSV_LINE_LENGTH];
+        bench::run("csv_format_record", BENCH_ITERATIONS, [&](uint32_t i) {
+            record.weight = 4000 + (i & 0x3ff);
+            bench::sink += record.toCsv(line, sizeof(line));
+        });
+        bench::run("csv_parse_line", BENCH_ITERATIONS, [&](uint32_t) {
+            MeasurementRecord parsed;
+            MeasurementRecord::fromCsv(line, parsed);
+            bench::sink += parsed.weight;
+        });
+    }
+
+    void benchLiveFrame()
+    {
+        // a full buffer of a visit in 0.1g, flushed with the active decimation
+        LiveSample samples[LIVE_BUFFER_SIZE];
+        for (uint32_t i = 0; i < LIVE_BUFFER_SIZE; i++) {
+            int32_t weight = (rawSamples[i + BENCH_SAMPLES / 2] - 123456) * 10 / 230;
+            samples[i] = { i * BENCH_SAMPLE_PERIOD_MS, weight, weight + (int32_t)(i % 7) - 3 };
+        }
+        static uint8_t frame[LIVE_FRAME_SIZE];
+        size_t length = 0;
+        bench::run("live_frame_encode", BENCH_ITERATIONS, [&](uint32_t i) {
+            length = encodeLiveFrame(samples, LIVE_BUFFER_SIZE, i, 1, LIVE_FLAG_ACTIVE, i, frame);
+            bench::sink += length;
+        });
+        printf("{\"name\": \"live_frame_bytes\", \"value\": %u, \"samples\": %u}\n",
+            (unsigned)length, LIVE_BUFFER_SIZE);
+    }
+
+#ifdef ARDUINO
+    void benchDisplay()
+    {
+        // includes the I2C transfer of the frame buffer
+        static Display display(&Wire);
+        Wire.begin(BENCH_SDA, BENCH_SCL);
+        display.begin();
+        // before: the whole frame buffer per update, after: only the changed columns
+        for (bool difference : { false, true }) {
+            display.setSendDifference(difference);
+            uint32_t bytes = display.getBytesSent();
+            double ticks = bench::run(difference ? "display_weight_screen_diff"
+                                                 : "display_weight_screen_full",
+                BENCH_DISPLAY_FRAMES,
+                [&](uint32_t i) { display.drawWeightScreen(4000 + i, 4321, i % 100); });
+            // bench::run adds a tenth for warming up
+            double bytesPerFrame = (display.getBytesSent() - bytes)
+                / (BENCH_DISPLAY_FRAMES + BENCH_DISPLAY_FRAMES / 10.);
+            printf("{\"name\": \"display_i2c_bytes_per_s_%s\", \"value\": %.0f, "
+                   "\"bytes_per_frame\": %.0f, \"render_ms\": %.2f}\n",
+                // at the fastest rate of the display task
+                difference ? "diff" : "full", bytesPerFrame * 1000 / DISPLAY_MIN_INTERVAL_MS,
+                bytesPerFrame, ticks * bench::secondsPerTick() * 1000);
+        }
+    }
+#endif
+
+    void runAll()
+    {
+        createSamples();
+        benchPipeline();
+        benchSlidingWindow();
+        benchScalePipeline();
+        benchCsvLine();
+        benchLiveFrame();
+        benchCsvImport();
+#ifdef ARDUINO
+        benchDisplay();
+#endif
+    }
+
+}
+
+#ifdef ARDUINO
+void setup()
+{
+    Serial.begin(115200);
+    delay(2000);
+    runAll();
+    printf("{\"name\": \"checks\", \"failed\": %u}\n", (unsigned)bench::failures);
+}
+
+void loop() { delay(1000); }
+#else
+int main()
+{
+    runAll();
+    return bench::failures ? 1 : 0;
+}
+#endif
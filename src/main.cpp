@@ -10,18 +10,35 @@
 #include <ESPAsyncWebServer.h>
 #include <ESPAsyncWiFiManager.h>
 #include <ESPmDNS.h>
-#include <PubSubClient.h>
 #include <FastLED.h>
-#include <Filters.h>
 #include <ArduinoOTA.h>
 #include <AsyncJson.h>
 #include <ArduinoJson.h>
 #include <melody_player.h>
 #include <melody_factory.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
 #include "Display.h"
+#include "ScaleReader.h"
+#include "Config.h"
+#include "ConfigStore.h"
+#include "FixedPoint.h"
+#include "PresenceSession.h"
+#include "ScalePipeline.h"
+#include "MeasurementLog.h"
+#include "MeasurementSummary.h"
+#include "MeasurementStats.h"
+#include "LiveStream.h"
+#include "LiveWeightPublisher.h"
+#include "Metrics.h"
+#include "MqttOutbox.h"
+#include "MqttPublisher.h"
+#include "SessionRecorder.h"
+#include "SystemStatus.h"
+#include "ZeroTracker.h"
 
-// Debug
-#define SAVE_RAW_VAL 0
 // Button
 #define ENCODER_BTN 9
 #define ENCODER_A 7
@@ -43,8 +60,8 @@
 // constants
 #define SCALE_DELAY_MS 100
 #define SCALE_WS_DELAY_MS 500
+#define SCALE_LOOP_TIMEOUT_MS 10
 #define BUFSIZE 55
-#define JSON_BUFFER 2048
 
 #define TAG "WeightWhiskers"
 
@@ -64,85 +81,144 @@ MelodyPlayer buzzer(BUZZER, 0, LOW);
 
 // scale
 HX711 scale;
+ScaleReader scaleReader(scale, LOADCELL_DOUT_PIN, LOADCELL_SCK_PIN);
+ScaleSampleBuffer::Reader scaleSamples;
 long scaleLastTimestamp = 0;
 long scaleLastWSTimestamp = 0;
-long scaleLastTareThreshTimestamp = 0;
-FilterOnePole weightLowPass = FilterOnePole(LOWPASS, 0.5, 0);
+ScaleCalibration calibration;
+FixedLowPass weightLowPass(0.5);
+PresenceSession session;
+LiveWeightPublisher liveWeight;
+ZeroTracker zeroTracker;
+ScalePipeline scalePipeline(calibration, weightLowPass, session, liveWeight, zeroTracker);
 // DEBUG
 time_t startTime = 0;
-
-struct CatMeasurement {
-    // UNIX timetamp in seconds
-    time_t time = 0;
-    // weight in gram
-    uint16_t weight = 0.;
-    // standard deviation
-    float std = 0.;
-    // duration in seconds
-    float duration = 0.;
-    // weight of poo/urine "dropping"
-    uint16_t weightDropping = 0;
+// time(nullptr) is valid once it's after this (2021-01-01), i.e. after the NTP sync
+#define TIME_VALID_MIN 1609459200
+// measurements are kept in RAM until the time is known, then back-dated and stored
+#define MEASUREMENTS_UNSYNCED_MAX 64
+struct UnsyncedMeasurement {
+    CatMeasurement measurement;
+    uint32_t millis;
 };
+std::vector<UnsyncedMeasurement> unsyncedMeasurements;
+// size of unsyncedMeasurements for the web handlers, the vector is only touched by the loop
+std::atomic<uint32_t> unsyncedCount { 0 };
+#if SESSION_RECORDER
+SessionRecorder sessionRecorder;
+#endif
+
 CatMeasurement lastMeasurement;
 
+// Boot, milliseconds since power on at the end of each phase, 0 if not reached yet
+enum BootPhase {
+    BOOT_DISPLAY,
+    BOOT_FILESYSTEM,
+    BOOT_CONFIG,
+    BOOT_SCALE,
+    BOOT_LOG,
+    BOOT_SETUP,
+    BOOT_FIRST_SAMPLE,
+    BOOT_WIFI,
+    BOOT_NETWORK,
+    BOOT_TIME,
+    BOOT_PHASES
+};
+const char* bootPhaseNames[BOOT_PHASES] = { "display", "filesystem", "config", "scale", "log",
+    "setup", "first_sample", "wifi", "network", "time" };
+volatile uint32_t bootPhaseMs[BOOT_PHASES] = {};
+// web server, OTA and NTP are running
+std::atomic<bool> networkReady { false };
+
 // fs::LittleFSFS fsWWW;
 // fs::LittleFSFS fsConfig;
 #define fsWWW LittleFS
 #define fsConfig LittleFS
-String measurementsFile = "/measurements.csv";
+MeasurementLog measurementLog(fsConfig, "/measurements.bin");
+MeasurementSummary measurementSummary(fsConfig, "/measurements.summary");
+// set when the log was replaced or measurements deleted, the summary is rebuilt before use
+volatile bool measurementSummaryStale = false;
+MeasurementStats measurementStats(fsConfig, "/measurements.stats");
+// set when the daily aggregates need a rebuild in the maintenance task
+volatile bool measurementStatsStale = false;
+// compact the log if more than this fraction of records is deleted
+#define MEASUREMENTS_COMPACT_RATIO 0.25f
+TaskHandle_t pTaskMaintenance;
+// JSON config of older versions, only imported if NVS doesn't contain a config yet
 String configFile = "/config.json";
+// WiFi, heap and filesystem usage for the display and the web interface
+SystemStatus systemStatus(fsConfig, measurementLog);
 
 // Config
-struct Config {
-    // MQTT
-    bool mqtt_enabled = false;
-    String mqtt_server = "";
-    int mqtt_port = 1883;
-    String mqtt_user = "kitty";
-    String mqtt_pass = "kitty";
-    String mqtt_topic_cat_weight = "home/cat/scale/measured";
-    String mqtt_topic_current_weight = "home/cat/scale/current";
-    // scale
-    float scale_calib_value = 1.f;
-    int scale_calib_weight = 500; // gram
-    int scale_weight_min = 2000; // gram
-    // scale tare triggers
-    int scale_tare_time = 60000; // millis
-    int scale_tare_thresh = 50; // gram
-    // presence detection
-    float presence_time_min = 5.f;
-    // weight deviation filter (0.0 = disabled, 0.2 = ±20%)
-    float scale_weight_deviation_percent = 0.f;
-};
-
+ConfigStore configStore;
 Config config;
-
-// Weight history for deviation filter (circular buffer for last 5 measurements)
-#define WEIGHT_HISTORY_SIZE 5
-uint16_t weightHistory[WEIGHT_HISTORY_SIZE] = {0};
-int weightHistoryCount = 0; // how many valid measurements we have (0-5)
-int weightHistoryIndex = 0; // current write position in circular buffer
+// subsystems that need to be set up again after a config change
+#define CONFIG_CHANGE_MQTT 0x01
+#define CONFIG_CHANGE_SCALE 0x02
+#define CONFIG_CHANGE_PRESENCE 0x04
+// scale and presence changes are applied by the loop once no session is active
+std::atomic<uint8_t> configPending { 0 };
+// result of a config update for the response
+struct ConfigUpdate {
+    uint8_t changes;
+    // a session was active, scale and presence changes are applied after it
+    bool deferred;
+    // invalid key or other error, nothing was changed
+    const char* error;
+};
 
 // MQTT
-TaskHandle_t pTaskMQTT;
-QueueHandle_t qMQTT = xQueueCreate(5, sizeof(CatMeasurement));
-SemaphoreHandle_t semMQTT;
+MqttOutbox mqttOutbox(fsConfig, "/mqtt_outbox.bin");
+MqttPublisher mqttPublisher(mqttOutbox);
 
 // WiFi
-WiFiClient espClient;
-PubSubClient mqtt(espClient);
 DNSServer dns;
 AsyncWebServer server(80);
 AsyncWiFiManager wifiManager(&server, &dns);
 AsyncWebSocket ws("/ws");
+LiveStream liveStream(ws);
+
+// metrics, exported on /api/metrics
+metrics::Histogram metricLoopDuration(
+    "loop_iteration_seconds", "Time per loop() pass including the sample wait");
+metrics::Histogram metricSampleDuration("sample_process_seconds", "Processing time per sample");
+metrics::Counter metricDisplayBytes("display_i2c_bytes_total", "I2C bytes sent to the display");
+metrics::Counter metricDisplaySkipped("display_skipped_frames_total", "Unchanged display frames");
+metrics::Histogram metricTareDuration("tare_seconds", "Time spent in tare()");
+metrics::Counter metricZeroDrift("zero_drift_corrections_total", "Zero drift corrections");
+metrics::Counter metricZeroSteps("zero_step_corrections_total", "Zero step corrections");
+metrics::Gauge metricZeroCorrection("zero_correction_centigrams", "Sum of all zero corrections");
+metrics::Histogram metricWriteDuration(
+    "measurement_write_seconds", "LittleFS write time of a measurement");
+metrics::Counter metricUnsyncedDropped(
+    "measurements_dropped_unsynced_total", "Measurements dropped while waiting for the time");
+metrics::Counter metricSamples("scale_samples_total", "HX711 samples");
+metrics::Counter metricDropped("scale_dropped_total", "HX711 samples missed by the reader task");
+metrics::Counter metricTimeouts("scale_timeouts_total", "HX711 wait ready timeouts");
+metrics::Counter metricOverruns("scale_overruns_total", "Samples overwritten before processing");
+metrics::Gauge metricWsClients("ws_clients", "Connected websocket clients");
+metrics::Gauge metricWsQueue("ws_queue_max", "Longest websocket send queue");
+metrics::Counter metricWsSkipped("ws_skipped_frames_total", "Frames skipped for slow clients");
+metrics::Gauge metricMqttConnected("mqtt_connected", "MQTT connection state");
+metrics::Gauge metricMqttPending("mqtt_pending", "Measurements waiting in the MQTT outbox");
+metrics::Counter metricMqttConnectFailures("mqtt_connect_failures_total", "Failed MQTT connects");
+metrics::Counter metricMqttPublishFailures("mqtt_publish_failures_total", "Failed MQTT publishes");
+metrics::Counter metricMqttConfirmTimeouts(
+    "mqtt_confirm_timeouts_total", "MQTT batches without confirmation echo");
+metrics::Gauge metricHeapFree("heap_free_bytes", "Free heap");
+metrics::Gauge metricHeapMin("heap_min_free_bytes", "Lowest free heap since boot");
 
 // declarations
 bool loadConfig();
 bool saveConfig();
 void printConfig();
-void applyConfig();
+uint8_t diffConfig(const Config& previous, const Config& current);
+void applyConfig(uint8_t changes);
 void listDir(fs::FS& fs, const char* dirname, uint8_t levels);
 void setupScale();
+void setupPresence();
+void processSample(const Sample& sample);
+int32_t readAverage(int count);
 void tare(int count);
 void calibrate(long weight);
 void apCallback(AsyncWiFiManager* mgr);
@@ -150,23 +226,34 @@ void WiFiEvent(WiFiEvent_t event);
 void handleConfig(AsyncWebServerRequest* request);
 void handleConfigUpdate(
     AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total);
+void storeConfigUpdate(AsyncWebServerRequest* request, const ConfigUpdate& update);
+void handleConfigSchema(AsyncWebServerRequest* request);
 void handeMeasurementsUpload(AsyncWebServerRequest* request, String filename, size_t index,
     uint8_t* data, size_t len, bool final);
 void handleMeasurements(AsyncWebServerRequest* request);
+void handleMeasurementsExport(AsyncWebServerRequest* request);
+void handleStats(AsyncWebServerRequest* request);
+void handleRaw(AsyncWebServerRequest* request);
+void handleRawUpdate(AsyncWebServerRequest* request);
 void handleSystem(AsyncWebServerRequest* request);
+void handleMetrics(AsyncWebServerRequest* request);
+#if MQTT_TEST_ENDPOINT
+void handleMqttTest(AsyncWebServerRequest* request);
+#endif
 void onEvent(AsyncWebSocket* server, AsyncWebSocketClient* client, AwsEventType type, void* arg,
     uint8_t* data, size_t len);
 void setupMQTT();
-void sendMQTTCatWeights(const CatMeasurement& measurement);
-void createMeasurementsFile();
-void initWeightHistory();
-void addToWeightHistory(uint16_t weight);
-float calculateAverageWeight();
+void taskNetwork(void* parameter);
+void taskMaintenance(void* parameter);
+void bootPhaseDone(BootPhase phase);
+bool isTimeValid();
+void storeMeasurement(CatMeasurement& measurement);
+void storeUnsyncedMeasurements();
+void initMeasurementSummary();
 bool isMeasurementValid(uint16_t weight, float deviationPercent);
 bool writeMeasurement(CatMeasurement& m);
 void playToneStart();
 void playToneSuccess();
-void taskMQTT(void* parameter);
 
 void IRAM_ATTR readEncoderISR() { encoder.readEncoder_ISR(); }
 
@@ -188,9 +275,9 @@ void setup()
     encoder.setup(readEncoderISR);
     encoder.disableAcceleration();
 
-    // display
+    // display, rendered in its own task
     Wire.begin(SDA, SCL);
-    display.begin();
+    display.begin(4096);
     display.drawBootScreen();
 
     // LED
@@ -201,6 +288,7 @@ void setup()
 
     // start sound
     playToneStart();
+    bootPhaseDone(BOOT_DISPLAY);
 
     // config filesystem and config
     if (!fsConfig.begin(true, "/littlefs", 10, "spiffs")) {
@@ -215,32 +303,75 @@ void setup()
             delay(500);
         }
     }
+    bootPhaseDone(BOOT_FILESYSTEM);
 
-    // load config or create config file with default values if not existing
-    listDir(fsConfig, "/", 4);
+    // load config or store the default values if not existing
+    configStore.begin();
     if (!loadConfig()) {
-        ESP_LOGI(TAG, "Cannot load config, saving default config file");
+        ESP_LOGI(TAG, "Cannot load config, saving default config");
         saveConfig();
     }
     printConfig();
+    bootPhaseDone(BOOT_CONFIG);
 
-    // create measurements file if not existing
-    createMeasurementsFile();
-    
-    // initialize weight history from existing measurements
-    initWeightHistory();
+    // setup scale first, a cat can be weighed before the network is up
+    setupScale();
+    setupPresence();
+    bootPhaseDone(BOOT_SCALE);
+
+    // create measurements log if not existing, imports the old CSV file once
+    if (!measurementLog.begin("/measurements.csv")) {
+        display.drawError("Log Error");
+    }
+    // initialize weight history and last measurement from the summary
+    initMeasurementSummary();
+    // aggregates are rebuilt in the background if missing
+    if (!measurementStats.begin()) {
+        measurementStatsStale = true;
+    }
+    bootPhaseDone(BOOT_LOG);
+
+    // refresh the system status in the background from now on
+    systemStatus.begin(4096);
 
-    listDir(fsConfig, "/", 4);
+    // remove deleted measurements and rebuild aggregates in the background, check after boot
+    xTaskCreate(taskMaintenance, "taskMaintenance", 4096, NULL, 1, &pTaskMaintenance);
+    xTaskNotifyGive(pTaskMaintenance);
 
+    // setup MQTT, measurements that weren't sent before the reboot are still in the outbox,
+    // the task waits for WiFi
+    mqttOutbox.begin();
+    mqttPublisher.begin(getArduinoLoopTaskStackSize());
+    setupMQTT();
+
+    // WiFi, web server, NTP and OTA come up in the background while measuring, the loop
+    // already feeds the live stream
+    liveStream.begin();
+    xTaskCreate(taskNetwork, "taskNetwork", getArduinoLoopTaskStackSize(), NULL, 1, NULL);
+
+    // success!
+    leds[0] = CRGB::Green;
+    FastLED.show();
+    bootPhaseDone(BOOT_SETUP);
+    ESP_LOGI(TAG, "Setup finished!");
+}
+
+/**
+ * @brief connects WiFi, or opens the config portal, and starts the network services
+ *
+ * Runs once in its own task, autoConnect() blocks until WiFi is configured.
+ */
+void taskNetwork(void* parameter)
+{
     // Setup WiFi
     ESP_LOGI(TAG, "WiFi autoconnect...");
-    display.drawWiFi();
     WiFi.setAutoReconnect(true);
     WiFi.onEvent(WiFiEvent);
     wifiManager.setAPCallback(apCallback);
     if (!wifiManager.autoConnect("weight-whiskers")) {
         Serial.println("failed to connect, we should reset as see if it connects");
     }
+    bootPhaseDone(BOOT_WIFI);
 
     // setup mDNS
     MDNS.begin("weight-whiskers");
@@ -248,19 +379,6 @@ void setup()
 
     // Set up required URL handlers on the web server.
     // static files, cached for 1 month
-    // if (!fsWWW.begin(true, "/www", 10, "www")) {
-    //     Serial.println("An Error has occurred while mounting www");
-    //     display.drawError("FS Error");
-    //     while (true) {
-    //         leds[0] = CRGB::Yellow;
-    //         FastLED.show();
-    //         delay(500);
-    //         leds[0] = CRGB::Black;
-    //         FastLED.show();
-    //         delay(500);
-    //     }
-    // }
-    listDir(fsWWW, "/", 4);
     server.serveStatic("/", fsWWW, "/www/")
         .setDefaultFile("index.html")
         .setCacheControl("max-age=2678400");
@@ -270,31 +388,27 @@ void setup()
     server.serveStatic("/live", fsWWW, "/www/index.html")
         .setDefaultFile("index.html")
         .setCacheControl("max-age=2678400");
+    server.on("/api/config/schema", HTTP_GET, handleConfigSchema);
+    server.on("/api/config", HTTP_GET, handleConfig);
     server.on("/api/config", HTTP_POST, handleConfig, nullptr, handleConfigUpdate);
+    server.on("/api/measurements", HTTP_GET, handleMeasurementsExport);
     server.on("/api/measurements", HTTP_POST, handleMeasurements, handeMeasurementsUpload);
-    server.on("/api/raw", HTTP_GET, [](AsyncWebServerRequest* request) {
-        request->send(fsConfig, "/rawvalues.csv", "text/csv");
-    });
+    server.on("/api/raw", HTTP_GET, handleRaw);
+    server.on("/api/raw", HTTP_POST, handleRawUpdate);
+    server.on("/api/stats", HTTP_GET, handleStats);
     server.on("/api/system", HTTP_GET, handleSystem);
+    server.on("/api/metrics", HTTP_GET, handleMetrics);
+#if MQTT_TEST_ENDPOINT
+    server.on("/api/mqtt/test", HTTP_POST, handleMqttTest);
+#endif
     server.on("/api/reboot", HTTP_GET, [](AsyncWebServerRequest* request) { ESP.restart(); });
     // attach AsyncWebSocket
     ws.onEvent(onEvent);
     server.addHandler(&ws);
     server.begin();
 
-    // setup time
-    display.drawText("NTP...");
+    // setup time, measurements are back-dated by the loop once it's synchronized
     configTime(0, 0, "pool.ntp.org");
-    time(&startTime);
-
-    // setup MQTT
-    semMQTT = xSemaphoreCreateBinary();
-    xSemaphoreGive(semMQTT);
-    setupMQTT();
-    xTaskCreate(taskMQTT, "taskMQTT", getArduinoLoopTaskStackSize(), NULL, 1, &pTaskMQTT);
-
-    // setup scale
-    setupScale();
 
     // setup OTA
     ArduinoOTA.setHostname("weight-whiskers");
@@ -309,8 +423,9 @@ void setup()
         display.drawOTA(1.);
     });
     ArduinoOTA.onProgress([](unsigned int progress, unsigned int total) {
+        // called for every received chunk, drawing doesn't wait for the display
         float percentage = (1. / total) * progress;
-        ESP_LOGI(TAG, "Update:%u%%\r", percentage * 100);
+        ESP_LOGD(TAG, "Update:%u%%", (unsigned)(percentage * 100));
         display.drawOTA(percentage);
     });
     ArduinoOTA.onError([](ota_error_t error) {
@@ -329,156 +444,210 @@ void setup()
     });
     ArduinoOTA.begin();
 
-    // success!
-    leds[0] = CRGB::Green;
-    FastLED.show();
-    ESP_LOGI(TAG, "Setup finished!");
+    networkReady = true;
+    bootPhaseDone(BOOT_NETWORK);
+    vTaskDelete(NULL);
 }
 
 void loop()
 {
+    metrics::Timer timer(metricLoopDuration);
+
     // clear ws clients
     ws.cleanupClients();
 
     // over the air update
-    ArduinoOTA.handle();
+    if (networkReady) {
+        ArduinoOTA.handle();
+    }
 
-    // button handling
-    if (encoder.isEncoderButtonClicked()) {
-        tare(10);
-    } else {
-        auto beforeDown = millis();
-        while (encoder.isEncoderButtonDown()) {
-            auto now = millis();
-            if ((now - beforeDown) > 1000) {
-                calibrate(config.scale_calib_weight);
+    // back-date measurements that were taken before the NTP sync
+    if (!bootPhaseMs[BOOT_TIME] && isTimeValid()) {
+        bootPhaseDone(BOOT_TIME);
+        startTime = time(nullptr) - millis() / 1000;
+        storeUnsyncedMeasurements();
+    }
+
+    // button handling, calibration would corrupt a running session
+    if (!session.isActive()) {
+        if (configPending) {
+            applyConfig(configPending.exchange(0));
+        }
+        if (encoder.isEncoderButtonClicked()) {
+            // zeroed by the pipeline once the scale is stable
+            zeroTracker.requestZero();
+        } else {
+            auto beforeDown = millis();
+            while (encoder.isEncoderButtonDown()) {
+                auto now = millis();
+                if ((now - beforeDown) > 1000) {
+                    calibrate(config.scale_calib_weight);
+                }
             }
         }
     }
 
-    // measure weight
-    auto current = millis();
-    if (scale.wait_ready_timeout(1000)) {
-        auto weight = scale.get_units(2);
-        auto raw = scale.get_value();
-        weightLowPass.input(weight);
-        // weightLowPass.print();
-        ESP_LOGV(TAG, "Current measurement=%fg raw=%f lowPass=%f Y=%f up since=%d\n", weight, raw,
-            weightLowPass.output(), weightLowPass.Y, startTime);
-        if (current - scaleLastWSTimestamp > SCALE_WS_DELAY_MS) {
-            ws.printfAll("{\"timestamp\": %lu, \"weight\": %f, \"weight_unfiltered\": %f}", current,
-                weightLowPass.output(), weight);
-            scaleLastWSTimestamp = current;
-        }
-    } else {
-        ESP_LOGE(TAG, "HX711 not found.");
+    // measure weight, process every new sample but never wait longer than one loop period
+    Sample sample;
+    if (!scaleReader.waitForSample(scaleSamples, sample, SCALE_LOOP_TIMEOUT_MS)) {
         return;
     }
+    do {
+        processSample(sample);
+    } while (scaleSamples.read(sample));
 
+    auto current = millis();
     if (current - scaleLastTimestamp > SCALE_DELAY_MS) {
-        if (weightLowPass.output() > config.scale_weight_min) {
-// debug: write values to file
-#ifdef SAVE_RAW_VAL
-            File rawValues = fsConfig.open("/rawvalues.csv", FILE_WRITE);
-            rawValues.println("time,raw,mean,std");
-#endif
-            // cat sits on the throne
-            leds[0] = CRGB::Yellow;
-            FastLED.show();
-            // prepare duration and temp value
-            auto presenceStart = current;
-            long duration = 0;
-            float bestWeightStd = infinityf();
-            float bestWeight = 0;
-            // prepare filter
-            auto statistics = RunningStatistics();
-            statistics.setWindowSecs(config.presence_time_min);
-            statistics.setInitialValue(weightLowPass.output());
-            // run measurement
-            while (weightLowPass.output() > config.scale_weight_min) {
-                auto value = scale.get_units(2);
-                duration = (millis() - presenceStart) / 1000.;
-                weightLowPass.input(value);
-                statistics.input(value);
-#ifdef SAVE_RAW_VAL
-                rawValues.printf("%lu,%.2f,%.2f,%.2f\n", millis() - presenceStart, value,
-                    statistics.mean(), statistics.sigma());
-#endif
-                display.drawWeightScreen(weightLowPass.output(), lastMeasurement.weight, (100./config.presence_time_min)*duration);
-                // use value with lowes std dev when minimum presence time is reached
-                if (duration > config.presence_time_min && statistics.sigma() < bestWeightStd) {
-                    bestWeightStd = statistics.sigma();
-                    bestWeight = statistics.mean();
-                }
-                delay(10);
-            }
-#ifdef SAVE_RAW_VAL
-            rawValues.close();
-#endif
-            // cat left the throne, save measurement if minimum presence time was reached
-            if (duration > config.presence_time_min) {
-                ESP_LOGI(TAG, "Got new meowsurement!");
-                // show success
-                leds[0] = CRGB::Green;
-                FastLED.show();
-                display.drawWeightScreen(bestWeight, lastMeasurement.weight);
-                playToneSuccess();
-                // wait for settlement to measure droppings and write measurement
-                delay(5000);
-                CatMeasurement measurement;
-                time(&measurement.time); // Get current timestamp
-                measurement.weight = bestWeight;
-                measurement.std = bestWeightStd;
-                measurement.duration = duration;
-                measurement.weightDropping = max(0, (int)scale.get_units(10));
-                // write data to file
-                writeMeasurement(measurement);
-                // send data to MQTT
-                if (config.mqtt_enabled) {
-                    ESP_LOGI(TAG, "MQTT enabled, sending message to queue");
-                    xQueueSend(qMQTT, &lastMeasurement, 0);
-                } else {
-                    ESP_LOGI(TAG, "MQTT not enabled");
-                }
-                // save last measurement
-                lastMeasurement = measurement;
-            }
-            delay(1000);
-            tare(10);
+        scaleLastTimestamp = current;
+        display.setWiFiState(systemStatus.get().wifi);
+
+        switch (session.getState()) {
+        case PresenceSession::State::Occupied:
+            display.drawWeightScreen(
+                toGram(weightLowPass.output()), lastMeasurement.weight, session.getProgress());
+            break;
+        case PresenceSession::State::Settling:
+        case PresenceSession::State::Dropping:
+            display.drawWeightScreen(toGram(session.getBestWeight()), lastMeasurement.weight);
+            break;
+        case PresenceSession::State::Retare:
+            display.drawTare();
+            break;
+        case PresenceSession::State::Idle:
+            // write weight to display, the zero tracker keeps it at zero
+            display.drawWeightScreen(toGram(weightLowPass.output()), lastMeasurement.weight);
+            break;
         }
+    }
+}
 
-        // write weight to display
-        display.drawWeightScreen(weightLowPass.output(), lastMeasurement.weight);
+/**
+ * @brief filters a sample, streams it to the websocket and feeds the presence session
+ */
+void processSample(const Sample& sample)
+{
+    metrics::Timer timer(metricSampleDuration);
+    if (!bootPhaseMs[BOOT_FIRST_SAMPLE]) {
+        bootPhaseDone(BOOT_FIRST_SAMPLE);
+    }
+    auto result = scalePipeline.process(sample.timestamp, sample.raw);
+    fixed_t weight = result.weight;
+    fixed_t filtered = result.filtered;
+    ESP_LOGV(TAG, "Current measurement=%dg raw=%d lowPass=%dg up since=%d dropped=%u overruns=%u\n",
+        toGram(weight), sample.raw, toGram(filtered), startTime, scaleReader.getDroppedCount(),
+        scaleSamples.getOverruns());
+    // batch samples and send them as one frame
+    liveStream.add(sample.timestamp, filtered, weight);
+    if (sample.timestamp - scaleLastWSTimestamp > SCALE_WS_DELAY_MS) {
+        liveStream.setActive(session.isActive());
+        liveStream.flush();
+        scaleLastWSTimestamp = sample.timestamp;
+    }
 
-        // tare if necessary
-        if (abs(weightLowPass.output()) < config.scale_tare_thresh) {
-            scaleLastTareThreshTimestamp = 0;
-        } else {
-            if (!scaleLastTareThreshTimestamp || current < scaleLastTareThreshTimestamp) {
-                scaleLastTareThreshTimestamp = current;
-            } else if (current - scaleLastTareThreshTimestamp > config.scale_tare_time) {
-                tare(10);
-            }
-        }
+    // throttled live weight and occupancy for the current weight topic
+    if (result.publishWeight) {
+        mqttPublisher.publishWeight(filtered, result.occupied);
     }
+#if SESSION_RECORDER
+    // debug: keep the unfiltered samples of the last visits in RAM
+    sessionRecorder.add(sample.timestamp, weight);
+#endif
 
-    // reset LED
-    leds[0] = CRGB::Black;
-    FastLED.show();
+    switch (result.event) {
+    case PresenceSession::Event::None:
+        break;
+    case PresenceSession::Event::Entered:
+        // cat sits on the throne
+        ESP_LOGI(TAG, "Cat entered the scale");
+        leds[0] = CRGB::Yellow;
+        FastLED.show();
+#if SESSION_RECORDER
+        sessionRecorder.start(sample.timestamp, time(nullptr));
+        sessionRecorder.add(sample.timestamp, weight);
+#endif
+        break;
+    case PresenceSession::Event::Left:
+        // cat left the throne after minimum presence time, show success
+        ESP_LOGI(TAG, "Got new meowsurement!");
+        leds[0] = CRGB::Green;
+        FastLED.show();
+        playToneSuccess();
+#if SESSION_RECORDER
+        sessionRecorder.stop();
+#endif
+        break;
+    case PresenceSession::Event::Aborted:
+        ESP_LOGI(TAG, "Cat left before minimum presence time");
+        leds[0] = CRGB::Black;
+        FastLED.show();
+#if SESSION_RECORDER
+        sessionRecorder.stop();
+#endif
+        break;
+    case PresenceSession::Event::Measured: {
+        // droppings weighed after settlement, write measurement
+        CatMeasurement measurement = session.getMeasurement();
+        // write data to file and send it to MQTT, once the time is known
+        storeMeasurement(measurement);
+        // save last measurement
+        lastMeasurement = measurement;
+        break;
+    }
+    case PresenceSession::Event::Tared:
+        // the pipeline already applied the new offset
+        leds[0] = CRGB::Black;
+        FastLED.show();
+        break;
+    }
 }
 
 void setupScale()
 {
     display.drawText("Setup scale");
-    scale.begin(LOADCELL_DOUT_PIN, LOADCELL_SCK_PIN);
-    scale.set_scale(config.scale_calib_value); // set calibrated scale value from config
+    // start acquisition task once, all further readings come from the sample buffer
+    if (!scaleReader.isRunning()) {
+        scaleReader.begin();
+        scaleSamples = scaleReader.createReader();
+    }
+    calibration.setScale(config.scale_calib_value); // set calibrated scale value from config
     tare(10);
 }
 
+void setupPresence()
+{
+    PresenceConfig presenceConfig;
+    presenceConfig.weightMin = toFixed(config.scale_weight_min);
+    presenceConfig.presenceTimeMinMs = config.presence_time_min * 1000;
+    session.setConfig(presenceConfig);
+
+    ZeroTrackerConfig zeroConfig;
+    zeroConfig.band = toFixed(config.scale_tare_thresh);
+    zeroConfig.stepHoldMs = config.scale_tare_time;
+    zeroTracker.setConfig(zeroConfig);
+}
+
+/**
+ * @brief averages the raw value of the next count samples
+ */
+int32_t readAverage(int count)
+{
+    // start with fresh samples
+    scaleSamples.skip();
+    int64_t sum = 0;
+    int n = 0;
+    Sample sample;
+    while (n < count && scaleReader.waitForSample(scaleSamples, sample)) {
+        sum += sample.raw;
+        n++;
+    }
+    return n ? sum / n : calibration.getOffset();
+}
+
 void tare(int count = 10)
 {
+    metrics::Timer timer(metricTareDuration);
     display.drawTare();
-    scale.tare(count);
+    calibration.setOffset(readAverage(count));
 }
 
 void calibrate(long weight)
@@ -486,8 +655,8 @@ void calibrate(long weight)
     ESP_LOGI(TAG, "Calibrate...");
 
     // setup scale
-    scale.set_scale();
-    scale.tare();
+    calibration.setScale(1.f);
+    calibration.setOffset(readAverage(10));
 
     // place weight
     display.drawCalib(weight);
@@ -516,8 +685,8 @@ void calibrate(long weight)
     display.drawText("Calibrating...");
 
     // measure and calculate scale
-    float value = scale.get_units(10) / weight;
-    scale.set_scale(value);
+    float value = (float)(readAverage(10) - calibration.getOffset()) / weight;
+    calibration.setScale(value);
 
     // write to file
     Serial.printf("Write scale %f to file\n", value);
@@ -566,6 +735,7 @@ void listDir(fs::FS& fs, const char* dirname, uint8_t levels)
 void apCallback(AsyncWiFiManager* mgr)
 {
     Serial.println("Started AP");
+    systemStatus.notify();
     display.drawWiFiAPMode();
     leds[0] = CRGB::Blue;
     FastLED.show();
@@ -577,6 +747,7 @@ void apCallback(AsyncWiFiManager* mgr)
  */
 void WiFiEvent(WiFiEvent_t event)
 {
+    systemStatus.notify();
     switch (event) {
     case ARDUINO_EVENT_WIFI_AP_START:
         ESP_LOGI(TAG, "AP Started");
@@ -604,10 +775,12 @@ void WiFiEvent(WiFiEvent_t event)
     case ARDUINO_EVENT_WIFI_STA_GOT_IP:
         // ESP_LOGI( TAG, "STA IPv4: ");
         ESP_LOGI(TAG, "%s", WiFi.localIP().toString().c_str());
+        mqttPublisher.notify();
         break;
     case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
     case ARDUINO_EVENT_WIFI_STA_LOST_IP:
         ESP_LOGI(TAG, "STA Disconnected -> reconnect");
+        mqttPublisher.notify();
         WiFi.reconnect();
         break;
     case ARDUINO_EVENT_WIFI_STA_STOP:
@@ -621,9 +794,44 @@ void WiFiEvent(WiFiEvent_t event)
 
 void handleConfig(AsyncWebServerRequest* request)
 {
-    // printConfig();
+    // report which subsystems were set up again after an update
+    if (auto result = (ConfigUpdate*)request->_tempObject) {
+        if (result->error) {
+            request->send(400, "text/plain", String("Invalid config: ") + result->error);
+            return;
+        }
+        StaticJsonDocument<128> doc;
+        auto state = [&](uint8_t change) {
+            if (!(result->changes & change)) {
+                return "unchanged";
+            }
+            return change != CONFIG_CHANGE_MQTT && result->deferred ? "deferred" : "applied";
+        };
+        doc["mqtt"] = state(CONFIG_CHANGE_MQTT);
+        doc["scale"] = state(CONFIG_CHANGE_SCALE);
+        doc["presence"] = state(CONFIG_CHANGE_PRESENCE);
+        AsyncResponseStream* response = request->beginResponseStream("application/json");
+        serializeJson(doc, *response);
+        request->send(response);
+        return;
+    }
+
     ESP_LOGI(TAG, "serving config");
-    request->send(fsConfig, configFile, "application/json");
+    AsyncResponseStream* response = request->beginResponseStream("application/json");
+    ConfigSchema::serialize(config, *response);
+    request->send(response);
+}
+
+/**
+ * GET /api/config/schema
+ *
+ * JSON schema with types, defaults and valid ranges of all config values
+ */
+void handleConfigSchema(AsyncWebServerRequest* request)
+{
+    AsyncResponseStream* response = request->beginResponseStream("application/json");
+    ConfigSchema::serializeSchema(*response);
+    request->send(response);
 }
 
 void handleConfigUpdate(
@@ -631,33 +839,45 @@ void handleConfigUpdate(
 {
     ESP_LOGI(TAG, "Update config. Config size: %d/%d bytes", len, total);
     if (len == total) {
-        DynamicJsonDocument doc(JSON_BUFFER);
-        DeserializationError error = deserializeJson(doc, data);
-
-        // Test if parsing succeeds.
-        if (error) {
-            ESP_LOGE(TAG, "deserializeJson() failed: %s", error.c_str());
-            request->send(500, "text/html", error.c_str());
+        // validate before anything is written
+        Config next = config;
+        if (auto invalid = ConfigSchema::parse(data, len, next)) {
+            ESP_LOGE(TAG, "Invalid config: %s", invalid);
+            storeConfigUpdate(request, { 0, false, invalid });
             return;
         }
-
-        // open file
-        File file = fsConfig.open(configFile, FILE_WRITE);
-
-        // Serialize JSON to file
-        if (serializeJson(doc, file) == 0) {
-            ESP_LOGE(TAG, "Failed to write to file");
-            request->send(500, "text/html", "Failed to write to file");
+        Config previous = config;
+        config = next;
+        if (!saveConfig()) {
+            config = previous;
+            storeConfigUpdate(request, { 0, false, "Failed to store config" });
             return;
         }
 
-        // Close the file
-        file.close();
+        // only apply what changed, MQTT right away and everything that affects the measurement
+        // in the loop between two sessions
+        uint8_t changes = diffConfig(previous, config);
+        if (changes & CONFIG_CHANGE_MQTT) {
+            applyConfig(CONFIG_CHANGE_MQTT);
+        }
+        configPending |= changes & (CONFIG_CHANGE_SCALE | CONFIG_CHANGE_PRESENCE);
+        bool deferred = session.isActive();
+        ESP_LOGI(TAG, "Config changes 0x%02x%s", changes, deferred ? ", deferred" : "");
 
-        // load config and apply new settings
+        storeConfigUpdate(request, { changes, deferred, nullptr });
+    }
+}
 
-        loadConfig();
-        applyConfig();
+// keeps the result for handleConfig(), the server free()s it with the request
+void storeConfigUpdate(AsyncWebServerRequest* request, const ConfigUpdate& update)
+{
+    if (request->_tempObject) {
+        return;
+    }
+    auto result = (ConfigUpdate*)malloc(sizeof(ConfigUpdate));
+    if (result) {
+        *result = update;
+        request->_tempObject = result;
     }
 }
 
@@ -665,14 +885,34 @@ void handeMeasurementsUpload(AsyncWebServerRequest* request, String filename, si
     uint8_t* data, size_t len, bool final)
 {
     ESP_LOGI(TAG, "Replace measurements file. CSV size: %d bytes\n", len);
-    // open new file if index is zero, else append data
-    File file = fsConfig.open(measurementsFile, index == 0 ? FILE_WRITE : FILE_APPEND);
+    // one import with an open temporary file per upload
+    auto import = (MeasurementLog::Import*)request->_tempObject;
+    if (index == 0 && !import) {
+        import = new MeasurementLog::Import(measurementLog);
+        request->_tempObject = import;
+        // the server only free()s _tempObject, clean up if the client disconnects early
+        request->onDisconnect([request]() {
+            delete (MeasurementLog::Import*)request->_tempObject;
+            request->_tempObject = nullptr;
+        });
+        if (!import->begin()) {
+            return;
+        }
+    }
+    if (!import) {
+        return;
+    }
 
-    // write data
-    file.write(data, len);
+    // parse rows and write records
+    import->write(data, len);
 
-    // Close the file
-    file.close();
+    // replace measurement log if the upload is complete
+    if (final && import->commit() >= 0) {
+        measurementSummary.invalidate();
+        measurementSummaryStale = true;
+        measurementStatsStale = true;
+        xTaskNotifyGive(pTaskMaintenance);
+    }
 }
 
 void handleMeasurements(AsyncWebServerRequest* request)
@@ -685,9 +925,18 @@ void handleMeasurements(AsyncWebServerRequest* request)
     }
 
     if (request->getParam("measurements", true, true)) {
-        ESP_LOGI(TAG, "Measurements upload successful");
-        // file upload successful!
-        request->redirect("/");
+        auto import = (MeasurementLog::Import*)request->_tempObject;
+        if (!import || !import->isCommitted()) {
+            request->send(500, "text/plain", "Import failed");
+        } else {
+            // file upload successful!
+            ESP_LOGI(TAG, "Measurements upload successful");
+            String url = "/config?imported=" + String(import->getAccepted())
+                + "&rejected=" + String(import->getRejected());
+            request->redirect(url.c_str());
+        }
+        delete import;
+        request->_tempObject = nullptr;
         return;
     }
 
@@ -699,69 +948,267 @@ void handleMeasurements(AsyncWebServerRequest* request)
         String action = obj["action"];
 
         if (action == "delete") {
-            // Serial.println("deleting...");
-            auto tmpMeasurementsFile = measurementsFile + "_tmp";
-            auto oldFile = fsConfig.open(measurementsFile, FILE_READ);
-            auto newFile = fsConfig.open(tmpMeasurementsFile, FILE_WRITE);
-
-            // read old file and write lines to new file that are not deleted list elements
-            auto line = oldFile.readStringUntil('\n');
-            while (line.length()) {
-                // get timestamp from line
-                int index = line.indexOf(',');
-                auto timestamp = line.substring(0, index).toInt();
-                // check if first element/timestamp is in deleted list
-                bool skip = false;
-                for (long ts : obj["timestamps"].as<JsonArray>()) {
-                    // Serial.printf("timestamp %d\n", ts.as<uint32_t>());
-                    if (timestamp == ts) {
-                        // Serial.printf("Deleting %d == %d\n", timestamp, ts);
-                        skip = true;
-                        break;
-                    }
-                }
-                // write line to new/tmp file
-                if (!skip) {
-                    line.trim();
-                    // Serial.printf("Writing line: %s\n", line.c_str());
-                    newFile.println(line);
-                }
-                // read new line
-                line = oldFile.readStringUntil('\n');
+            // sorted timestamps for binary search while copying the log
+            auto timestamps = obj["timestamps"].as<JsonArray>();
+            std::vector<uint32_t> deleted;
+            deleted.reserve(timestamps.size());
+            for (uint32_t ts : timestamps) {
+                deleted.push_back(ts);
+            }
+            std::sort(deleted.begin(), deleted.end());
+            if (measurementLog.remove(deleted.data(), deleted.size())) {
+                measurementSummary.invalidate();
+                measurementSummaryStale = true;
+                measurementStatsStale = true;
+                xTaskNotifyGive(pTaskMaintenance);
             }
 
-            // close files
-            oldFile.close();
-            newFile.close();
+            request->send(200);
+            return;
+        }
+    }
 
-            // replace with new measurements file
-            fsConfig.remove(measurementsFile);
-            fsConfig.rename(tmpMeasurementsFile, measurementsFile);
+    handleMeasurementsExport(request);
+}
 
-            request->send(200);
+/**
+ * GET /api/measurements?from=&to=&limit=&cursor=
+ *
+ * from/to are inclusive UNIX timestamps, limit is the maximum number of rows. If the result
+ * is cut off by limit, X-Next-Cursor contains the cursor for the next page.
+ *
+ * A cursor is "time:skip", the next page starts with the record after the first skip records
+ * with that timestamp. Rows can share a timestamp, so the time alone could repeat rows or
+ * never get past more than limit rows with the same time. Skip and limit only count rows
+ * that are exported, so unlike a plain record index the cursor stays valid when deleted
+ * records are compacted away between two pages.
+ */
+void handleMeasurementsExport(AsyncWebServerRequest* request)
+{
+    auto getParam = [request](const char* name, uint32_t defaultValue) -> uint32_t {
+        auto param = request->getParam(name);
+        return param ? strtoul(param->value().c_str(), nullptr, 10) : defaultValue;
+    };
+    uint32_t from = getParam("from", 0);
+    uint32_t to = getParam("to", UINT32_MAX);
+    uint32_t limit = getParam("limit", 0);
+    uint32_t skip = 0;
+    if (auto cursor = request->getParam("cursor")) {
+        char* end;
+        from = strtoul(cursor->value().c_str(), &end, 10);
+        skip = *end == ':' ? strtoul(end + 1, nullptr, 10) : 0;
+    }
+
+    // find the requested slice with a binary search over the time sorted log
+    File file = measurementLog.open();
+    size_t count = measurementLog.count();
+    size_t first = from ? measurementLog.lowerBound(file, from) : 0;
+    size_t last = to < UINT32_MAX ? measurementLog.lowerBound(file, to + 1) : count;
+    // skip and limit only count exported records, deleted ones are skipped like in the CSV
+    MeasurementRecord record;
+    for (; skip && first < last && measurementLog.readTime(file, first) == from; first++) {
+        if (measurementLog.read(file, first, record)) {
+            skip--;
         }
     }
+    String nextCursor;
+    size_t rows = 0;
+    for (size_t index = first; limit && index < last; index++) {
+        if (!measurementLog.read(file, index, record) || rows++ < limit) {
+            continue;
+        }
+        // index is the first row of the next page
+        uint32_t nextTime = record.time;
+        size_t nextSkip = 0;
+        for (size_t i = measurementLog.lowerBound(file, nextTime); i < index; i++) {
+            if (measurementLog.read(file, i, record)) {
+                nextSkip++;
+            }
+        }
+        nextCursor = String(nextTime) + ":" + String(nextSkip);
+        last = index;
+        break;
+    }
+    file.close();
+    ESP_LOGI(TAG, "Export measurements %u-%u", first, last);
+
+    // generate CSV from the binary log while sending
+    auto csv = std::make_shared<MeasurementLog::CsvStream>(measurementLog, first, last);
+    auto response = request->beginChunkedResponse("text/csv",
+        [csv](uint8_t* buffer, size_t maxLen, size_t index) { return csv->read(buffer, maxLen); });
+    if (nextCursor.length()) {
+        response->addHeader("X-Next-Cursor", nextCursor);
+    }
+    request->send(response);
+}
 
-    request->send(fsConfig, measurementsFile, "text/csv");
+/**
+ * GET /api/stats?days=
+ *
+ * hour-of-day histogram and daily aggregates of the last days (default 31). Hours and days
+ * are UTC, the device has no time zone, the web interface shifts the hours to local time.
+ */
+void handleStats(AsyncWebServerRequest* request)
+{
+    auto param = request->getParam("days");
+    size_t days = param ? strtoul(param->value().c_str(), nullptr, 10) : 31;
+    days = std::min(days, (size_t)MEASUREMENT_STATS_DAYS);
+    DynamicJsonDocument doc(JSON_OBJECT_SIZE(3) + JSON_ARRAY_SIZE(24)
+        + JSON_ARRAY_SIZE(days) + days * JSON_ARRAY_SIZE(6));
+    measurementStats.toJson(doc, days);
+
+    AsyncResponseStream* response = request->beginResponseStream("application/json");
+    serializeJson(doc, *response);
+    request->send(response);
+}
+
+/**
+ * GET /api/raw
+ * GET /api/raw?session=0[&format=bin]
+ *
+ * lists the recorded sessions or sends the samples of one session (0 is the newest) as CSV or
+ * in the binary ring buffer encoding
+ */
+void handleRaw(AsyncWebServerRequest* request)
+{
+#if SESSION_RECORDER
+    auto param = request->getParam("session");
+    if (!param) {
+        DynamicJsonDocument doc(
+            JSON_OBJECT_SIZE(2) + SESSION_RECORDER_SESSIONS * JSON_OBJECT_SIZE(3) + 64);
+        doc["enabled"] = sessionRecorder.isEnabled();
+        auto sessions = doc.createNestedArray("sessions");
+        SessionRecorder::Session session;
+        for (size_t i = 0; sessionRecorder.getSession(i, session); i++) {
+            auto entry = sessions.createNestedObject();
+            entry["id"] = session.id;
+            entry["time"] = session.time;
+            entry["samples"] = session.samples;
+        }
+        AsyncResponseStream* response = request->beginResponseStream("application/json");
+        serializeJson(doc, *response);
+        request->send(response);
+        return;
+    }
+
+    SessionRecorder::Session session;
+    if (!sessionRecorder.getSession(param->value().toInt(), session)) {
+        request->send(404, "text/plain", "Session not found");
+        return;
+    }
+    AsyncWebServerResponse* response;
+    auto format = request->getParam("format");
+    if (format && format->value() == "bin") {
+        response = request->beginChunkedResponse("application/octet-stream",
+            [session](uint8_t* buffer, size_t maxLen, size_t index) {
+                return sessionRecorder.copy(session, index, buffer, maxLen);
+            });
+    } else {
+        // decode while sending, a line that doesn't fit is kept for the next chunk
+        struct CsvState {
+            SessionRecorder::Cursor cursor;
+            char line[32];
+            size_t length = 0;
+            size_t offset = 0;
+            bool header = true;
+        };
+        auto state = std::shared_ptr<CsvState>(new CsvState { { sessionRecorder, session } });
+        response = request->beginChunkedResponse("text/csv",
+            [state](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
+                size_t written = 0;
+                while (written < maxLen) {
+                    if (state->offset == state->length) {
+                        uint32_t timestamp;
+                        int32_t weight;
+                        state->offset = 0;
+                        if (state->header) {
+                            state->length = snprintf(state->line, sizeof(state->line),
+                                "time,weight\n");
+                            state->header = false;
+                        } else if (state->cursor.next(timestamp, weight)) {
+                            state->length = SessionRecorder::formatCsv(
+                                timestamp, weight, state->line, sizeof(state->line));
+                        } else {
+                            state->length = 0;
+                            break;
+                        }
+                    }
+                    size_t length = std::min(state->length - state->offset, maxLen - written);
+                    memcpy(buffer + written, state->line + state->offset, length);
+                    state->offset += length;
+                    written += length;
+                }
+                return written;
+            });
+    }
+    response->addHeader("X-Session-Time", String((unsigned long)session.time));
+    response->addHeader("X-Session-Samples", String(session.samples));
+    request->send(response);
+#else
+    request->send(404, "text/plain", "Session recorder not available");
+#endif
+}
+
+/**
+ * POST /api/raw?enable=0|1
+ * POST /api/raw?save=0
+ *
+ * switches recording at runtime or writes a session to /rawvalues.csv
+ */
+void handleRawUpdate(AsyncWebServerRequest* request)
+{
+#if SESSION_RECORDER
+    if (auto param = request->getParam("enable")) {
+        if (!sessionRecorder.setEnabled(param->value().toInt())) {
+            request->send(500, "text/plain", "Out of memory");
+            return;
+        }
+    }
+    if (auto param = request->getParam("save")) {
+        if (!sessionRecorder.save(param->value().toInt(), fsConfig, "/rawvalues.csv")) {
+            request->send(404, "text/plain", "Session not found");
+            return;
+        }
+    }
+    request->send(200);
+#else
+    request->send(404, "text/plain", "Session recorder not available");
+#endif
 }
 
 void handleSystem(AsyncWebServerRequest* request)
 {
-    StaticJsonDocument<512> doc;
+    // cached, never touches the filesystem or the WiFi driver
+    auto status = systemStatus.get();
+    StaticJsonDocument<768> doc;
+    doc["age"] = millis() - status.timestamp;
+    auto boot = doc.createNestedObject("boot");
+    for (size_t i = 0; i < BOOT_PHASES; i++) {
+        boot[bootPhaseNames[i]] = bootPhaseMs[i];
+    }
+    doc["unsynced"] = unsyncedCount.load();
     auto flash = doc.createNestedObject("flash");
-    flash["total"] = fsConfig.totalBytes();
-    flash["used"] = fsConfig.usedBytes();
-    flash["config"] = fsConfig.open(configFile, FILE_READ).size();
-    flash["measurements"] = fsConfig.open(measurementsFile, FILE_READ).size();
+    flash["total"] = status.flashTotal;
+    flash["used"] = status.flashUsed;
+    flash["config"] = configStore.getSize();
+    flash["measurements"] = status.measurementsSize;
     auto wifi = doc.createNestedObject("wifi");
-    wifi["rssi"] = WiFi.RSSI();
+    wifi["rssi"] = status.rssi;
+    auto mqttStats = doc.createNestedObject("mqtt");
+    mqttStats["connected"] = mqttPublisher.isConnected();
+    mqttStats["pending"] = mqttPublisher.getPending();
+    auto scaleStats = doc.createNestedObject("scale");
+    scaleStats["samples"] = scaleReader.getSampleCount();
+    scaleStats["dropped"] = scaleReader.getDroppedCount();
+    scaleStats["timeouts"] = scaleReader.getTimeoutCount();
+    scaleStats["overruns"] = scaleSamples.getOverruns();
     auto system = doc.createNestedObject("system");
     system["cpu"] = ESP.getChipModel();
     system["freq"] = ESP.getCpuFreqMHz();
-    system["heapSize"] = ESP.getHeapSize();
-    system["heapFree"] = ESP.getFreeHeap();
-    system["heapMin"] = ESP.getMinFreeHeap();
-    system["heapMax"] = ESP.getMaxAllocHeap();
+    system["heapSize"] = status.heapSize;
+    system["heapFree"] = status.heapFree;
+    system["heapMin"] = status.heapMin;
+    system["heapMax"] = status.heapMax;
 
     // create repsonse
     AsyncResponseStream* response = request->beginResponseStream("application/json");
@@ -769,6 +1216,98 @@ void handleSystem(AsyncWebServerRequest* request)
     request->send(response);
 }
 
+/**
+ * GET /api/metrics
+ *
+ * counters, gauges and latency histograms in the Prometheus text format
+ */
+void handleMetrics(AsyncWebServerRequest* request)
+{
+    // values that are kept by the subsystems themselves
+    metricSamples.set(scaleReader.getSampleCount());
+    metricDropped.set(scaleReader.getDroppedCount());
+    metricTimeouts.set(scaleReader.getTimeoutCount());
+    metricOverruns.set(scaleSamples.getOverruns());
+    metricDisplayBytes.set(display.getBytesSent());
+    metricDisplaySkipped.set(display.getSkippedFrames());
+    metricWsClients.set(ws.count());
+    metricWsQueue.set(liveStream.getMaxQueueLength());
+    metricWsSkipped.set(liveStream.getSkippedFrames());
+    metricMqttConnected.set(mqttPublisher.isConnected());
+    metricMqttPending.set(mqttPublisher.getPending());
+    metricMqttConnectFailures.set(mqttPublisher.getConnectFailures());
+    metricMqttPublishFailures.set(mqttPublisher.getPublishFailures());
+    metricMqttConfirmTimeouts.set(mqttPublisher.getConfirmTimeouts());
+    auto status = systemStatus.get();
+    metricHeapFree.set(status.heapFree);
+    metricHeapMin.set(status.heapMin);
+    const ZeroTracker& tracker = scalePipeline.getZeroTracker();
+    metricZeroDrift.set(tracker.getDriftCorrections());
+    metricZeroSteps.set(tracker.getStepCorrections());
+    metricZeroCorrection.set((fixed64_t)tracker.getTotalCorrection() * 100 / FIXED_ONE);
+
+    AsyncResponseStream* response = request->beginResponseStream("text/plain; version=0.0.4");
+    metrics::Metric::writeAll(*response);
+    response->print("# HELP " METRICS_PREFIX "task_stack_free_bytes Stack high water mark\n"
+                    "# TYPE " METRICS_PREFIX "task_stack_free_bytes gauge\n");
+    for (auto name : { "loopTask", "taskScale", "taskMQTT", "taskMaintenance", "taskDisplay",
+             "taskStatus", "async_tcp" }) {
+        TaskHandle_t task = xTaskGetHandle(name);
+        if (task) {
+            response->printf(METRICS_PREFIX "task_stack_free_bytes{task=\"%s\"} %u\n", name,
+                (unsigned)uxTaskGetStackHighWaterMark(task));
+        }
+    }
+    response->print("# HELP " METRICS_PREFIX "boot_phase_seconds Time since power on at the end "
+                    "of a boot phase\n"
+                    "# TYPE " METRICS_PREFIX "boot_phase_seconds gauge\n");
+    for (size_t i = 0; i < BOOT_PHASES; i++) {
+        if (bootPhaseMs[i]) {
+            response->printf(METRICS_PREFIX "boot_phase_seconds{phase=\"%s\"} %.3f\n",
+                bootPhaseNames[i], bootPhaseMs[i] / 1000.);
+        }
+    }
+    request->send(response);
+}
+
+#if MQTT_TEST_ENDPOINT
+/**
+ * @brief POST /api/mqtt/test queues synthetic measurements in the MQTT outbox
+ *
+ * ?count=N&weight=W publishes N measurements with the weights W, W+1, ... They aren't written
+ * to the measurement log.
+ */
+void handleMqttTest(AsyncWebServerRequest* request)
+{
+    if (!isTimeValid()) {
+        request->send(503, "text/plain", "No time yet");
+        return;
+    }
+    long count = 1;
+    long weight = 1000;
+    if (auto param = request->getParam("count")) {
+        count = param->value().toInt();
+    }
+    if (auto param = request->getParam("weight")) {
+        weight = param->value().toInt();
+    }
+    if (count < 1 || count > MQTT_OUTBOX_SIZE || weight < 0 || weight + count > UINT16_MAX) {
+        request->send(400, "text/plain", "Invalid count or weight");
+        return;
+    }
+    CatMeasurement measurement;
+    time(&measurement.time);
+    for (long i = 0; i < count; i++) {
+        measurement.weight = weight + i;
+        if (!mqttPublisher.publish(measurement)) {
+            request->send(500, "text/plain", "MQTT disabled or outbox not writable");
+            return;
+        }
+    }
+    request->send(200);
+}
+#endif
+
 void onEvent(AsyncWebSocket* server, AsyncWebSocketClient* client, AwsEventType type, void* arg,
     uint8_t* data, size_t len)
 {
@@ -777,9 +1316,11 @@ void onEvent(AsyncWebSocket* server, AsyncWebSocketClient* client, AwsEventType
         ESP_LOGI(TAG, "ws[%s][%u] connect\n", server->url(), client->id());
         // client->printf("{message: 'Hi!'}", client->id());
         client->ping();
+        liveStream.onConnect(client);
     } else if (type == WS_EVT_DISCONNECT) {
         // client disconnected
         ESP_LOGI(TAG, "ws[%s][%u] disconnect: %u\n", server->url(), client->id());
+        liveStream.onDisconnect(client);
     } else if (type == WS_EVT_ERROR) {
         // error was received from the other end
         ESP_LOGI(TAG, "ws[%s][%u] error(%u): %s\n", server->url(), client->id(), *((uint16_t*)arg),
@@ -790,241 +1331,119 @@ void onEvent(AsyncWebSocket* server, AsyncWebSocketClient* client, AwsEventType
             (len) ? (char*)data : "");
     } else if (type == WS_EVT_DATA) {
         ESP_LOGI(TAG, "Got WS data!");
+        // rate negotiation, only complete single frame text messages
+        auto info = (AwsFrameInfo*)arg;
+        if (info->final && info->index == 0 && info->len == len && info->opcode == WS_TEXT) {
+            liveStream.onMessage(client, data, len);
+        }
     }
 }
 
 bool loadConfig()
 {
+    if (configStore.load(config)) {
+        return true;
+    }
+    // migrate the JSON file of older versions once, it's kept as backup
     File file = fsConfig.open(configFile, FILE_READ);
-
     if (!file) {
-        ESP_LOGE(TAG, "config.json does not exist!");
+        ESP_LOGE(TAG, "%s does not exist!", configFile.c_str());
         return false;
     }
-
-    // Allocate a temporary JsonDocument
-    // Don't forget to change the capacity to match your requirements.
-    // Use https://arduinojson.org/v6/assistant to compute the capacity.
-    StaticJsonDocument<JSON_BUFFER> doc;
-
-    // Deserialize the JSON document
-    DeserializationError error = deserializeJson(doc, file);
-    if (error){
-        ESP_LOGE(TAG, "Failed to deserialize config file, using default configuration");
-    }
-
-    // Copy values from the JsonDocument to the Config
-    config.mqtt_enabled = doc["mqttEnabled"] | config.mqtt_enabled;
-    config.mqtt_server = doc["mqttServer"] | config.mqtt_server;
-    config.mqtt_port = doc["mqttPort"] | config.mqtt_port;
-    config.mqtt_user = doc["mqttUser"] | config.mqtt_user;
-    config.mqtt_pass = doc["mqttPass"] | config.mqtt_pass;
-    config.mqtt_topic_current_weight
-        = doc["mqttTopicCurrentWeight"] | config.mqtt_topic_current_weight;
-    config.mqtt_topic_cat_weight = doc["mqttTopicCatWeight"] | config.mqtt_topic_cat_weight;
-
-    config.scale_calib_value = doc["scaleCalibValue"] | config.scale_calib_value;
-    config.scale_calib_weight = doc["scaleCalibWeight"] | config.scale_calib_weight;
-    config.scale_weight_min = doc["scaleWeightMin"] | config.scale_weight_min;
-
-    config.scale_tare_time = doc["scaleTareTime"] | config.scale_tare_time;
-    config.scale_tare_thresh = doc["scaleTareThresh"] | config.scale_tare_thresh;
-    config.scale_weight_deviation_percent = doc["scaleWeightDeviationPercent"] | config.scale_weight_deviation_percent;
-
-    // Close the file (Curiously, File's destructor doesn't close the file)
+    // an unreadable file is migrated with the defaults
+    ConfigSchema::load(file, config);
     file.close();
-
-    return true;
-}
-
-bool saveConfig()
-{
-    // Open file for writing
-    File file = fsConfig.open(configFile, FILE_WRITE);
-    if (!file) {
-        ESP_LOGE(TAG, "Failed to open config file");
-        return false;
+    ESP_LOGI(TAG, "Migrating %s to NVS", configFile.c_str());
+    if (saveConfig()) {
+        fsConfig.rename(configFile, configFile + ".bak");
+        systemStatus.invalidateFlash();
     }
-
-    // Allocate a temporary JsonDocument
-    // Don't forget to change the capacity to match your requirements.
-    // Use https://arduinojson.org/assistant to compute the capacity.
-    StaticJsonDocument<512> doc;
-
-    // Set the values in the document
-    doc["mqttEnabled"] = config.mqtt_enabled;
-    doc["mqttServer"] = config.mqtt_server;
-    doc["mqttPort"] = config.mqtt_port;
-    doc["mqttUser"] = config.mqtt_user;
-    doc["mqttPass"] = config.mqtt_pass;
-    doc["mqttTopicCurrentWeight"] = config.mqtt_topic_cat_weight;
-    doc["mqttTopicCatWeight"] = config.mqtt_topic_current_weight;
-
-    doc["scaleCalibValue"] = config.scale_calib_value;
-    doc["scaleCalibWeight"] = config.scale_calib_weight;
-    doc["scaleWeightMin"] = config.scale_weight_min;
-
-    doc["scaleTareTime"] = config.scale_tare_time;
-    doc["scaleTareThresh"] = config.scale_tare_thresh;
-    doc["scaleWeightDeviationPercent"] = config.scale_weight_deviation_percent;
-
-    // Serialize JSON to file
-    if (serializeJson(doc, file) == 0) {
-        ESP_LOGE(TAG, "Failed to serialize config to file");
-    }
-
-    // Close the file
-    file.close();
-
     return true;
 }
 
+bool saveConfig() { return configStore.save(config); }
+
 void printConfig()
 {
     ESP_LOGD(TAG, "printConfig...");
-    // Serial.flush();
-    // Open file for reading
-    File file = fsConfig.open(configFile, FILE_READ);
-    if (!file) {
-        ESP_LOGE(TAG, "Failed to read file");
-        return;
-    }
-
-    // Extract each characters by one by one
-    while (file.available()) {
-        Serial.print((char)file.read());
-    }
+    ConfigSchema::serialize(config, Serial);
     Serial.println();
-
-    // Close the file
-    file.close();
 }
 
-void applyConfig()
-{
-    setupMQTT();
-    setupScale();
-}
-
-void setupMQTT() { 
-    xSemaphoreTake(semMQTT ,portMAX_DELAY);
-    mqtt.setServer(config.mqtt_server.c_str(), config.mqtt_port);
-    xSemaphoreGive(semMQTT);
-}
-
-void sendMQTTCatWeights(const CatMeasurement& measurement)
+/**
+ * @brief returns the CONFIG_CHANGE_* flags of the subsystems affected by the difference
+ *
+ * Values that are read from the config on every use, like the deviation filter, don't need to
+ * be applied.
+ */
+uint8_t diffConfig(const Config& previous, const Config& current)
 {
-    // check WiFi
-    if (!WiFi.isConnected()) {
-        ESP_LOGE(TAG, "WiFI currently not connected!");
-        return;
-    }
-
-    // reconnect to MQTT
-    xSemaphoreTake(semMQTT ,portMAX_DELAY);
-    if (!mqtt.connected()) {
-        ESP_LOGI(TAG, "Connect to MQTT");
-        auto connected = mqtt.connect("cat_scale", config.mqtt_user.c_str(), config.mqtt_pass.c_str());
-        if (!connected) {
-            ESP_LOGE(TAG, "Cannot connect to MQTT");
-            xSemaphoreGive(semMQTT);
-            return;
-        }
+    uint8_t changes = 0;
+    if (previous.mqtt_enabled != current.mqtt_enabled
+        || previous.mqtt_server != current.mqtt_server
+        || previous.mqtt_port != current.mqtt_port || previous.mqtt_user != current.mqtt_user
+        || previous.mqtt_pass != current.mqtt_pass
+        || previous.mqtt_topic_cat_weight != current.mqtt_topic_cat_weight
+        || previous.mqtt_topic_current_weight != current.mqtt_topic_current_weight) {
+        changes |= CONFIG_CHANGE_MQTT;
     }
-
-    // send MQTT
-    String msg = "sensors,device=cat_scale,field=cat_weight value=" + String(measurement.weight)
-        + ",std=" + String(measurement.std) + ",duration=" + String(measurement.duration);
-    ESP_LOGV(TAG, "Send MQTT message on topic %s: %s\n", config.mqtt_topic_cat_weight.c_str(),
-        msg.c_str());
-    if (!mqtt.publish(config.mqtt_topic_cat_weight.c_str(), msg.c_str())) {
-        ESP_LOGE(TAG, "Could not publish MQTT message!");
+    if (previous.scale_calib_value != current.scale_calib_value) {
+        changes |= CONFIG_CHANGE_SCALE;
     }
-
-    // disconnect from MQTT
-    mqtt.disconnect();
-    xSemaphoreGive(semMQTT);
-}
-
-void createMeasurementsFile()
-{
-    if (!fsConfig.exists(measurementsFile)) {
-
-        File f = fsConfig.open(measurementsFile, FILE_APPEND, true);
-        if (!f) {
-            ESP_LOGE(TAG, "Cannot open measurements file %s\n", measurementsFile);
-        } else {
-            f.println("time,weight,std,duration,dropping");
-        }
-        f.close();
+    if (previous.scale_weight_min != current.scale_weight_min
+        || previous.presence_time_min != current.presence_time_min
+        || previous.scale_tare_time != current.scale_tare_time
+        || previous.scale_tare_thresh != current.scale_tare_thresh) {
+        changes |= CONFIG_CHANGE_PRESENCE;
     }
+    return changes;
 }
 
-// Initialize weight history from last measurements in CSV
-void initWeightHistory()
+/**
+ * @brief sets up the subsystems affected by a config change
+ *
+ * Scale and presence changes must only be applied by the loop without an active session.
+ */
+void applyConfig(uint8_t changes)
 {
-    weightHistoryCount = 0;
-    weightHistoryIndex = 0;
-    
-    File f = fsConfig.open(measurementsFile, FILE_READ);
-    if (!f) {
-        ESP_LOGW(TAG, "Cannot open measurements file for weight history initialization");
-        return;
+    if (changes & CONFIG_CHANGE_MQTT) {
+        setupMQTT();
     }
-    
-    // Read all lines and keep only last 5
-    String line = f.readStringUntil('\n'); // skip header
-    uint16_t tempWeights[WEIGHT_HISTORY_SIZE * 2];
-    int tempCount = 0;
-    
-    while (line.length() && tempCount < WEIGHT_HISTORY_SIZE * 2) {
-        line = f.readStringUntil('\n');
-        if (line.length() > 0) {
-            // Parse CSV: time,weight,std,duration,dropping
-            int firstComma = line.indexOf(',');
-            int secondComma = line.indexOf(',', firstComma + 1);
-            String weightStr = line.substring(firstComma + 1, secondComma);
-            tempWeights[tempCount] = weightStr.toInt();
-            tempCount++;
-        }
+    if (changes & CONFIG_CHANGE_SCALE) {
+        // the offset is a raw value and stays valid, no need to tare again
+        calibration.setScale(config.scale_calib_value);
     }
-    f.close();
-    
-    // Copy last WEIGHT_HISTORY_SIZE measurements to the circular buffer
-    int startIdx = (tempCount > WEIGHT_HISTORY_SIZE) ? (tempCount - WEIGHT_HISTORY_SIZE) : 0;
-    for (int i = startIdx; i < tempCount; i++) {
-        weightHistory[weightHistoryCount] = tempWeights[i];
-        weightHistoryCount++;
+    if (changes & CONFIG_CHANGE_PRESENCE) {
+        setupPresence();
     }
-    
-    ESP_LOGI(TAG, "Weight history initialized with %d measurements", weightHistoryCount);
 }
 
-// Add measurement to weight history (circular buffer)
-void addToWeightHistory(uint16_t weight)
+void setupMQTT()
 {
-    weightHistory[weightHistoryIndex] = weight;
-    weightHistoryIndex = (weightHistoryIndex + 1) % WEIGHT_HISTORY_SIZE;
-    
-    if (weightHistoryCount < WEIGHT_HISTORY_SIZE) {
-        weightHistoryCount++;
-    }
-    
-    ESP_LOGV(TAG, "Weight history updated: [%hu, %hu, %hu, %hu, %hu], count=%d",
-             weightHistory[0], weightHistory[1], weightHistory[2], weightHistory[3], weightHistory[4],
-             weightHistoryCount);
+    MqttSettings settings;
+    settings.enabled = config.mqtt_enabled;
+    settings.server = config.mqtt_server;
+    settings.port = config.mqtt_port;
+    settings.user = config.mqtt_user;
+    settings.pass = config.mqtt_pass;
+    settings.topicCatWeight = config.mqtt_topic_cat_weight;
+    settings.topicCurrentWeight = config.mqtt_topic_current_weight;
+    mqttPublisher.configure(settings);
 }
 
-// Calculate average weight from history
-float calculateAverageWeight()
+// Load summary of the measurement log, rebuild it from the end of the log if missing
+void initMeasurementSummary()
 {
-    if (weightHistoryCount == 0) return 0.f;
-    
-    float sum = 0.f;
-    for (int i = 0; i < weightHistoryCount; i++) {
-        sum += weightHistory[i];
+    if (!measurementSummary.load()) {
+        ESP_LOGW(TAG, "Rebuilding measurement summary");
+        measurementSummary.rebuild(measurementLog);
+        measurementSummary.save();
+    }
+    if (measurementSummary.getLast().time) {
+        lastMeasurement = measurementSummary.getLast().toMeasurement();
     }
-    return sum / weightHistoryCount;
+    ESP_LOGI(TAG, "Weight history initialized with %d of %u measurements",
+        measurementSummary.getWeightCount(), measurementSummary.getTotal());
 }
 
 // Check if measurement is within acceptable deviation
@@ -1034,11 +1453,11 @@ bool isMeasurementValid(uint16_t weight, float deviationPercent)
         return true; // filter disabled
     }
     
-    if (weightHistoryCount < WEIGHT_HISTORY_SIZE) {
+    if (measurementSummary.getWeightCount() < WEIGHT_HISTORY_SIZE) {
         return true; // not enough measurements yet, accept
     }
     
-    float avgWeight = calculateAverageWeight();
+    float avgWeight = measurementSummary.getAverageWeight();
     float tolerance = avgWeight * deviationPercent;
     float diff = abs((float)weight - avgWeight);
     
@@ -1049,32 +1468,109 @@ bool isMeasurementValid(uint16_t weight, float deviationPercent)
     return valid;
 }
 
+void bootPhaseDone(BootPhase phase)
+{
+    bootPhaseMs[phase] = millis();
+    ESP_LOGI(TAG, "Boot: %s after %ums", bootPhaseNames[phase], bootPhaseMs[phase]);
+}
+
+bool isTimeValid() { return time(nullptr) > TIME_VALID_MIN; }
+
+/**
+ * @brief writes and publishes a measurement with the current time
+ *
+ * Before the NTP sync the measurement is kept with its uptime and stored by
+ * storeUnsyncedMeasurements() later, so a cat is weighed right after a power loss or without
+ * WiFi. Beyond MEASUREMENTS_UNSYNCED_MAX the oldest ones are dropped and counted.
+ */
+void storeMeasurement(CatMeasurement& measurement)
+{
+    if (isTimeValid()) {
+        time(&measurement.time);
+        writeMeasurement(measurement);
+        mqttPublisher.publish(measurement);
+        return;
+    }
+    if (unsyncedMeasurements.size() >= MEASUREMENTS_UNSYNCED_MAX) {
+        // the log is sorted by time, an uptime instead of a UNIX time would break it
+        ESP_LOGW(TAG, "No time for a long time, dropping oldest measurement");
+        unsyncedMeasurements.erase(unsyncedMeasurements.begin());
+        metricUnsyncedDropped.add();
+    }
+    ESP_LOGI(TAG, "No time yet, keeping measurement until NTP sync");
+    unsyncedMeasurements.push_back({ measurement, (uint32_t)millis() });
+    unsyncedCount = unsyncedMeasurements.size();
+}
+
+void storeUnsyncedMeasurements()
+{
+    time_t now = time(nullptr);
+    uint32_t current = millis();
+    for (auto& unsynced : unsyncedMeasurements) {
+        unsynced.measurement.time = now - (current - unsynced.millis) / 1000;
+        ESP_LOGI(TAG, "Back-dating measurement by %us", (current - unsynced.millis) / 1000);
+        writeMeasurement(unsynced.measurement);
+        mqttPublisher.publish(unsynced.measurement);
+    }
+    unsyncedMeasurements.clear();
+    unsyncedCount = 0;
+}
+
 bool writeMeasurement(CatMeasurement& m)
 {
+    // measurements were deleted or imported since the last measurement
+    if (measurementSummaryStale) {
+        measurementSummaryStale = false;
+        measurementSummary.rebuild(measurementLog);
+    }
+
     // Check if measurement passes deviation filter
     if (!isMeasurementValid(m.weight, config.scale_weight_deviation_percent)) {
         ESP_LOGW(TAG, "Measurement rejected due to deviation filter: %hu", m.weight);
         return false;
     }
     
-    File f = fsConfig.open(measurementsFile, FILE_APPEND, true);
-
-    if (!f) {
-        ESP_LOGE(TAG, "Cannot open measurements file %s\n", measurementsFile);
+    ESP_LOGI(TAG, "Write measurement to file");
+    metrics::Timer timer(metricWriteDuration);
+    if (!measurementLog.append(m)) {
         return false;
     }
-    ESP_LOGE(TAG, "Write measurement to file");
-
-    f.printf("%ld,%hu,%.2f,%.2f,%hu", m.time, m.weight, m.std, m.duration, m.weightDropping);
-    f.println();
-    f.close();
     
     // Update weight history with this valid measurement
-    addToWeightHistory(m.weight);
+    measurementSummary.add(MeasurementRecord::from(m));
+    measurementSummary.save();
+
+    // update daily aggregates, unless they are rebuilt anyway
+    if (!measurementStatsStale) {
+        measurementStats.add(MeasurementRecord::from(m));
+        measurementStats.save();
+    }
+    systemStatus.invalidateFlash();
 
     return true;
 }
 
+void taskMaintenance(void* parameter)
+{
+    while (true) {
+        // wait for deletions and imports
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (measurementStatsStale) {
+            measurementStatsStale = false;
+            measurementStats.rebuild(measurementLog);
+            measurementStats.save();
+        }
+        size_t deleted = measurementLog.deletedCount();
+        if (deleted && deleted > measurementLog.count() * MEASUREMENTS_COMPACT_RATIO) {
+            ESP_LOGI(TAG, "Compacting measurements, %u deleted records", deleted);
+            uint32_t start = millis();
+            measurementLog.compact();
+            ESP_LOGI(TAG, "Compaction took %ums", millis() - start);
+        }
+        systemStatus.invalidateFlash();
+    }
+}
+
 void playToneStart()
 {
     String notes1[] = { "C3", "G3", "C4" };
@@ -1088,27 +1584,3 @@ void playToneSuccess()
     Melody melody1 = MelodyFactory.load("Nice Melody", 250, notes1, 8);
     buzzer.playAsync(melody1);
 }
-
-void taskMQTT(void* parameter)
-{
-    CatMeasurement currentData;
-    while (true) {
-        // just sleep some seconds if mqtt is disabled
-        if (!config.mqtt_enabled) {
-            delay(10000);
-            continue;
-        }
-        if (xQueueReceive(qMQTT, &currentData, 1000 / portTICK_PERIOD_MS) == pdPASS) {
-            // update MQTT
-            // send via MQTT
-            ESP_LOGD(TAG, "Got MQTT message in queue");
-            sendMQTTCatWeights(currentData);
-        } else {
-            ESP_LOGD(TAG, "Got no MQTT message in queue.");
-        }
-
-        xSemaphoreTake(semMQTT ,portMAX_DELAY);
-        mqtt.loop();
-        xSemaphoreGive(semMQTT);
-    }
-}
\ No newline at end of file
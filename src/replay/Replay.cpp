@@ -0,0 +1,218 @@
+#include "Replay.h"
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+namespace weightwhiskers
+{
+    namespace replay
+    {
+
+        uint32_t seed = 1;
+
+        namespace
+        {
+
+            float randomUniform()
+            {
+                seed = seed * 1664525 + 1013904223;
+                return (seed >> 8) / (float)(1 << 24);
+            }
+
+            // approximately normal distributed noise
+            float randomNoise(float sigma)
+            {
+                float sum = 0;
+                for (int i = 0; i < 4; i++) {
+                    sum += randomUniform();
+                }
+                return (sum - 2.f) * sigma * 1.73f;
+            }
+
+            int32_t toRaw(float weight)
+            {
+                return REPLAY_OFFSET + (int32_t)lroundf(weight * REPLAY_SCALE);
+            }
+
+
+        }
+
+        Scale::Scale()
+        {
+            calibration.setScale(REPLAY_SCALE);
+            calibration.setOffset(REPLAY_OFFSET);
+        }
+
+        Visit createVisit()
+        {
+            Visit visit;
+            visit.weight = 3000 + randomUniform() * 3000;
+            visit.weightDropping = randomUniform() < 0.5f ? 0 : 10 + randomUniform() * 70;
+            uint32_t duration = 10000 + randomUniform() * 110000;
+            uint32_t digging = duration * 0.3f;
+
+            uint32_t t = 0;
+            for (uint32_t i = 0; i < duration; i += REPLAY_SAMPLE_PERIOD_MS) {
+                float weight = visit.weight;
+                if (i < 2000) {
+                    // jumping in
+                    weight *= i / 2000.f;
+                } else if (i < digging) {
+                    weight += randomNoise(300.f);
+                } else {
+                    weight += randomNoise(5.f);
+                }
+                visit.samples.push_back({ t, weight + randomNoise(2.f) });
+                t += REPLAY_SAMPLE_PERIOD_MS;
+            }
+            for (uint32_t i = 0; i < REPLAY_IDLE_AFTER_MS; i += REPLAY_SAMPLE_PERIOD_MS) {
+                visit.samples.push_back({ t, visit.weightDropping + randomNoise(2.f) });
+                t += REPLAY_SAMPLE_PERIOD_MS;
+            }
+            return visit;
+        }
+
+        bool loadVisit(const char* path, Visit& visit)
+        {
+            FILE* file = fopen(path, "r");
+            if (!file) {
+                fprintf(stderr, "Cannot open %s\n", path);
+                return false;
+            }
+            char line[128];
+            uint32_t first = 0;
+            uint32_t t = 0;
+            while (fgets(line, sizeof(line), file)) {
+                char* end;
+                unsigned long time = strtoul(line, &end, 10);
+                if (end == line || *end != ',') {
+                    // header
+                    continue;
+                }
+                if (visit.samples.empty()) {
+                    first = time;
+                }
+                t = time - first;
+                visit.samples.push_back({ t, strtof(end + 1, nullptr) });
+            }
+            fclose(file);
+            // the recording stops when the cat leaves, add an empty scale
+            float last = visit.samples.empty() ? 0.f : visit.samples.back().weight;
+            for (uint32_t i = 0; i < REPLAY_IDLE_AFTER_MS; i += REPLAY_SAMPLE_PERIOD_MS) {
+                t += REPLAY_SAMPLE_PERIOD_MS;
+                visit.samples.push_back({ t, last < 200.f ? last : 0.f });
+            }
+            return !visit.samples.empty();
+        }
+
+        bool replayVisit(const Visit& visit, Scale& scale, bool verbose)
+        {
+            Totals& totals = scale.totals;
+            totals.visits++;
+            bool measured = false;
+            auto process = [&](uint32_t timestamp, float weight) {
+                auto result = scale.pipeline.process(timestamp, toRaw(totals.baseline + weight));
+                totals.samples++;
+                totals.liveMessages += result.publishWeight;
+                switch (result.event) {
+                case PresenceSession::Event::Entered:
+                    totals.entered++;
+                    break;
+                case PresenceSession::Event::Aborted:
+                    totals.aborted++;
+                    break;
+                case PresenceSession::Event::Measured:
+                    measured = true;
+                    totals.measured++;
+                    break;
+                default:
+                    break;
+                }
+                return result;
+            };
+
+            VirtualClock& clock = scale.clock;
+            uint32_t start = clock.now();
+            for (uint32_t i = 0; i < REPLAY_IDLE_BEFORE_MS; i += REPLAY_SAMPLE_PERIOD_MS) {
+                process(clock.advance(REPLAY_SAMPLE_PERIOD_MS), randomNoise(2.f));
+            }
+            uint32_t offset = clock.now();
+            CatMeasurement measurement;
+            for (auto& sample : visit.samples) {
+                uint32_t timestamp = offset + sample.timestamp + REPLAY_SAMPLE_PERIOD_MS;
+                clock.advance(timestamp - clock.now());
+                auto result = process(timestamp, sample.weight);
+                if (result.event == PresenceSession::Event::Measured) {
+                    measurement = scale.session.getMeasurement();
+                }
+            }
+            totals.virtualMs += clock.now() - start;
+            totals.baseline += visit.weightDropping;
+
+            bool failed = visit.weight && !measured;
+            if (measured && visit.weight) {
+                int weightError = abs((int)measurement.weight - visit.weight);
+                int droppingError = abs((int)measurement.weightDropping - visit.weightDropping);
+                totals.maxWeightError = std::max(totals.maxWeightError, weightError);
+                totals.maxDroppingError = std::max(totals.maxDroppingError, droppingError);
+                failed = weightError > REPLAY_MAX_WEIGHT_ERROR_G
+                    || droppingError > REPLAY_MAX_DROPPING_ERROR_G;
+            }
+            totals.failed += failed;
+            if (verbose || failed) {
+                printf("{\"name\": \"visit\", \"index\": %u, \"measured\": %s, \"weight\": %u, "
+                       "\"expected\": %u, \"dropping\": %u, \"expected_dropping\": %u, "
+                       "\"duration\": %.1f, \"std\": %.1f}\n",
+                    totals.visits - 1, measured ? "true" : "false", measurement.weight,
+                    visit.weight, measurement.weightDropping, visit.weightDropping,
+                    measurement.duration, measurement.std);
+            }
+            return !failed;
+        }
+
+        bool replayDrift(Scale& scale, bool verbose)
+        {
+            Totals& totals = scale.totals;
+            float drift = 0;
+            bool passed = true;
+            auto phase = [&](const char* name, uint32_t duration, float load, float creep,
+                             float expected = 0, int maxError = REPLAY_MAX_ZERO_ERROR_G) {
+                fixed_t filtered = 0;
+                for (uint32_t i = 0; i < duration; i += REPLAY_SAMPLE_PERIOD_MS) {
+                    drift += creep * REPLAY_SAMPLE_PERIOD_MS / duration;
+                    float weight = totals.baseline + drift + load + randomNoise(2.f);
+                    uint32_t timestamp = scale.clock.advance(REPLAY_SAMPLE_PERIOD_MS);
+                    filtered = scale.pipeline.process(timestamp, toRaw(weight)).filtered;
+                    totals.samples++;
+                }
+                totals.virtualMs += duration;
+                int error = abs(toGram(filtered) - (int)expected);
+                if (expected == 0) {
+                    totals.maxZeroError = std::max(totals.maxZeroError, error);
+                }
+                bool failed = error > maxError;
+                totals.failed += failed;
+                passed &= !failed;
+                if (verbose || failed) {
+                    printf("{\"name\": \"zero\", \"phase\": \"%s\", \"weight\": %d, "
+                           "\"failed\": %s}\n",
+                        name, toGram(filtered), failed ? "true" : "false");
+                }
+            };
+            // the first window sets the zero of the power on
+            phase("start", REPLAY_STEP_MS, 0, 0);
+            phase("creep", REPLAY_DRIFT_MS, 0, REPLAY_DRIFT_G);
+            phase("creep_back", REPLAY_DRIFT_MS, 0, -REPLAY_DRIFT_G);
+            phase("light_load", REPLAY_LIGHT_LOAD_MS, REPLAY_LIGHT_LOAD_G, 0, REPLAY_LIGHT_LOAD_G,
+                REPLAY_MAX_LIGHT_LOAD_LOSS_G);
+            phase("light_load_removed", REPLAY_STEP_MS, 0, 0);
+            phase("litter_added", REPLAY_STEP_MS, REPLAY_STEP_G, 0);
+            phase("litter_removed", REPLAY_STEP_MS, 0, 0);
+            // following visits see the offset of the tracker
+            totals.baseline += drift;
+            return passed;
+        }
+
+    }
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "ScalePipeline.h"
+
+// HX711 at 10 SPS
+#define REPLAY_SAMPLE_PERIOD_MS 100
+// empty scale before and after a visit
+#define REPLAY_IDLE_BEFORE_MS 10000
+#define REPLAY_IDLE_AFTER_MS 30000
+// raw conversion of a typical load cell
+#define REPLAY_OFFSET 123456
+#define REPLAY_SCALE 230.61f
+// accepted error of synthetic visits
+#define REPLAY_MAX_WEIGHT_ERROR_G 40
+#define REPLAY_MAX_DROPPING_ERROR_G 10
+// drift scenario: creep of the empty scale, litter added and removed
+#define REPLAY_DRIFT_MS 600000
+#define REPLAY_DRIFT_G 40.f
+#define REPLAY_STEP_G 400.f
+#define REPLAY_STEP_MS 90000
+// accepted zero error after drift and steps
+#define REPLAY_MAX_ZERO_ERROR_G 3
+// light object within the tare threshold that must not be zeroed away within a minute
+#define REPLAY_LIGHT_LOAD_G 30.f
+#define REPLAY_LIGHT_LOAD_MS 60000
+#define REPLAY_MAX_LIGHT_LOAD_LOSS_G 10
+
+namespace weightwhiskers
+{
+    namespace replay
+    {
+
+        struct Sample {
+            uint32_t timestamp;
+            float weight;
+        };
+
+        struct Visit {
+            std::vector<Sample> samples;
+            // expected results, 0 if unknown
+            uint16_t weight = 0;
+            uint16_t weightDropping = 0;
+        };
+
+        /**
+         * @brief millis() replacement that only moves when samples are fed
+         */
+        class VirtualClock
+        {
+        public:
+            uint32_t now() const { return time; }
+            uint32_t advance(uint32_t ms) { return time += ms; }
+
+        protected:
+            uint32_t time = 0;
+        };
+
+        struct Totals {
+            uint32_t visits = 0;
+            uint32_t samples = 0;
+            uint32_t entered = 0;
+            uint32_t measured = 0;
+            uint32_t aborted = 0;
+            uint32_t liveMessages = 0;
+            uint32_t failed = 0;
+            int maxZeroError = 0;
+            int maxWeightError = 0;
+            int maxDroppingError = 0;
+            uint64_t virtualMs = 0;
+            // droppings pile up between two cleanings
+            float baseline = 0;
+        };
+
+        /**
+         * @brief the firmware's sample processing with the calibration of the synthetic visits
+         */
+        struct Scale {
+            Scale();
+
+            ScaleCalibration calibration;
+            FixedLowPass lowPass { 0.5 };
+            PresenceSession session;
+            LiveWeightPublisher liveWeight;
+            ZeroTracker zeroTracker;
+            ScalePipeline pipeline { calibration, lowPass, session, liveWeight, zeroTracker };
+            VirtualClock clock;
+            Totals totals;
+        };
+
+        // seed of the synthetic visits and noise
+        extern uint32_t seed;
+
+        // cat jumps in, digs, sits still, leaves droppings and jumps out
+        Visit createVisit();
+        // session export of /api/raw or old rawvalues.csv capture
+        bool loadVisit(const char* path, Visit& visit);
+
+        /**
+         * @brief feeds an empty scale followed by the visit through the pipeline
+         *
+         * Visit weights are relative to the scale before the visit, like the recordings.
+         * @return false if a synthetic visit wasn't measured within the accepted error
+         */
+        bool replayVisit(const Visit& visit, Scale& scale, bool verbose);
+
+        /**
+         * @brief slow creep of the empty scale, a light object and litter added and removed
+         *
+         * @return false if the empty scale doesn't read zero at the end of every phase or the
+         *   light object is tracked away
+         */
+        bool replayDrift(Scale& scale, bool verbose);
+
+    }
+}
@@ -0,0 +1,71 @@
+/**
+ * Replays visits through the presence and measurement logic on the host
+ *
+ *   pio run -e native -t exec
+ *   .pio/build/native/program [--synthetic N] [--seed S] [session.csv ...]
+ *
+ * CSV files are session exports of /api/raw (time in ms, weight in g) or old rawvalues.csv
+ * captures, only the first two columns are used. Samples carry their own timestamps, so the
+ * replay runs on a virtual clock as fast as the host allows. Prints JSON lines.
+ *
+ * Synthetic runs start with a drifting empty scale and litter steps, which the zero tracker
+ * has to follow without a tare, and a light object that it must not zero away.
+ */
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "Replay.h"
+
+using namespace weightwhiskers;
+using namespace weightwhiskers::replay;
+
+int main(int argc, char** argv)
+{
+    uint32_t synthetic = 0;
+    std::vector<const char*> files;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--synthetic") && i + 1 < argc) {
+            synthetic = strtoul(argv[++i], nullptr, 10);
+        } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            seed = strtoul(argv[++i], nullptr, 10);
+        } else {
+            files.push_back(argv[i]);
+        }
+    }
+    if (!synthetic && files.empty()) {
+        synthetic = 1000;
+    }
+
+    Scale scale;
+    Totals& totals = scale.totals;
+
+    auto begin = std::chrono::steady_clock::now();
+    for (auto path : files) {
+        Visit visit;
+        if (loadVisit(path, visit)) {
+            replayVisit(visit, scale, true);
+        }
+    }
+    if (synthetic) {
+        replayDrift(scale, true);
+    }
+    for (uint32_t i = 0; i < synthetic; i++) {
+        replayVisit(createVisit(), scale, false);
+    }
+    double elapsed
+        = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    printf("{\"name\": \"replay\", \"visits\": %u, \"samples\": %u, \"entered\": %u, "
+           "\"measured\": %u, \"aborted\": %u, \"failed\": %u, \"live_messages\": %u, "
+           "\"max_weight_error_g\": %d, \"max_dropping_error_g\": %d, \"max_zero_error_g\": %d, "
+           "\"drift_corrections\": %u, \"step_corrections\": %u, \"seconds\": %.3f, "
+           "\"speedup\": %.0f}\n",
+        totals.visits, totals.samples, totals.entered, totals.measured, totals.aborted,
+        totals.failed, totals.liveMessages, totals.maxWeightError, totals.maxDroppingError,
+        totals.maxZeroError, scale.zeroTracker.getDriftCorrections(),
+        scale.zeroTracker.getStepCorrections(), elapsed,
+        elapsed > 0 ? totals.virtualMs / 1000. / elapsed : 0.);
+    return totals.failed ? 1 : 0;
+}
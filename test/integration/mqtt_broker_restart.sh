@@ -0,0 +1,135 @@
+#!/bin/bash
+# Broker restart test of the MQTT outbox against a real scale and a local mosquitto.
+#
+# Needs mosquitto, mosquitto_sub and curl on this machine and a scale with the test endpoint:
+#   pio run -e esp32s2_mqtt_test -t upload
+# usage: test/integration/mqtt_broker_restart.sh <scale address> <address of this machine> [port]
+#
+# 1. measurements reach a running broker
+# 2. the broker is frozen (SIGSTOP) and the connection is half-open: the published batch must
+#    not count as delivered, the scale has to miss the confirmation and reconnect
+# 3. the frozen broker is killed and measurements are queued while it is down
+# 4. after the restart every measurement of 2 and 3 arrives
+#
+# The MQTT settings of the scale are changed for the test and restored afterwards.
+
+SCALE=$1
+HOST=$2
+PORT=${3:-18830}
+TOPIC="weight-whiskers/test/$$"
+WORK=$(mktemp -d)
+BROKER=""
+SUBSCRIBER=""
+
+fail() {
+    echo "FAIL: $1"
+    exit 1
+}
+
+cleanup() {
+    if [ -n "${BROKER}" ]; then
+        kill -CONT ${BROKER} 2>/dev/null
+        kill ${BROKER} 2>/dev/null
+    fi
+    if [ -n "${SUBSCRIBER}" ]; then
+        kill ${SUBSCRIBER} 2>/dev/null
+    fi
+    if [ -f ${WORK}/config.json ]; then
+        curl -sf -X POST -H "Content-Type: application/json" --data @${WORK}/config.json \
+            "http://${SCALE}/api/config" >/dev/null || echo "Cannot restore the scale config"
+    fi
+    rm -r ${WORK}
+}
+trap cleanup EXIT
+
+start_broker() {
+    mosquitto -c ${WORK}/mosquitto.conf >>${WORK}/mosquitto.log 2>&1 &
+    BROKER=$!
+    sleep 1
+}
+
+# publishes count measurements with the weights first, first + 1, ...
+inject() {
+    curl -sf -X POST "http://${SCALE}/api/mqtt/test?count=$2&weight=$1" >/dev/null \
+        || fail "cannot queue measurements $1-$(($1 + $2 - 1))"
+}
+
+# waits until the weights first, first + 1, ... were received
+wait_for() {
+    for ((t = 0; t < $3; t++)); do
+        missing=0
+        for ((w = $1; w < $1 + $2; w++)); do
+            grep -q "value=${w}," ${WORK}/received || missing=$((missing + 1))
+        done
+        if [ ${missing} = 0 ]; then
+            return 0
+        fi
+        sleep 1
+    done
+    echo "${missing} of the measurements $1-$(($1 + $2 - 1)) are missing"
+    return 1
+}
+
+metric() {
+    curl -sf "http://${SCALE}/api/metrics" | awk -v name="weightwhiskers_$1" '$1 == name { print $2 }'
+}
+
+if [ $# -lt 2 ]; then
+    echo "usage: $0 <scale address> <address of this machine> [port]"
+    exit 2
+fi
+
+# keep the subscription and queue messages for it over the broker restart
+cat >${WORK}/mosquitto.conf <<EOF
+listener ${PORT}
+allow_anonymous true
+persistence true
+persistence_location ${WORK}/
+autosave_interval 1
+queue_qos0_messages true
+EOF
+start_broker
+touch ${WORK}/received
+# mosquitto_sub exits if the broker is gone, it resumes its session after the restart
+(
+    while true; do
+        mosquitto_sub -h 127.0.0.1 -p ${PORT} -t ${TOPIC} -q 1 -c -i weight-whiskers-test \
+            >>${WORK}/received 2>/dev/null
+        sleep 1
+    done
+) &
+SUBSCRIBER=$!
+
+curl -sf "http://${SCALE}/api/config" -o ${WORK}/config.json || fail "scale not reachable"
+curl -sf -X POST -H "Content-Type: application/json" \
+    --data "{\"mqttEnabled\": true, \"mqttServer\": \"${HOST}\", \"mqttPort\": ${PORT}, \"mqttTopicCatWeight\": \"${TOPIC}\"}" \
+    "http://${SCALE}/api/config" >/dev/null || fail "cannot configure MQTT"
+sleep 5
+
+echo "Running broker"
+inject 1000 5
+wait_for 1000 5 30 || fail "measurements not delivered to a running broker"
+
+echo "Frozen broker"
+timeouts=$(metric mqtt_confirm_timeouts_total)
+kill -STOP ${BROKER}
+inject 2000 5
+# MQTT_CONFIRM_TIMEOUT_MS and some margin
+sleep 10
+[ "$(metric mqtt_confirm_timeouts_total)" -gt "${timeouts}" ] \
+    || fail "the batch to the frozen broker was confirmed"
+[ "$(metric mqtt_pending)" -ge 5 ] || fail "unconfirmed measurements left the outbox"
+
+echo "Broker down"
+kill -KILL ${BROKER}
+inject 3000 5
+sleep 5
+
+echo "Broker restarted"
+start_broker
+wait_for 2000 5 120 || fail "measurements of the frozen broker lost"
+wait_for 3000 5 30 || fail "measurements queued while the broker was down lost"
+sleep 2
+[ "$(metric mqtt_pending)" = 0 ] || fail "measurements left in the outbox"
+
+echo "PASS"
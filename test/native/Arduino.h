@@ -0,0 +1,100 @@
+#pragma once
+
+/**
+ * Arduino API for the host tests (env:native_test), only what the tested sources use
+ *
+ * ArduinoJson uses String, Print and Stream from here with
+ * ARDUINOJSON_ENABLE_ARDUINO_STRING/STREAM/PRINT set in platformio.ini.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+
+#define ESP_LOGE(tag, ...) (void)0
+#define ESP_LOGW(tag, ...) (void)0
+#define ESP_LOGI(tag, ...) (void)0
+#define ESP_LOGD(tag, ...) (void)0
+#define ESP_LOGV(tag, ...) (void)0
+
+inline unsigned long micros()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+inline unsigned long millis() { return micros() / 1000; }
+
+class String
+{
+public:
+    String(const char* text = "")
+        : text(text ? text : "")
+    {
+    }
+
+    const char* c_str() const { return text.c_str(); }
+    size_t length() const { return text.size(); }
+    bool concat(const char* more)
+    {
+        text += more;
+        return true;
+    }
+    bool operator==(const String& other) const { return text == other.text; }
+    bool operator!=(const String& other) const { return text != other.text; }
+
+protected:
+    std::string text;
+};
+
+class Print
+{
+public:
+    virtual ~Print() = default;
+
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size)
+    {
+        size_t written = 0;
+        while (written < size && write(buffer[written])) {
+            written++;
+        }
+        return written;
+    }
+    size_t print(const char* text) { return write((const uint8_t*)text, strlen(text)); }
+    size_t printf(const char* format, ...)
+    {
+        char buffer[256];
+        va_list arguments;
+        va_start(arguments, format);
+        int length = vsnprintf(buffer, sizeof(buffer), format, arguments);
+        va_end(arguments);
+        if (length < 0) {
+            return 0;
+        }
+        return write((const uint8_t*)buffer, std::min((size_t)length, sizeof(buffer) - 1));
+    }
+};
+
+class Stream : public Print
+{
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+
+    size_t readBytes(char* buffer, size_t length)
+    {
+        size_t count = 0;
+        int c;
+        while (count < length && (c = read()) >= 0) {
+            buffer[count++] = (char)c;
+        }
+        return count;
+    }
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+/**
+ * NVS Preferences for the host tests, the values are shared by all instances like the flash
+ *
+ * tornWrite simulates a power loss in the middle of the next putBytes: only that many bytes of
+ * the new value end up over the old one and the write fails.
+ */
+
+#include <map>
+#include <string>
+#include <vector>
+#include "Arduino.h"
+
+class Preferences
+{
+public:
+    // "namespace/key" to value
+    inline static std::map<std::string, std::vector<uint8_t>> storage;
+    // bytes written by the next putBytes before the power fails, -1 writes everything
+    inline static int tornWrite = -1;
+
+    bool begin(const char* name, bool readOnly = false, const char* partition = nullptr)
+    {
+        (void)readOnly;
+        (void)partition;
+        prefix = std::string(name) + "/";
+        return true;
+    }
+
+    void end() { }
+
+    size_t putBytes(const char* key, const void* value, size_t length)
+    {
+        std::vector<uint8_t>& stored = storage[prefix + key];
+        const uint8_t* bytes = (const uint8_t*)value;
+        if (tornWrite < 0) {
+            stored.assign(bytes, bytes + length);
+            return length;
+        }
+        // the new length with the start of the new value, the rest is what was there before
+        stored.resize(length, 0xff);
+        std::copy(bytes, bytes + std::min((size_t)tornWrite, length), stored.begin());
+        tornWrite = -1;
+        return 0;
+    }
+
+    size_t getBytesLength(const char* key)
+    {
+        auto value = storage.find(prefix + key);
+        return value != storage.end() ? value->second.size() : 0;
+    }
+
+    size_t getBytes(const char* key, void* buffer, size_t length)
+    {
+        auto value = storage.find(prefix + key);
+        if (value == storage.end() || value->second.size() > length) {
+            return 0;
+        }
+        std::copy(value->second.begin(), value->second.end(), (uint8_t*)buffer);
+        return value->second.size();
+    }
+
+protected:
+    std::string prefix;
+};
@@ -0,0 +1,282 @@
+/**
+ * Every field of the config table through the binary storage encoding and JSON
+ *
+ *   pio test -e native_test -f test_config
+ */
+#include <math.h>
+#include <unity.h>
+#include <string>
+#include <vector>
+#include "Config.h"
+
+using namespace weightwhiskers;
+
+namespace
+{
+
+    class TextPrint : public Print
+    {
+    public:
+        size_t write(uint8_t c) override
+        {
+            text += (char)c;
+            return 1;
+        }
+
+        std::string text;
+    };
+
+    class TextStream : public Stream
+    {
+    public:
+        TextStream(const std::string& text)
+            : text(text)
+        {
+        }
+
+        int available() override { return text.size() - position; }
+        int read() override { return position < text.size() ? (uint8_t)text[position++] : -1; }
+        size_t write(uint8_t) override { return 0; }
+
+    protected:
+        std::string text;
+        size_t position = 0;
+    };
+
+    const ConfigField* fields = nullptr;
+    size_t fieldCount = 0;
+
+    /**
+     * @brief a valid value that differs from the default and from the other fields
+     */
+    void setChanged(const ConfigField& field, size_t index, Config& config)
+    {
+        switch (field.type) {
+        case ConfigField::Type::Bool:
+            config.*field.boolean = field.defaultNumber == 0;
+            break;
+        case ConfigField::Type::Int:
+            config.*field.integer = field.defaultNumber != field.maximum ? field.maximum
+                                                                         : field.minimum;
+            break;
+        case ConfigField::Type::Float:
+            config.*field.real = field.defaultNumber != field.maximum ? field.maximum
+                                                                      : field.minimum;
+            break;
+        case ConfigField::Type::Text: {
+            // the longest allowed text, starting with the key
+            std::string text = field.key;
+            while (text.size() < field.maximum) {
+                text += (char)('a' + (index + text.size()) % 26);
+            }
+            text.resize(field.maximum);
+            config.*field.string = text.c_str();
+            break;
+        }
+        }
+    }
+
+    Config changedConfig()
+    {
+        Config config;
+        for (size_t i = 0; i < fieldCount; i++) {
+            setChanged(fields[i], i, config);
+        }
+        return config;
+    }
+
+    bool isEqual(const ConfigField& field, const Config& a, const Config& b)
+    {
+        switch (field.type) {
+        case ConfigField::Type::Bool:
+            return a.*field.boolean == b.*field.boolean;
+        case ConfigField::Type::Int:
+            return a.*field.integer == b.*field.integer;
+        case ConfigField::Type::Float:
+            return a.*field.real == b.*field.real;
+        case ConfigField::Type::Text:
+            return a.*field.string == b.*field.string;
+        }
+        return false;
+    }
+
+    // JSON of the default value
+    std::string defaultJson(const ConfigField& field)
+    {
+        switch (field.type) {
+        case ConfigField::Type::Bool:
+            return field.defaultNumber ? "true" : "false";
+        case ConfigField::Type::Int:
+            return std::to_string((int)field.defaultNumber);
+        case ConfigField::Type::Float:
+            return std::to_string(field.defaultNumber);
+        case ConfigField::Type::Text:
+            return std::string("\"") + field.defaultText + "\"";
+        }
+        return "null";
+    }
+
+    // JSON values outside the valid range or of the wrong type
+    std::vector<std::string> invalidJson(const ConfigField& field)
+    {
+        switch (field.type) {
+        case ConfigField::Type::Bool:
+            return { "1", "\"true\"" };
+        case ConfigField::Type::Int:
+        case ConfigField::Type::Float:
+            return { std::to_string((long)field.maximum + 1),
+                std::to_string((long)field.minimum - 1), "\"1\"" };
+        case ConfigField::Type::Text:
+            return { "\"" + std::string((size_t)field.maximum + 1, 'x') + "\"", "1" };
+        }
+        return {};
+    }
+
+    void assertField(const ConfigField& field, const Config& expected, const Config& actual)
+    {
+        switch (field.type) {
+        case ConfigField::Type::Bool:
+            TEST_ASSERT_EQUAL_MESSAGE(expected.*field.boolean, actual.*field.boolean, field.key);
+            break;
+        case ConfigField::Type::Int:
+            TEST_ASSERT_EQUAL_INT_MESSAGE(
+                expected.*field.integer, actual.*field.integer, field.key);
+            break;
+        case ConfigField::Type::Float:
+            TEST_ASSERT_FLOAT_WITHIN_MESSAGE(fabsf(expected.*field.real) * 1e-6f,
+                expected.*field.real, actual.*field.real, field.key);
+            break;
+        case ConfigField::Type::Text:
+            TEST_ASSERT_EQUAL_STRING_MESSAGE(
+                (expected.*field.string).c_str(), (actual.*field.string).c_str(), field.key);
+            break;
+        }
+    }
+
+    void assertConfig(const Config& expected, const Config& actual)
+    {
+        for (size_t i = 0; i < fieldCount; i++) {
+            assertField(fields[i], expected, actual);
+        }
+    }
+
+}
+
+void setUp() { fields = ConfigSchema::getFields(fieldCount); }
+
+void tearDown() { }
+
+void test_changed_config_differs_in_every_field()
+{
+    Config defaults;
+    Config changed = changedConfig();
+    for (size_t i = 0; i < fieldCount; i++) {
+        TEST_ASSERT_FALSE_MESSAGE(isEqual(fields[i], defaults, changed), fields[i].key);
+    }
+}
+
+void test_encoding_round_trips_every_field()
+{
+    Config changed = changedConfig();
+    uint8_t buffer[CONFIG_ENCODED_SIZE];
+    size_t size = ConfigSchema::encode(changed, buffer, sizeof(buffer));
+    TEST_ASSERT_GREATER_THAN(0, size);
+    Config decoded;
+    TEST_ASSERT_TRUE(ConfigSchema::decode(buffer, size, decoded));
+    assertConfig(changed, decoded);
+}
+
+void test_json_round_trips_every_field()
+{
+    Config changed = changedConfig();
+    TextPrint json;
+    ConfigSchema::serialize(changed, json);
+    Config parsed;
+    TEST_ASSERT_NULL(
+        ConfigSchema::parse((const uint8_t*)json.text.data(), json.text.size(), parsed));
+    assertConfig(changed, parsed);
+}
+
+void test_json_file_round_trips_every_field()
+{
+    Config changed = changedConfig();
+    TextPrint json;
+    ConfigSchema::serialize(changed, json);
+    TextStream file(json.text);
+    Config loaded;
+    TEST_ASSERT_TRUE(ConfigSchema::load(file, loaded));
+    assertConfig(changed, loaded);
+}
+
+void test_parse_rejects_invalid_values_without_changes()
+{
+    Config changed = changedConfig();
+    for (size_t i = 0; i < fieldCount; i++) {
+        for (auto& value : invalidJson(fields[i])) {
+            // valid defaults of all other fields must not be applied either
+            std::string json = "{";
+            for (size_t j = 0; j < fieldCount; j++) {
+                json += std::string(j ? ", \"" : "\"") + fields[j].key + "\": ";
+                json += j == i ? value : defaultJson(fields[j]);
+            }
+            json += "}";
+            Config parsed = changed;
+            const char* invalid
+                = ConfigSchema::parse((const uint8_t*)json.data(), json.size(), parsed);
+            TEST_ASSERT_EQUAL_STRING_MESSAGE(fields[i].key, invalid, json.c_str());
+            assertConfig(changed, parsed);
+        }
+    }
+}
+
+void test_older_encoding_keeps_new_fields()
+{
+    // written before the last field was appended to the table
+    uint8_t buffer[CONFIG_ENCODED_SIZE];
+    size_t size = ConfigSchema::encode(Config(), buffer, sizeof(buffer));
+    const ConfigField& last = fields[fieldCount - 1];
+    switch (last.type) {
+    case ConfigField::Type::Bool:
+        size -= 1;
+        break;
+    case ConfigField::Type::Int:
+    case ConfigField::Type::Float:
+        size -= 4;
+        break;
+    case ConfigField::Type::Text:
+        size -= 1 + strlen(last.defaultText);
+        break;
+    }
+    buffer[0] = fieldCount - 1;
+    Config changed = changedConfig();
+    Config decoded = changed;
+    TEST_ASSERT_TRUE(ConfigSchema::decode(buffer, size, decoded));
+    for (size_t i = 0; i + 1 < fieldCount; i++) {
+        assertField(fields[i], Config(), decoded);
+    }
+    assertField(last, changed, decoded);
+}
+
+void test_truncated_encoding_is_rejected()
+{
+    Config changed = changedConfig();
+    uint8_t buffer[CONFIG_ENCODED_SIZE];
+    size_t size = ConfigSchema::encode(changed, buffer, sizeof(buffer));
+    for (size_t length = 0; length < size; length++) {
+        Config decoded;
+        TEST_ASSERT_FALSE(ConfigSchema::decode(buffer, length, decoded));
+    }
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_changed_config_differs_in_every_field);
+    RUN_TEST(test_encoding_round_trips_every_field);
+    RUN_TEST(test_json_round_trips_every_field);
+    RUN_TEST(test_json_file_round_trips_every_field);
+    RUN_TEST(test_parse_rejects_invalid_values_without_changes);
+    RUN_TEST(test_older_encoding_keeps_new_fields);
+    RUN_TEST(test_truncated_encoding_is_rejected);
+    return UNITY_END();
+}
@@ -0,0 +1,141 @@
+/**
+ * ConfigStore after a power loss at every byte of a save, with the NVS in memory
+ *
+ *   pio test -e native_test -f test_config_store
+ */
+#include <unity.h>
+#include "ConfigStore.h"
+
+using namespace weightwhiskers;
+
+namespace
+{
+
+    Config configWithWeight(int weight)
+    {
+        Config config;
+        config.scale_weight_min = weight;
+        config.mqtt_server = ("server" + std::to_string(weight)).c_str();
+        return config;
+    }
+
+    void assertWeight(int weight, const Config& config)
+    {
+        TEST_ASSERT_EQUAL_INT(weight, config.scale_weight_min);
+        TEST_ASSERT_EQUAL_STRING(("server" + std::to_string(weight)).c_str(),
+            config.mqtt_server.c_str());
+    }
+
+    // loads the config like after a reboot, false if nothing valid is stored
+    bool reboot(ConfigStore& store, Config& config)
+    {
+        store = ConfigStore();
+        TEST_ASSERT_TRUE(store.begin());
+        return store.load(config);
+    }
+
+    size_t savedSize(const Config& config)
+    {
+        uint8_t buffer[CONFIG_ENCODED_SIZE];
+        return sizeof(ConfigStoreHeader) + ConfigSchema::encode(config, buffer, sizeof(buffer));
+    }
+
+}
+
+void setUp()
+{
+    Preferences::storage.clear();
+    Preferences::tornWrite = -1;
+}
+
+void tearDown() { }
+
+void test_load_without_config_fails()
+{
+    ConfigStore store;
+    Config config = configWithWeight(1000);
+    TEST_ASSERT_FALSE(reboot(store, config));
+    assertWeight(1000, config);
+}
+
+void test_load_returns_newest_save()
+{
+    ConfigStore store;
+    Config config;
+    TEST_ASSERT_FALSE(reboot(store, config));
+    for (int weight = 1000; weight < 1005; weight++) {
+        TEST_ASSERT_TRUE(store.save(configWithWeight(weight)));
+        Config loaded;
+        TEST_ASSERT_TRUE(reboot(store, loaded));
+        assertWeight(weight, loaded);
+    }
+}
+
+void test_power_loss_during_save_keeps_previous_config()
+{
+    ConfigStore store;
+    Config config;
+    reboot(store, config);
+    TEST_ASSERT_TRUE(store.save(configWithWeight(1000)));
+    TEST_ASSERT_TRUE(store.save(configWithWeight(2000)));
+    auto saved = Preferences::storage;
+
+    Config next = configWithWeight(3000);
+    size_t size = savedSize(next);
+    for (size_t written = 0; written < size; written++) {
+        Preferences::storage = saved;
+        Config loaded;
+        TEST_ASSERT_TRUE(reboot(store, loaded));
+        Preferences::tornWrite = written;
+        TEST_ASSERT_FALSE(store.save(next));
+
+        // the torn slot is skipped and the previous config loaded, unless the bytes that
+        // weren't written already matched, never the older or a mixed config
+        TEST_ASSERT_TRUE(reboot(store, loaded));
+        assertWeight(loaded.scale_weight_min == 3000 ? 3000 : 2000, loaded);
+
+        // and the next save after the power loss succeeds
+        TEST_ASSERT_TRUE(store.save(next));
+        TEST_ASSERT_TRUE(reboot(store, loaded));
+        assertWeight(3000, loaded);
+    }
+}
+
+void test_power_loss_during_first_save()
+{
+    ConfigStore store;
+    Config config = configWithWeight(1000);
+    reboot(store, config);
+    Preferences::tornWrite = savedSize(config) / 2;
+    TEST_ASSERT_FALSE(store.save(config));
+    Config loaded = configWithWeight(2000);
+    TEST_ASSERT_FALSE(reboot(store, loaded));
+    assertWeight(2000, loaded);
+}
+
+void test_failed_save_keeps_slot_of_current_config()
+{
+    // a save that failed must not make the next save overwrite the current config
+    ConfigStore store;
+    Config config;
+    reboot(store, config);
+    TEST_ASSERT_TRUE(store.save(configWithWeight(1000)));
+    Preferences::tornWrite = 4;
+    TEST_ASSERT_FALSE(store.save(configWithWeight(2000)));
+    Preferences::tornWrite = 4;
+    TEST_ASSERT_FALSE(store.save(configWithWeight(3000)));
+    Config loaded;
+    TEST_ASSERT_TRUE(reboot(store, loaded));
+    assertWeight(1000, loaded);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_load_without_config_fails);
+    RUN_TEST(test_load_returns_newest_save);
+    RUN_TEST(test_power_loss_during_save_keeps_previous_config);
+    RUN_TEST(test_power_loss_during_first_save);
+    RUN_TEST(test_failed_save_keeps_slot_of_current_config);
+    return UNITY_END();
+}
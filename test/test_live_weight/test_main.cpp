@@ -0,0 +1,161 @@
+/**
+ * Publish rules of the live weight and the message count of replayed visits
+ *
+ *   pio test -e native_test -f test_live_weight
+ */
+#include <math.h>
+#include <unity.h>
+#include <memory>
+#include "LiveWeightPublisher.h"
+#include "replay/Replay.h"
+
+#define TEST_VISITS 100
+
+using namespace weightwhiskers;
+using namespace weightwhiskers::replay;
+
+namespace
+{
+
+    LiveWeightConfig config;
+
+    LiveWeightPublisher createPublisher()
+    {
+        LiveWeightPublisher publisher;
+        publisher.setConfig(config);
+        return publisher;
+    }
+
+}
+
+void setUp()
+{
+    config = LiveWeightConfig();
+    seed = 1;
+}
+
+void tearDown() { }
+
+void test_first_sample_is_published()
+{
+    LiveWeightPublisher publisher = createPublisher();
+    TEST_ASSERT_TRUE(publisher.update(5000, toFixed(12), false));
+    TEST_ASSERT_EQUAL_INT32(toFixed(12), publisher.getWeight());
+    TEST_ASSERT_FALSE(publisher.isOccupied());
+}
+
+void test_change_within_deadband_is_not_published()
+{
+    LiveWeightPublisher publisher = createPublisher();
+    publisher.update(0, 0, false);
+    for (uint32_t t = 100; t < config.maxIntervalMs; t += 100) {
+        fixed_t weight = t % 200 ? config.deadband : -config.deadband;
+        TEST_ASSERT_FALSE(publisher.update(t, weight, false));
+    }
+    TEST_ASSERT_EQUAL_INT32(0, publisher.getWeight());
+}
+
+void test_change_is_published_after_min_interval()
+{
+    LiveWeightPublisher publisher = createPublisher();
+    publisher.update(0, 0, false);
+    fixed_t weight = config.deadband + 1;
+    TEST_ASSERT_FALSE(publisher.update(config.minIntervalMs - 1, weight, false));
+    TEST_ASSERT_TRUE(publisher.update(config.minIntervalMs, weight, false));
+    TEST_ASSERT_EQUAL_INT32(weight, publisher.getWeight());
+    // the deadband is relative to the last published weight
+    TEST_ASSERT_FALSE(publisher.update(2 * config.minIntervalMs, 2 * weight - 1, false));
+    TEST_ASSERT_TRUE(publisher.update(2 * config.minIntervalMs, -1, false));
+}
+
+void test_weight_is_published_every_max_interval()
+{
+    LiveWeightPublisher publisher = createPublisher();
+    publisher.update(0, 0, false);
+    TEST_ASSERT_FALSE(publisher.update(config.maxIntervalMs - 1, 0, false));
+    TEST_ASSERT_TRUE(publisher.update(config.maxIntervalMs, 0, false));
+    TEST_ASSERT_TRUE(publisher.update(2 * config.maxIntervalMs, 0, false));
+}
+
+void test_occupied_change_is_published_immediately()
+{
+    LiveWeightPublisher publisher = createPublisher();
+    publisher.update(0, 0, false);
+    TEST_ASSERT_TRUE(publisher.update(1, 0, true));
+    TEST_ASSERT_TRUE(publisher.isOccupied());
+    TEST_ASSERT_FALSE(publisher.update(2, 0, true));
+    TEST_ASSERT_TRUE(publisher.update(3, 0, false));
+    TEST_ASSERT_FALSE(publisher.isOccupied());
+}
+
+void test_timestamp_wrap_keeps_intervals()
+{
+    LiveWeightPublisher publisher = createPublisher();
+    uint32_t start = UINT32_MAX - 100;
+    publisher.update(start, 0, false);
+    TEST_ASSERT_FALSE(publisher.update(start + config.minIntervalMs / 2, toFixed(1000), false));
+    TEST_ASSERT_TRUE(publisher.update(start + config.minIntervalMs, toFixed(1000), false));
+}
+
+void test_replayed_visits_stay_within_message_bounds()
+{
+    auto scale = std::make_unique<Scale>();
+    uint32_t messages = 0;
+    uint32_t transitions = 0;
+    uint32_t lastMessage = 0;
+    bool occupied = false;
+    auto process = [&](uint32_t timestamp, float weight) {
+        scale->clock.advance(timestamp - scale->clock.now());
+        int32_t raw = REPLAY_OFFSET + (int32_t)lroundf(weight * REPLAY_SCALE);
+        auto result = scale->pipeline.process(timestamp, raw);
+        if (result.occupied != occupied) {
+            // every transition is published with the sample that caused it
+            TEST_ASSERT_TRUE_MESSAGE(result.publishWeight, "transition not published");
+            transitions++;
+            occupied = result.occupied;
+        }
+        if (result.publishWeight) {
+            if (messages) {
+                TEST_ASSERT_LESS_OR_EQUAL_UINT32(config.maxIntervalMs, timestamp - lastMessage);
+            }
+            messages++;
+            lastMessage = timestamp;
+        }
+    };
+
+    for (uint32_t i = 0; i < TEST_VISITS; i++) {
+        Visit visit = createVisit();
+        uint32_t start = scale->clock.now();
+        uint32_t visitMessages = messages;
+        uint32_t visitTransitions = transitions;
+        for (uint32_t t = 0; t < REPLAY_IDLE_BEFORE_MS; t += REPLAY_SAMPLE_PERIOD_MS) {
+            process(scale->clock.now() + REPLAY_SAMPLE_PERIOD_MS, 0.f);
+        }
+        uint32_t offset = scale->clock.now() + REPLAY_SAMPLE_PERIOD_MS;
+        for (auto& sample : visit.samples) {
+            process(offset + sample.timestamp, sample.weight);
+        }
+        visitMessages = messages - visitMessages;
+        visitTransitions = transitions - visitTransitions;
+        uint32_t duration = scale->clock.now() - start;
+
+        // the cat entered and left
+        TEST_ASSERT_GREATER_OR_EQUAL_UINT32(2, visitTransitions);
+        TEST_ASSERT_LESS_OR_EQUAL_UINT32(
+            duration / config.minIntervalMs + visitTransitions + 1, visitMessages);
+        TEST_ASSERT_GREATER_OR_EQUAL_UINT32(duration / config.maxIntervalMs, visitMessages);
+    }
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_first_sample_is_published);
+    RUN_TEST(test_change_within_deadband_is_not_published);
+    RUN_TEST(test_change_is_published_after_min_interval);
+    RUN_TEST(test_weight_is_published_every_max_interval);
+    RUN_TEST(test_occupied_change_is_published_immediately);
+    RUN_TEST(test_timestamp_wrap_keeps_intervals);
+    RUN_TEST(test_replayed_visits_stay_within_message_bounds);
+    return UNITY_END();
+}
@@ -0,0 +1,132 @@
+/**
+ * CSV upload parsing with rows split at every position and malformed rows at chunk ends
+ *
+ *   pio test -e native_test -f test_measurement_csv
+ */
+#include <unity.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "MeasurementRecord.h"
+
+using namespace weightwhiskers;
+
+namespace
+{
+
+    MeasurementCsvParser parser;
+    std::vector<MeasurementRecord> records;
+
+    // the chunk is not terminated like the upload handler's data, the bytes behind it are
+    // the next chunk that the parser must not read yet
+    void input(const std::string& chunk, const std::string& behind = "")
+    {
+        std::unique_ptr<char[]> buffer(new char[chunk.size() + behind.size()]);
+        memcpy(buffer.get(), chunk.data(), chunk.size());
+        memcpy(buffer.get() + chunk.size(), behind.data(), behind.size());
+        parser.input(buffer.get(), chunk.size(),
+            [](const MeasurementRecord& record) { records.push_back(record); });
+    }
+
+    void finish()
+    {
+        parser.finish([](const MeasurementRecord& record) { records.push_back(record); });
+    }
+
+}
+
+void setUp()
+{
+    parser.reset();
+    records.clear();
+}
+
+void tearDown() { }
+
+void test_rows_split_between_chunks_are_parsed()
+{
+    const std::string csv = MEASUREMENT_CSV_HEADER "\n"
+                                                   "1700000000,4000,12.50,30.00,20\n"
+                                                   "1700000100,4100,1.25,45.50\r\n"
+                                                   "1700000200,4200,0.00,10.00,0";
+    for (size_t split = 0; split <= csv.size(); split++) {
+        setUp();
+        input(csv.substr(0, split));
+        input(csv.substr(split));
+        finish();
+        TEST_ASSERT_EQUAL_UINT32(3, records.size());
+        TEST_ASSERT_EQUAL_UINT32(0, parser.getRejected());
+        TEST_ASSERT_EQUAL_UINT32(1700000000, records[0].time);
+        TEST_ASSERT_EQUAL_UINT16(4000, records[0].weight);
+        TEST_ASSERT_EQUAL_FLOAT(12.5f, records[0].std);
+        TEST_ASSERT_EQUAL_FLOAT(30.f, records[0].duration);
+        TEST_ASSERT_EQUAL_UINT16(20, records[0].weightDropping);
+        TEST_ASSERT_EQUAL_UINT16(0, records[1].weightDropping);
+        TEST_ASSERT_EQUAL_FLOAT(45.5f, records[1].duration);
+        TEST_ASSERT_EQUAL_UINT32(1700000200, records[2].time);
+        TEST_ASSERT_TRUE(records[2].isValid());
+    }
+}
+
+void test_empty_field_at_chunk_end_is_rejected()
+{
+    // strtof would skip the line break and read past the end of the chunk
+    input("1700000000,4000,\n", "12.5,30.0\n");
+    input("1700000100,4000,1.00,\n", "30.0\n");
+    input("1700000200,4000, \n", "12.5,30.0\n");
+    finish();
+    TEST_ASSERT_EQUAL_UINT32(0, records.size());
+    TEST_ASSERT_EQUAL_UINT32(3, parser.getRejected());
+}
+
+void test_empty_field_does_not_parse_the_next_line()
+{
+    input("1700000000,4000,\n12.5,30.0\n1700000100,4100,1.00,2.00\n");
+    finish();
+    TEST_ASSERT_EQUAL_UINT32(1, records.size());
+    TEST_ASSERT_EQUAL_UINT32(1700000100, records[0].time);
+    TEST_ASSERT_EQUAL_UINT32(2, parser.getRejected());
+}
+
+void test_invalid_numbers_are_rejected()
+{
+    input("1700000000,-1,1.00,2.00\n"
+          "1700000000,70000,1.00,2.00\n"
+          "1700000000,4000,nan,2.00\n"
+          "1700000000,4000,1.00,inf\n"
+          "1700000000,4000,1.00,2.00,-5\n"
+          "0,4000,1.00,2.00\n"
+          "1700000000,4000,1.00,2.00x\n");
+    finish();
+    TEST_ASSERT_EQUAL_UINT32(0, records.size());
+    TEST_ASSERT_EQUAL_UINT32(7, parser.getRejected());
+}
+
+void test_older_rows_are_rejected()
+{
+    input("1700000100,4000,1.00,2.00\n1700000000,4000,1.00,2.00\n1700000100,4000,1.00,2.00\n");
+    finish();
+    TEST_ASSERT_EQUAL_UINT32(2, records.size());
+    TEST_ASSERT_EQUAL_UINT32(1, parser.getRejected());
+}
+
+void test_overlong_line_is_rejected()
+{
+    input("1700000000,4000,1.00," + std::string(MEASUREMENT_CSV_LINE_LENGTH, '1'));
+    input("\n1700000100,4000,1.00,2.00\n");
+    finish();
+    TEST_ASSERT_EQUAL_UINT32(1, records.size());
+    TEST_ASSERT_EQUAL_UINT32(1, parser.getRejected());
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_rows_split_between_chunks_are_parsed);
+    RUN_TEST(test_empty_field_at_chunk_end_is_rejected);
+    RUN_TEST(test_empty_field_does_not_parse_the_next_line);
+    RUN_TEST(test_invalid_numbers_are_rejected);
+    RUN_TEST(test_older_rows_are_rejected);
+    RUN_TEST(test_overlong_line_is_rejected);
+    return UNITY_END();
+}
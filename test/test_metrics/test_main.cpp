@@ -0,0 +1,117 @@
+/**
+ * Prometheus text export of the metrics
+ *
+ *   pio test -e native_test -f test_metrics
+ */
+#include <unity.h>
+#include <string>
+#include "Metrics.h"
+
+using namespace weightwhiskers;
+
+namespace
+{
+
+    class TextPrint : public Print
+    {
+    public:
+        size_t write(uint8_t c) override
+        {
+            text += (char)c;
+            return 1;
+        }
+
+        std::string text;
+    };
+
+    // registered during static initialization like the firmware's metrics
+    metrics::Counter counter("test_events_total", "Events counted by the test");
+    metrics::Gauge gauge("test_level", "Level set by the test");
+    metrics::Histogram histogram("test_seconds", "Latencies recorded by the test");
+
+    std::string writeAll()
+    {
+        TextPrint out;
+        metrics::Metric::writeAll(out);
+        return out.text;
+    }
+
+    void assertContains(const std::string& expected, const std::string& text)
+    {
+        TEST_ASSERT_TRUE_MESSAGE(text.find(expected) != std::string::npos, expected.c_str());
+    }
+
+}
+
+void setUp() { }
+
+void tearDown() { }
+
+void test_counter_is_exported()
+{
+    counter.add();
+    counter.add(41);
+    assertContains("# HELP weightwhiskers_test_events_total Events counted by the test\n"
+                   "# TYPE weightwhiskers_test_events_total counter\n"
+                   "weightwhiskers_test_events_total 42\n",
+        writeAll());
+    counter.set(UINT32_MAX);
+    assertContains("weightwhiskers_test_events_total 4294967295\n", writeAll());
+}
+
+void test_gauge_is_exported_signed()
+{
+    gauge.set(-17);
+    assertContains("# HELP weightwhiskers_test_level Level set by the test\n"
+                   "# TYPE weightwhiskers_test_level gauge\n"
+                   "weightwhiskers_test_level -17\n",
+        writeAll());
+}
+
+void test_histogram_buckets_are_cumulative()
+{
+    // on the bound, above it, in a later bucket and beyond the last bound
+    histogram.record(100);
+    histogram.record(101);
+    histogram.record(40000);
+    histogram.record(6000000);
+    assertContains("# HELP weightwhiskers_test_seconds Latencies recorded by the test\n"
+                   "# TYPE weightwhiskers_test_seconds histogram\n"
+                   "weightwhiskers_test_seconds_bucket{le=\"0.0001\"} 1\n"
+                   "weightwhiskers_test_seconds_bucket{le=\"0.00025\"} 2\n"
+                   "weightwhiskers_test_seconds_bucket{le=\"0.0005\"} 2\n"
+                   "weightwhiskers_test_seconds_bucket{le=\"0.001\"} 2\n"
+                   "weightwhiskers_test_seconds_bucket{le=\"0.0025\"} 2\n"
+                   "weightwhiskers_test_seconds_bucket{le=\"0.005\"} 2\n"
+                   "weightwhiskers_test_seconds_bucket{le=\"0.01\"} 2\n"
+                   "weightwhiskers_test_seconds_bucket{le=\"0.025\"} 2\n"
+                   "weightwhiskers_test_seconds_bucket{le=\"0.05\"} 3\n"
+                   "weightwhiskers_test_seconds_bucket{le=\"0.1\"} 3\n"
+                   "weightwhiskers_test_seconds_bucket{le=\"0.5\"} 3\n"
+                   "weightwhiskers_test_seconds_bucket{le=\"5\"} 3\n"
+                   "weightwhiskers_test_seconds_bucket{le=\"+Inf\"} 4\n"
+                   "weightwhiskers_test_seconds_sum 6.040201\n"
+                   "weightwhiskers_test_seconds_count 4\n",
+        writeAll());
+}
+
+void test_every_metric_is_exported_once()
+{
+    std::string text = writeAll();
+    for (const char* name : { "test_events_total", "test_level", "test_seconds" }) {
+        std::string type = std::string("# TYPE weightwhiskers_") + name + " ";
+        size_t first = text.find(type);
+        TEST_ASSERT_TRUE_MESSAGE(first != std::string::npos, name);
+        TEST_ASSERT_TRUE_MESSAGE(text.find(type, first + 1) == std::string::npos, name);
+    }
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_counter_is_exported);
+    RUN_TEST(test_gauge_is_exported_signed);
+    RUN_TEST(test_histogram_buckets_are_cumulative);
+    RUN_TEST(test_every_metric_is_exported_once);
+    return UNITY_END();
+}
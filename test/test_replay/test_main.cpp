@@ -0,0 +1,92 @@
+/**
+ * Synthetic visits through the firmware's sample processing on a virtual clock
+ *
+ *   pio test -e native_test -f test_replay
+ */
+#include <unity.h>
+#include <memory>
+#include "replay/Replay.h"
+
+// enough visits to hit rare cases, still well below a second
+#define TEST_VISITS 500
+
+using namespace weightwhiskers;
+using namespace weightwhiskers::replay;
+
+void setUp() { seed = 1; }
+
+void tearDown() { }
+
+void test_synthetic_visits_are_measured()
+{
+    auto scale = std::make_unique<Scale>();
+    for (uint32_t i = 0; i < TEST_VISITS; i++) {
+        Visit visit = createVisit();
+        TEST_ASSERT_TRUE_MESSAGE(replayVisit(visit, *scale, false), "visit not measured");
+    }
+    const Totals& totals = scale->totals;
+    TEST_ASSERT_EQUAL_UINT32(TEST_VISITS, totals.entered);
+    TEST_ASSERT_EQUAL_UINT32(TEST_VISITS, totals.measured);
+    TEST_ASSERT_EQUAL_UINT32(0, totals.aborted);
+    TEST_ASSERT_EQUAL_UINT32(0, totals.failed);
+    TEST_ASSERT_LESS_OR_EQUAL(REPLAY_MAX_WEIGHT_ERROR_G, totals.maxWeightError);
+    TEST_ASSERT_LESS_OR_EQUAL(REPLAY_MAX_DROPPING_ERROR_G, totals.maxDroppingError);
+}
+
+void test_empty_scale_is_no_visit()
+{
+    auto scale = std::make_unique<Scale>();
+    // ten minutes of an empty scale with some vibration
+    Visit empty;
+    for (uint32_t t = 0; t < 600000; t += REPLAY_SAMPLE_PERIOD_MS) {
+        empty.samples.push_back({ t, (t / REPLAY_SAMPLE_PERIOD_MS) % 7 * 3.f - 9.f });
+    }
+    TEST_ASSERT_TRUE(replayVisit(empty, *scale, false));
+    TEST_ASSERT_EQUAL_UINT32(0, scale->totals.entered);
+    TEST_ASSERT_EQUAL_UINT32(0, scale->totals.measured);
+}
+
+void test_zero_follows_drift_and_litter()
+{
+    auto scale = std::make_unique<Scale>();
+    // includes a light load that still reads its weight after a minute
+    TEST_ASSERT_TRUE(replayDrift(*scale, false));
+    TEST_ASSERT_EQUAL_UINT32(0, scale->totals.failed);
+    TEST_ASSERT_LESS_OR_EQUAL(REPLAY_MAX_ZERO_ERROR_G, scale->totals.maxZeroError);
+    TEST_ASSERT_GREATER_THAN_UINT32(0, scale->zeroTracker.getDriftCorrections());
+    // litter added and removed
+    TEST_ASSERT_EQUAL_UINT32(2, scale->zeroTracker.getStepCorrections());
+    TEST_ASSERT_EQUAL_UINT32(0, scale->totals.entered);
+
+    // visits are measured from the tracked zero
+    for (uint32_t i = 0; i < 50; i++) {
+        TEST_ASSERT_TRUE(replayVisit(createVisit(), *scale, false));
+    }
+}
+
+void test_replay_is_deterministic()
+{
+    // the seed makes failures reproducible with the replay tool
+    auto first = std::make_unique<Scale>();
+    auto second = std::make_unique<Scale>();
+    for (uint32_t i = 0; i < 20; i++) {
+        replayVisit(createVisit(), *first, false);
+    }
+    seed = 1;
+    for (uint32_t i = 0; i < 20; i++) {
+        replayVisit(createVisit(), *second, false);
+    }
+    TEST_ASSERT_EQUAL_UINT32(first->totals.samples, second->totals.samples);
+    TEST_ASSERT_EQUAL_UINT32(first->totals.liveMessages, second->totals.liveMessages);
+    TEST_ASSERT_EQUAL_INT(first->totals.maxWeightError, second->totals.maxWeightError);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_synthetic_visits_are_measured);
+    RUN_TEST(test_empty_scale_is_no_visit);
+    RUN_TEST(test_zero_follows_drift_and_litter);
+    RUN_TEST(test_replay_is_deterministic);
+    return UNITY_END();
+}
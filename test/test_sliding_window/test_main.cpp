@@ -0,0 +1,172 @@
+/**
+ * SlidingWindowStatistics against a brute force computation over the same samples
+ *
+ *   pio test -e native_test -f test_sliding_window
+ */
+#include <math.h>
+#include <unity.h>
+#include <vector>
+#include "SlidingWindowStatistics.h"
+
+// accepted error of the mean in g and of the variance in g²
+#define TEST_MAX_MEAN_ERROR 0.01
+#define TEST_MAX_VARIANCE_ERROR 0.01
+
+using namespace weightwhiskers;
+
+namespace
+{
+
+    struct Sample {
+        fixed_t value;
+        uint32_t timestamp;
+    };
+
+    struct Reference {
+        size_t count = 0;
+        double mean = 0;
+        double variance = 0;
+    };
+
+    uint32_t seed = 1;
+
+    float randomUniform()
+    {
+        seed = seed * 1664525 + 1013904223;
+        return (seed >> 8) / (float)(1 << 24);
+    }
+
+    double toDouble(fixed64_t value) { return value / (double)FIXED_ONE; }
+
+    /**
+     * @brief window ending with samples[end - 1] by the eviction rules of the statistics:
+     * the newest sample and the ones younger than windowMs, at most windowSamples of them
+     */
+    Reference compute(
+        const std::vector<Sample>& samples, size_t end, size_t windowSamples, uint32_t windowMs)
+    {
+        Reference reference;
+        uint32_t now = samples[end - 1].timestamp;
+        size_t first = end - 1;
+        while (first > 0 && end - first < windowSamples
+            && (!windowMs || now - samples[first - 1].timestamp < windowMs)) {
+            first--;
+        }
+        reference.count = end - first;
+        for (size_t i = first; i < end; i++) {
+            reference.mean += toDouble(samples[i].value);
+        }
+        reference.mean /= reference.count;
+        for (size_t i = first; i < end; i++) {
+            double delta = toDouble(samples[i].value) - reference.mean;
+            reference.variance += delta * delta;
+        }
+        reference.variance /= reference.count;
+        return reference;
+    }
+
+    /**
+     * @brief empty scale, cat jumping in with steps of several kg, digging and sitting still
+     */
+    fixed_t visitWeight(uint32_t i)
+    {
+        float weight = 0;
+        if (i > 200 && i < 1800) {
+            weight = 4500.f + (i < 600 ? (randomUniform() - 0.5f) * 1200.f : 0.f);
+        }
+        return toFixed(weight + (randomUniform() - 0.5f) * 10.f);
+    }
+
+    template <size_t N>
+    void compare(SlidingWindowStatistics<N>& statistics, const std::vector<Sample>& samples,
+        size_t windowSamples, uint32_t windowMs)
+    {
+        double lowestVariance = INFINITY;
+        for (size_t i = 0; i < samples.size(); i++) {
+            statistics.input(samples[i].value, samples[i].timestamp);
+            Reference reference = compute(samples, i + 1, windowSamples, windowMs);
+            TEST_ASSERT_EQUAL_UINT32(reference.count, statistics.count());
+            TEST_ASSERT_FLOAT_WITHIN(
+                TEST_MAX_MEAN_ERROR, reference.mean, toDouble(statistics.mean()));
+            TEST_ASSERT_FLOAT_WITHIN(
+                TEST_MAX_VARIANCE_ERROR, reference.variance, toDouble(statistics.variance()));
+            if (statistics.isComplete() && reference.variance < lowestVariance) {
+                lowestVariance = reference.variance;
+            }
+        }
+        TEST_ASSERT_FLOAT_WITHIN(TEST_MAX_VARIANCE_ERROR, lowestVariance,
+            toDouble(statistics.getBestWindow().variance));
+    }
+
+}
+
+void setUp() { seed = 1; }
+
+void tearDown() { }
+
+void test_sample_window_matches_brute_force()
+{
+    static SlidingWindowStatistics<64> statistics;
+    statistics.setWindowSamples(50);
+    statistics.reset();
+    std::vector<Sample> samples;
+    for (uint32_t i = 0; i < 2000; i++) {
+        samples.push_back({ visitWeight(i), i * 100 });
+    }
+    compare(statistics, samples, 50, 0);
+}
+
+void test_time_window_with_gaps_matches_brute_force()
+{
+    static SlidingWindowStatistics<128> statistics;
+    statistics.setWindowMs(5000);
+    statistics.reset();
+    std::vector<Sample> samples;
+    uint32_t timestamp = 0;
+    for (uint32_t i = 0; i < 2000; i++) {
+        // jittered sample rate with some missed samples
+        timestamp += 50 + randomUniform() * 150 + (i % 97 == 0 ? 3000 : 0);
+        samples.push_back({ visitWeight(i), timestamp });
+    }
+    compare(statistics, samples, 128, 5000);
+}
+
+void test_capacity_limits_the_time_window()
+{
+    static SlidingWindowStatistics<16> statistics;
+    statistics.setWindowMs(60000);
+    statistics.reset();
+    std::vector<Sample> samples;
+    for (uint32_t i = 0; i < 500; i++) {
+        samples.push_back({ visitWeight(i * 4), i * 100 });
+    }
+    compare(statistics, samples, 16, 60000);
+}
+
+void test_reset_starts_over()
+{
+    static SlidingWindowStatistics<16> statistics;
+    statistics.setWindowSamples(8);
+    statistics.reset();
+    for (uint32_t i = 0; i < 100; i++) {
+        statistics.input(toFixed(5000), i * 100);
+    }
+    statistics.reset();
+    TEST_ASSERT_EQUAL_UINT32(0, statistics.count());
+    TEST_ASSERT_FALSE(statistics.isComplete());
+    TEST_ASSERT_TRUE(statistics.getBestWindow().variance == INT64_MAX);
+    statistics.input(toFixed(12), 0);
+    statistics.input(toFixed(14), 100);
+    TEST_ASSERT_EQUAL_INT32(toFixed(13), statistics.mean());
+    TEST_ASSERT_EQUAL_INT32(toFixed(1), statistics.variance());
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_sample_window_matches_brute_force);
+    RUN_TEST(test_time_window_with_gaps_matches_brute_force);
+    RUN_TEST(test_capacity_limits_the_time_window);
+    RUN_TEST(test_reset_starts_over);
+    return UNITY_END();
+}
@@ -11,5 +11,6 @@ export interface Config {
   scaleWeightMin: number | undefined;
   scaleTareTime: number | undefined;
   scaleTareThresh: number | undefined;
+  presenceTimeMin: number | undefined;
   scaleWeightDeviationPercent: number | undefined;
 }
\ No newline at end of file
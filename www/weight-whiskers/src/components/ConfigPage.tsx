@@ -60,6 +60,10 @@ const schema: RJSFSchema = {
       "type": "integer",
       "title": "Scale auto tare threshold (gram)"
     },
+    "presenceTimeMin": {
+      "type": "number",
+      "title": "Minimum presence time (s)"
+    },
     "scaleWeightDeviationPercent": {
       "type": "number",
       "title": "Weight deviation filter (0 = disabled)",
@@ -110,6 +114,7 @@ const ConfigPage = () => {
     scaleWeightMin: 0,
     scaleTareTime: 0,
     scaleTareThresh: 0,
+    presenceTimeMin: 5,
     scaleWeightDeviationPercent: 0
   }
 
@@ -1,10 +1,15 @@
 const HandleCSV = () => {
+    // result of the last upload, added by the redirect after the import
+    const params = new URLSearchParams(window.location.search);
+    const imported = params.get("imported");
+    const rejected = params.get("rejected");
     return <div>
         <a href="/api/measurements" className="button">Download measurements as CSV</a>
         <form action="/api/measurements" method="POST" encType="multipart/form-data">
             <input name="measurements" type="file" className="icon-upload" />
             <input type="submit" value="Upload CSV (will overwrite data)" />
         </form>
+        {imported !== null ? <p>Imported {imported} measurements, rejected {rejected} invalid rows</p> : null}
     </div>
 }
 
@@ -4,11 +4,50 @@ import { Datum, ResponsiveLine, Serie } from '@nivo/line'
 import { LoadingImage } from "./Loading";
 
 const WS_URL = "ws://" + window.location.host +"/ws";
+// sample decimation while a cat is on the scale and while idle (10 samples/s)
+const DECIMATION = { active: 1, idle: 5 };
+// number of points in the graph
+const HISTORY_SIZE = 300;
+const FRAME_VERSION = 2;
+const DELTA_ESCAPE = -32768;
 
 
 interface Measurement {
   timestamp: number;
   weight: number;
+  weightUnfiltered: number;
+}
+
+// decode a binary live frame (see LiveFrameHeader in LiveFrame.h)
+const decodeFrame = (buffer: ArrayBuffer): Array<Measurement> => {
+  const view = new DataView(buffer);
+  if (view.getUint8(0) !== FRAME_VERSION) {
+    return [];
+  }
+  let timestamp = view.getUint32(4, true);
+  const count = view.getUint16(8, true);
+  let offset = 10;
+  let previous = [0, 0];
+  const readValue = (channel: number) => {
+    const delta = view.getInt16(offset, true);
+    offset += 2;
+    if (delta === DELTA_ESCAPE) {
+      previous[channel] = view.getInt32(offset, true);
+      offset += 4;
+    } else {
+      previous[channel] += delta;
+    }
+    return previous[channel] / 10.;
+  };
+  let measurements = new Array<Measurement>();
+  for (let i = 0; i < count; i++) {
+    timestamp += view.getUint16(offset, true);
+    offset += 2;
+    const weight = readValue(0);
+    const weightUnfiltered = readValue(1);
+    measurements.push({ timestamp, weight, weightUnfiltered });
+  }
+  return measurements;
 }
 
 class Point implements Datum {
@@ -24,26 +63,29 @@ class MeasurementData implements Serie {
 
 const LiveMeasurements = () => {
   const [dataHistory, setDataHistory] = useState<Array<MeasurementData>>([new MeasurementData()]);
-  const { sendMessage, lastMessage, readyState } = useWebSocket(WS_URL, {
-    onOpen: () => {
+  const { lastMessage, readyState } = useWebSocket(WS_URL, {
+    onOpen: (event) => {
       console.log('opened');
+      (event.target as WebSocket).binaryType = "arraybuffer";
+      (event.target as WebSocket).send(JSON.stringify(DECIMATION));
     },
     share: true
   });
 
   useEffect(() => {
-    if (lastMessage !== null) {
-      let data = JSON.parse(lastMessage.data);
-      if (dataHistory[0].startTime <= 0) {
-        dataHistory[0].startTime = data.timestamp;
-      }
-      let p = new Point();
-      p.x = (data.timestamp - dataHistory[0].startTime) / 1000.;
-      p.y = data.weight;
-      dataHistory[0].data.push(p);
+    if (lastMessage !== null && lastMessage.data instanceof ArrayBuffer) {
+      decodeFrame(lastMessage.data).forEach(data => {
+        if (dataHistory[0].startTime <= 0) {
+          dataHistory[0].startTime = data.timestamp;
+        }
+        let p = new Point();
+        p.x = (data.timestamp - dataHistory[0].startTime) / 1000.;
+        p.y = data.weight;
+        dataHistory[0].data.push(p);
+      });
       // delete old values (ringbuffer)
-      if (dataHistory[0].data.length > 100) {
-        dataHistory[0].data.shift();
+      if (dataHistory[0].data.length > HISTORY_SIZE) {
+        dataHistory[0].data.splice(0, dataHistory[0].data.length - HISTORY_SIZE);
       }
       setDataHistory(dataHistory);
     }
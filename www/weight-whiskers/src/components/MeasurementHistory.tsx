@@ -17,6 +17,13 @@ export interface MeasurementCSV {
   dropping: number;
 }
 
+// GET /api/stats, days are [time, count, mean, min, max, dropping], hours and days are UTC
+export interface MeasurementStats {
+  total: number;
+  hours: Array<number>;
+  days: Array<Array<number>>;
+}
+
 class Point implements Datum {
   id: number = 0;
   x: string = "";
@@ -30,6 +37,20 @@ class MeasurementData implements Serie {
   data: Array<Point> = [];
 }
 
+class DayPoint implements Datum {
+  x: string = "";
+  // mean weight of the day
+  y: number = 0;
+  min: number = 0;
+  max: number = 0;
+  count: number = 0;
+}
+
+class DayData implements Serie {
+  id: string = 'Measured weight';
+  data: Array<DayPoint> = [];
+}
+
 type HistogramDatum = {
   hour: number,
   value: number
@@ -43,12 +64,39 @@ const CreateEmptyHistogram = () => {
   return histogram;
 }
 
+// the device aggregates in UTC, shift the hours to the local time of the browser
+const CreateLocalHistogram = (utcHours: Array<number>) => {
+  const offset = Math.round(-new Date().getTimezoneOffset() / 60);
+  let histogram = CreateEmptyHistogram();
+  utcHours.forEach((count, hour) => {
+    histogram[(hour + offset + 24) % 24].value += count;
+  });
+  return histogram;
+}
+
+// daily aggregates are kept for three months on the device
 enum MeasurementFilter {
   LastMonth = "Last month",
-  LastThreeMonths = "Last three months",
-  AllData = "All data"
+  LastThreeMonths = "Last three months"
+}
+
+const getFilterDays = (filter: MeasurementFilter) => {
+  return filter === MeasurementFilter.LastMonth ? 31 : 92;
 }
 
+// measurements of the last month are listed in the table
+const getTableStart = () => {
+  var startDate = new Date();
+  startDate.setMonth(startDate.getMonth() - 1);
+  startDate.setHours(0);
+  startDate.setMinutes(0);
+  startDate.setSeconds(0);
+  return Math.floor(startDate.getTime() / 1000.);
+}
+
+// deletes are applied to the aggregates in the background
+const STATS_RELOAD_DELAY = 2000;
+
 const useWindowSize = () => {
   const [size, setSize] = useState([window.innerWidth, window.innerHeight]);
 
@@ -65,86 +113,60 @@ const useWindowSize = () => {
 
 const MeasurementHistory = () => {
   const [dataFilter, setDataFilter] = useState<MeasurementFilter>(MeasurementFilter.LastMonth);
-  const [filteredData, setFilteredData] = useState<Array<MeasurementData>>([new MeasurementData()]);
+  const [dailyData, setDailyData] = useState<Array<DayData>>([new DayData()]);
   const [histogramData, setHistogramData] = useState<Array<HistogramDatum>>(CreateEmptyHistogram());
-  const [allData, setAllData] = useState<Array<MeasurementData>>([new MeasurementData()]);
+  const [tableData, setTableData] = useState<Array<MeasurementData>>([new MeasurementData()]);
+  // undefined while the aggregates are loading
+  const [stats, setStats] = useState<MeasurementStats | undefined>(undefined);
   const [windowWidth] = useWindowSize();
   const commonConfig = { delimiter: ",", dynamicTyping: true };
 
   // update measurements filter via dropdown
   const updateMeasurementsFilter = (event: ChangeEvent<HTMLSelectElement>) => {
-    // setFilteredData(dataHistory);
     setDataFilter(event.target.value as MeasurementFilter);
   }
 
-  // filter data
-  const filterMeasurements = () => {
-    var measurements = new MeasurementData();
-    const isAllData = dataFilter === MeasurementFilter.AllData;
-    if (isAllData) {
-      // create deep copy
-      measurements.data = JSON.parse(JSON.stringify(allData[0].data));
-      measurements.id = allData[0].id;
-    } else {
-      var startDate = new Date();
-      switch (dataFilter) {
-        case MeasurementFilter.LastMonth:
-          startDate.setMonth(startDate.getMonth() - 1);
-          break;
-        case MeasurementFilter.LastThreeMonths:
-          startDate.setMonth(startDate.getMonth() - 3);
-          break;
-      }
-      startDate.setHours(0);
-      startDate.setMinutes(0);
-      startDate.setSeconds(0);
-      measurements.data = allData[0].data.filter(d => {
-        if (d.rawData === undefined) {
-          return false;
-        }
-        // compare timestamps to prevent different data formats
-        return d.rawData?.time > startDate.getTime() / 1000.;
+  // load daily and hour-of-day aggregates
+  const loadStats = () => {
+    fetch(`/api/stats?days=${getFilterDays(dataFilter)}`)
+      .then(response => response.json())
+      .then((result: MeasurementStats) => {
+        console.log("Stats", result);
+        let days = new DayData();
+        result.days.forEach(([time, count, mean, min, max]) => {
+          days.data.push({
+            x: new Date(time * 1000).toLocaleDateString(undefined, { timeZone: "UTC" }),
+            y: mean,
+            min: min,
+            max: max,
+            count: count
+          });
+        });
+        setDailyData([days]);
+        setHistogramData(CreateLocalHistogram(result.hours));
+        setStats(result);
+      })
+      .catch((error) => {
+        console.log("Error");
       });
-
-      measurements.id = allData[0].id;
-    }
-    // calculate histogram
-    let newHistogram = CreateEmptyHistogram();
-    measurements.data.forEach(element => {
-      if (element.rawData?.time) {
-        let date = new Date(element.rawData?.time * 1000);
-        newHistogram[date.getHours()].value++;
-      }
-    });
-
-    // aggregate data if necessary
-    if (measurements.data.length > 500) {
-      const targetPoints = isAllData ? 600 : 300;
-      measurements.data = aggregateData(measurements.data, targetPoints);
-    }
-
-    // update data
-    setFilteredData([measurements]);
-    setHistogramData(newHistogram);
   }
 
   // on click table element
   const selectPoint = (event: React.MouseEvent<HTMLTableRowElement>, id: number) => {
     event.preventDefault();
-    var history = filteredData[0];
+    var history = tableData[0];
     var idx = history.data.findIndex(item => item.id === id);
     history.data[idx].selected = !history.data[idx].selected;
-    setFilteredData([
+    setTableData([
       { ...history, data: history.data }
     ]
     );
-    console.log(filteredData);
   }
 
   // send delete request to delete selected elements identified by timestamp
   const deleteSelectedPoints = (event: React.MouseEvent<HTMLButtonElement>) => {
     event.preventDefault();
-    var pointsToDelete = filteredData[0].data.filter(d => d.selected);
+    var pointsToDelete = tableData[0].data.filter(d => d.selected);
     var deletePayload = {
       action: "delete",
       timestamps: pointsToDelete.map(point => point.rawData?.time)
@@ -162,13 +184,14 @@ const MeasurementHistory = () => {
       .then((response) => {
         console.log(response.status);
         if (response.status === 200) {
-          setAllData([
+          setTableData([
             {
-              ...allData[0],
-              data: allData[0].data.filter(d => !d.selected)
+              ...tableData[0],
+              data: tableData[0].data.filter(d => !d.selected)
             }
           ]
           );
+          setTimeout(loadStats, STATS_RELOAD_DELAY);
         }
       })
       .catch((error) => {
@@ -176,16 +199,14 @@ const MeasurementHistory = () => {
       });
   }
 
-  // draw std dev hose around values
-  const StdDevLine = (props: any) => {
+  // draw the range of the daily weights around the mean
+  const RangeLine = (props: any) => {
     const { series, xScale, yScale } = props;
 
-    // Draw standard deviation lines
-    // Create an area layer to represent the "hose"
     const areaData = series[0].data.map((point: any) => ({
       x: xScale(point.data.x),
-      y0: yScale(point.data.y - point.data.rawData.std / 2), // Lower bound
-      y1: yScale(point.data.y + point.data.rawData.std / 2), // Upper bound
+      y0: yScale(point.data.min), // Lower bound
+      y1: yScale(point.data.max), // Upper bound
     }));
 
     return (
@@ -200,25 +221,6 @@ const MeasurementHistory = () => {
     );
   };
 
-  const SelectedMeasurements = (props: any) => {
-    const { series, xScale, yScale, innerHeight } = props;
-    const areaData = series[0].data.filter((d: any) => d.data.selected).map((point: any) => ({
-      x: xScale(point.data.x),
-    }));
-
-    return areaData.map((p: any) => (
-      (<line
-        key={p.x}
-        x1={p.x}
-        y1={0}
-        x2={p.x}
-        y2={innerHeight}
-        stroke="rgba(255, 0, 0, 1)"
-        strokeWidth={10}
-      />)
-    ));
-  };
-
   const MovingAverageLine = (props: any) => {
     const { series, xScale, yScale } = props;
 
@@ -269,104 +271,44 @@ const MeasurementHistory = () => {
     );
   };
 
-  const aggregateData = (data: Point[], targetPoints: number = 300): Point[] => {
-    // calculate group size by days
-    const totalDays = (data[data.length - 1].rawData!.time - data[0].rawData!.time) / (24 * 3600);
-    const daysPerGroup = Math.max(1, Math.ceil(totalDays / targetPoints));
-
-    // group data by time intervals
-    const groups = new Map<string, Point[]>();
-
-    data.forEach(point => {
-      if (!point.rawData) return;
-
-      // calculate group numer based on daysPerGroup
-      const daysSinceStart = Math.floor((point.rawData.time - data[0].rawData!.time) / (24 * 3600));
-      const groupNum = Math.floor(daysSinceStart / daysPerGroup);
-      const groupKey = `group_${groupNum}`;
-
-      if (!groups.has(groupKey)) {
-        groups.set(groupKey, []);
-      }
-      groups.get(groupKey)?.push(point);
-    });
-
-    // calculate average by group
-    const aggregatedData: Point[] = [];
-    groups.forEach((points) => {
-      const avgWeight = points.reduce((sum, p) => sum + p.y, 0) / points.length;
-      const avgStd = points.reduce((sum, p) => sum + (p.rawData?.std || 0), 0) / points.length;
-      const middlePoint = points[Math.floor(points.length / 2)];
-      const timestamp = middlePoint.rawData?.time || 0;
-
-      // format date based on group size
-      let dateStr;
-      if (daysPerGroup === 1) {
-        dateStr = new Date(timestamp * 1000).toLocaleDateString();
-      } else {
-        const startDate = new Date(points[0].rawData!.time * 1000).toLocaleDateString();
-        const endDate = new Date(points[points.length - 1].rawData!.time * 1000).toLocaleDateString();
-        dateStr = `${startDate} - ${endDate}`;
-      }
-
-      aggregatedData.push({
-        id: timestamp,
-        x: dateStr,
-        y: avgWeight,
-        selected: points.some(p => p.selected),
-        rawData: {
-          time: timestamp,
-          weight: avgWeight,
-          std: avgStd,
-          duration: 0,
-          dropping: 0
-        }
-      });
-    });
-
-    return aggregatedData.sort((a, b) => (a.rawData?.time || 0) - (b.rawData?.time || 0));
-  };
+  // load aggregates of the selected time range
+  useEffect(() => {
+    loadStats();
+  }, [dataFilter])
 
-  // load all measurements
+  // load the measurements of the table
   useEffect(() => {
-    if (allData[0].data.length === 0) {
-      // load data
-      Papa.parse(
-        "/api/measurements",
-        {
-          ...commonConfig,
-          header: true,
-          download: true,
-          complete: (result: Papa.ParseResult<MeasurementCSV>) => {
-            console.log("Parsed CSV data", result);
-            let measurementData = new MeasurementData();
-            measurementData.id = "Measured weight";
-            result.data.forEach((m, idx) => {
-              if (m.time > 0) {
-                measurementData.data.push({
-                  id: idx,
-                  x: new Date(m.time * 1000).toLocaleString(),
-                  y: m.weight,
-                  selected: false,
-                  rawData: m
-                })
-              }
-            });
-            let series = new Array<MeasurementData>(measurementData);
-            setAllData(series);
-          }
+    Papa.parse(
+      `/api/measurements?from=${getTableStart()}`,
+      {
+        ...commonConfig,
+        header: true,
+        download: true,
+        complete: (result: Papa.ParseResult<MeasurementCSV>) => {
+          console.log("Parsed CSV data", result);
+          let measurementData = new MeasurementData();
+          measurementData.id = "Measured weight";
+          result.data.forEach((m, idx) => {
+            if (m.time > 0) {
+              measurementData.data.push({
+                id: idx,
+                x: new Date(m.time * 1000).toLocaleString(),
+                y: m.weight,
+                selected: false,
+                rawData: m
+              })
+            }
+          });
+          setTableData([measurementData]);
         }
-      );
-    } else {
-      // filter data to update graph
-      filterMeasurements();
-    }
-  }, [dataFilter, allData])
+      }
+    );
+  }, [])
 
   return <>
     <div>
       <h1>Measurements</h1>
-      {allData[0].data.length === 0 ? <LoadingImage></LoadingImage> : null}
+      {stats === undefined ? <LoadingImage></LoadingImage> : null}
       <div style={{ textAlign: "center" }}>
         <div>Show data for</div>
         <select value={dataFilter} onChange={updateMeasurementsFilter}>
@@ -381,7 +323,7 @@ const MeasurementHistory = () => {
       <div style={{ height: "500px" }}>
         <ResponsiveLine
           enableSlices="x"
-          data={filteredData}
+          data={dailyData}
           margin={{ top: 10, right: 5, bottom: 150, left: 60 }}
           xScale={{ type: 'point' }}
           yScale={{
@@ -399,11 +341,11 @@ const MeasurementHistory = () => {
             legend: 'date',
             legendOffset: 110,
             legendPosition: 'middle',
-            tickValues: filteredData[0].data
+            tickValues: dailyData[0].data
               .filter((_, index) => {
                 // calculate maximum number of labels based on window width
                 const maxLabels = Math.max(5, Math.floor(windowWidth / 100));
-                const skipFactor = Math.ceil(filteredData[0].data.length / maxLabels);
+                const skipFactor = Math.ceil(dailyData[0].data.length / maxLabels);
                 return index % skipFactor === 0;
               })
               .map(d => d.x)
@@ -425,10 +367,9 @@ const MeasurementHistory = () => {
             'grid',
             'markers',
             'areas',
-            StdDevLine,
+            RangeLine,
             'lines',
             'slices',
-            SelectedMeasurements,
             'crosshair',
             'axes',
             'points',
@@ -531,7 +472,7 @@ const MeasurementHistory = () => {
     </div>
     <div>
       <table className="hoverable" style={{ overflowX: "hidden" }}>
-        <caption>Measurements table</caption>
+        <caption>Measurements of the last month</caption>
         <thead>
           <tr>
             <th>Date</th>
@@ -541,7 +482,7 @@ const MeasurementHistory = () => {
           </tr>
         </thead>
         <tbody>
-          {filteredData[0].data.map((row, idx) => (
+          {tableData[0].data.map((row, idx) => (
             <tr key={row.id} onClick={e => selectPoint(e, row.id)} className={(row.selected ? 'selected' : '')}>
               <td data-label="Date" className={(row.selected ? 'primary' : '')}>{row.x}</td>
               <td data-label="Weight">{row.y}</td>
@@ -551,7 +492,7 @@ const MeasurementHistory = () => {
           ))}
         </tbody>
       </table>
-      <button onClick={deleteSelectedPoints}>Delete selected ({allData[0].data.filter(item => item.selected).length})</button>
+      <button onClick={deleteSelectedPoints}>Delete selected ({tableData[0].data.filter(item => item.selected).length})</button>
     </div>
   </>
 }
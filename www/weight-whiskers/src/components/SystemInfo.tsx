@@ -12,6 +12,13 @@ export interface SystemStateWifi {
   rssi: number | undefined;
 }
 
+export interface SystemStateScale {
+  samples: number | undefined;
+  dropped: number | undefined;
+  timeouts: number | undefined;
+  overruns: number | undefined;
+}
+
 export interface SystemStateSystem {
   cpu: string | undefined;
   freq: number | undefined;
@@ -24,6 +31,7 @@ export interface SystemStateSystem {
 export interface SystemState {
   flash: SystemStateFlash | undefined;
   wifi: SystemStateWifi | undefined;
+  scale: SystemStateScale | undefined;
   system: SystemStateSystem | undefined;
 }
 
@@ -48,6 +56,7 @@ const SystemInfoComponent = () => {
   const initState = {
     flash: undefined,
     wifi: undefined,
+    scale: undefined,
     system: undefined
   };
 
@@ -82,6 +91,15 @@ const SystemInfoComponent = () => {
               <h2>WiFi</h2>
               <span>WiFi RSSI: {state.wifi?.rssi} dB</span>
             </div>
+            <div>
+              <h2>Scale</h2>
+              <ul>
+                <li>Samples: {state.scale?.samples}</li>
+                <li>Dropped samples: {state.scale?.dropped}</li>
+                <li>HX711 timeouts: {state.scale?.timeouts}</li>
+                <li>Buffer overruns: {state.scale?.overruns}</li>
+              </ul>
+            </div>
             <div>
               <h2>System</h2>
               <ul>